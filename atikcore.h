@@ -31,48 +31,51 @@
     #define ATIK_DEBUG 0
     #endif
 
+    // opaque handle of opened camera: each camera has its own state, so
+    // different cameras could be used from different threads simultaneously
+    typedef struct atikcam atikcam;
+
     #ifdef __cplusplus
         extern "C" int atik_list_create();
         extern "C" char *atik_list_get();
         extern "C" void atik_list_destroy();
         extern "C" int atik_list_cleanup(char *camname);
         extern "C" int atik_list_item_count();
-        extern "C" int atik_list_item_select(char *camname);
         extern "C" int atik_list_item_destroy(char *camname);
-        extern "C" const char *atik_camera_name();
-        extern "C" int atik_camera_open();
-        extern "C" void atik_camera_close();
-        extern "C" int atik_camera_setParam(PARAM_TYPE code, long value);
-        extern "C" AtikCapabilities *atik_camera_getCapabilities();
-        extern "C" CAMERA_TYPE atik_camera_getType();
-        extern "C" int atik_camera_getTemperatureSensorStatus(unsigned int sensor, float *currentTemp);
-        extern "C" int atik_camera_getCoolingStatus(COOLING_STATE *state, float *targetTemp, float *power);
-        extern "C" int atik_camera_setCooling(float targetTemp);
-        extern "C" int atik_camera_initiateWarmUp();
-        extern "C" int atik_camera_getFilterWheelStatus(unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target);
-        extern "C" int atik_camera_setFilter(unsigned int index);
-        extern "C" int atik_camera_setPreviewMode(int useMode);
-        extern "C" int atik_camera_set8BitMode(int useMode);
-        extern "C" int atik_camera_setDarkFrameMode(int useMode);
-        extern "C" int atik_camera_startExposure(int amp);
-        extern "C" int atik_camera_abortExposure();
-        extern "C" int atik_camera_readCCD(unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY);
-        extern "C" int atik_camera_readCCD_delay(unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay);
-        extern "C" int atik_camera_getImage(unsigned short *imgBuf, unsigned int imgSize);
-        extern "C" int atik_camera_setShutter(int open);
-        extern "C" int atik_camera_setGuideRelays(unsigned short mask);
-        extern "C" int atik_camera_setGPIODirection(unsigned short mask);
-        extern "C" int atik_camera_getGPIO(unsigned short *mask);
-        extern "C" int atik_camera_setGPIO(unsigned short mask);
-        extern "C" int atik_camera_getGain(int *gain, int *offset);
-        extern "C" int atik_camera_setGain(int gain, int offset);
-        extern "C" unsigned int atik_camera_delay(double delay);
-        extern "C" unsigned int atik_camera_imageWidth(unsigned int width, unsigned int binX);
-        extern "C" unsigned int atik_camera_imageHeight(unsigned int height, unsigned int binY);
+        extern "C" const char *atik_camera_name(atikcam *cam);
+        extern "C" atikcam *atik_camera_open(const char *camname);
+        extern "C" void atik_camera_close(atikcam *cam);
+        extern "C" int atik_camera_setParam(atikcam *cam, PARAM_TYPE code, long value);
+        extern "C" AtikCapabilities *atik_camera_getCapabilities(atikcam *cam);
+        extern "C" CAMERA_TYPE atik_camera_getType(atikcam *cam);
+        extern "C" int atik_camera_getTemperatureSensorStatus(atikcam *cam, unsigned int sensor, float *currentTemp);
+        extern "C" int atik_camera_getCoolingStatus(atikcam *cam, COOLING_STATE *state, float *targetTemp, float *power);
+        extern "C" int atik_camera_setCooling(atikcam *cam, float targetTemp);
+        extern "C" int atik_camera_initiateWarmUp(atikcam *cam);
+        extern "C" int atik_camera_getFilterWheelStatus(atikcam *cam, unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target);
+        extern "C" int atik_camera_setFilter(atikcam *cam, unsigned int index);
+        extern "C" int atik_camera_setPreviewMode(atikcam *cam, int useMode);
+        extern "C" int atik_camera_set8BitMode(atikcam *cam, int useMode);
+        extern "C" int atik_camera_setDarkFrameMode(atikcam *cam, int useMode);
+        extern "C" int atik_camera_startExposure(atikcam *cam, int amp);
+        extern "C" int atik_camera_abortExposure(atikcam *cam);
+        extern "C" int atik_camera_readCCD(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY);
+        extern "C" int atik_camera_readCCD_delay(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay);
+        extern "C" int atik_camera_getImage(atikcam *cam, unsigned short *imgBuf, unsigned int imgSize);
+        extern "C" int atik_camera_setShutter(atikcam *cam, int open);
+        extern "C" int atik_camera_setGuideRelays(atikcam *cam, unsigned short mask);
+        extern "C" int atik_camera_setGPIODirection(atikcam *cam, unsigned short mask);
+        extern "C" int atik_camera_getGPIO(atikcam *cam, unsigned short *mask);
+        extern "C" int atik_camera_setGPIO(atikcam *cam, unsigned short mask);
+        extern "C" int atik_camera_getGain(atikcam *cam, int *gain, int *offset);
+        extern "C" int atik_camera_setGain(atikcam *cam, int gain, int offset);
+        extern "C" unsigned int atik_camera_delay(atikcam *cam, double delay);
+        extern "C" unsigned int atik_camera_imageWidth(atikcam *cam, unsigned int width, unsigned int binX);
+        extern "C" unsigned int atik_camera_imageHeight(atikcam *cam, unsigned int height, unsigned int binY);
 
-        extern "C" int atik_camera_getColorId();
-        extern "C" char *atik_camera_getBinList();
-        extern "C" char *atik_camera_getCfwList();
+        extern "C" int atik_camera_getColorId(atikcam *cam);
+        extern "C" char *atik_camera_getBinList(atikcam *cam);
+        extern "C" char *atik_camera_getCfwList(atikcam *cam);
     #else
         // The following definitions are copied from original <atikccdusb.h>
         // Inclusion of that file from within a c source is not possible
@@ -127,42 +130,41 @@
         void atik_list_destroy();
         int atik_list_cleanup(char *camname);
         int atik_list_item_count();
-        int atik_list_item_select(char *camname);
         int atik_list_item_destroy(char *camname);
-        const char *atik_camera_name();
-        int atik_camera_open();
-        void atik_camera_close();
-        int atik_camera_setParam(PARAM_TYPE code, long value);
-        AtikCapabilities *atik_camera_getCapabilities();
-        CAMERA_TYPE atik_camera_getType();
-        int atik_camera_getTemperatureSensorStatus(unsigned int sensor, float *currentTemp);
-        int atik_camera_getCoolingStatus(COOLING_STATE *state, float *targetTemp, float *power);
-        int atik_camera_setCooling(float targetTemp);
-        int atik_camera_initiateWarmUp();
-        int atik_camera_getFilterWheelStatus(unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target);
-        int atik_camera_setFilter(unsigned int index);
-        int atik_camera_setPreviewMode(int useMode);
-        int atik_camera_set8BitMode(int useMode);
-        int atik_camera_setDarkFrameMode(int useMode);
-        int atik_camera_startExposure(int amp);
-        int atik_camera_abortExposure();
-        int atik_camera_readCCD(unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY);
-        int atik_camera_readCCD_delay(unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay);
-        int atik_camera_getImage(unsigned short *imgBuf, unsigned int imgSize);
-        int atik_camera_setShutter(int open);
-        int atik_camera_setGuideRelays(unsigned short mask);
-        int atik_camera_setGPIODirection(unsigned short mask);
-        int atik_camera_getGPIO(unsigned short *mask);
-        int atik_camera_setGPIO(unsigned short mask);
-        int atik_camera_getGain(int *gain, int *offset);
-        int atik_camera_setGain(int gain, int offset);
-        unsigned int atik_camera_delay(double delay);
-        unsigned int atik_camera_imageWidth(unsigned int width, unsigned int binX);
-        unsigned int atik_camera_imageHeight(unsigned int height, unsigned int binY);
+        const char *atik_camera_name(atikcam *cam);
+        atikcam *atik_camera_open(const char *camname);
+        void atik_camera_close(atikcam *cam);
+        int atik_camera_setParam(atikcam *cam, PARAM_TYPE code, long value);
+        AtikCapabilities *atik_camera_getCapabilities(atikcam *cam);
+        CAMERA_TYPE atik_camera_getType(atikcam *cam);
+        int atik_camera_getTemperatureSensorStatus(atikcam *cam, unsigned int sensor, float *currentTemp);
+        int atik_camera_getCoolingStatus(atikcam *cam, COOLING_STATE *state, float *targetTemp, float *power);
+        int atik_camera_setCooling(atikcam *cam, float targetTemp);
+        int atik_camera_initiateWarmUp(atikcam *cam);
+        int atik_camera_getFilterWheelStatus(atikcam *cam, unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target);
+        int atik_camera_setFilter(atikcam *cam, unsigned int index);
+        int atik_camera_setPreviewMode(atikcam *cam, int useMode);
+        int atik_camera_set8BitMode(atikcam *cam, int useMode);
+        int atik_camera_setDarkFrameMode(atikcam *cam, int useMode);
+        int atik_camera_startExposure(atikcam *cam, int amp);
+        int atik_camera_abortExposure(atikcam *cam);
+        int atik_camera_readCCD(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY);
+        int atik_camera_readCCD_delay(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay);
+        int atik_camera_getImage(atikcam *cam, unsigned short *imgBuf, unsigned int imgSize);
+        int atik_camera_setShutter(atikcam *cam, int open);
+        int atik_camera_setGuideRelays(atikcam *cam, unsigned short mask);
+        int atik_camera_setGPIODirection(atikcam *cam, unsigned short mask);
+        int atik_camera_getGPIO(atikcam *cam, unsigned short *mask);
+        int atik_camera_setGPIO(atikcam *cam, unsigned short mask);
+        int atik_camera_getGain(atikcam *cam, int *gain, int *offset);
+        int atik_camera_setGain(atikcam *cam, int gain, int offset);
+        unsigned int atik_camera_delay(atikcam *cam, double delay);
+        unsigned int atik_camera_imageWidth(atikcam *cam, unsigned int width, unsigned int binX);
+        unsigned int atik_camera_imageHeight(atikcam *cam, unsigned int height, unsigned int binY);
 
-        int atik_camera_getColorId();
-        char *atik_camera_getBinList();
-        char *atik_camera_getCfwList();
+        int atik_camera_getColorId(atikcam *cam);
+        char *atik_camera_getBinList(atikcam *cam);
+        char *atik_camera_getCfwList(atikcam *cam);
     #endif
 #endif
 
@@ -0,0 +1,618 @@
+/*
+ * atiksim.c - simulated camera with the same API as cAtik.cpp
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Simulated camera for work without hardware (cmake -DUSE_SIM=yes): star field
+ * with gaussian PSF, sky, dark current depending on CCD temperature, photon &
+ * readout noise, readout time proportional to amount of pixels, cooling with
+ * limited rate, shutter and filter wheel. Parameters are given by environment
+ * variable ATIKSIM="key=value,key=value,...", keys are:
+ *  width, height   - sensor size (pix)
+ *  pixsize         - pixel size (um)
+ *  readout         - readout time of full frame (s)
+ *  maxshort        - max length of short exposure (s)
+ *  bias, ron       - bias level (ADU) and readout noise (e-)
+ *  gain            - e- per ADU
+ *  dark            - dark current at 0degrC (e-/s/pix), doubles each 6 degrees
+ *  sky             - sky level (e-/s/pix)
+ *  skytrend        - exponential change of sky level (1/s), e.g. -0.01 for
+ *                    twilight: sky is sky*exp(skytrend*t) at t seconds after open
+ *  stars, fwhm     - amount of stars and their FWHM (pix)
+ *  maxflux         - flux of the brightest star (e-/s)
+ *  seed            - random seed
+ *  ambient         - ambient temperature (degrC)
+ *  coolrate        - max speed of temperature change (degr/s)
+ *  coolmax         - max difference between ambient and CCD temperatures
+ *  filters         - amount of filter wheel positions (0 - no wheel)
+ *  shutter         - camera has shutter (0/1)
+ *  cameras         - amount of simulated cameras (each has its own star field)
+ *  driftx, drifty  - drift of mount (pix/s), star field moves with it
+ *  guiderate       - speed of mount moved by guide relays (pix/s): EAST/WEST
+ *                    move field along X, NORTH/SOUTH - along Y
+ *  bayer           - colour filter array as returned by atik_camera_getColorId():
+ *                    0 - monochrome, 1 - GBRG, 2 - RGGB, 3 - GRBG, 4 - BGGR
+ * Each opened camera (handle) has its own state, so several cameras could be
+ * used from different threads simultaneously.
+ */
+
+#ifdef ATIK_SIMULATOR
+
+#include <math.h>
+#include <time.h>
+#include "atikcore.h"
+#include "usefull_macros.h"
+
+#define SIMNAME     "Atik Simulator"
+#define NGAUSS      (65536)     // size of table with normal distribution
+#define FWMOVETIME  (0.5)       // time to move filter wheel to next position (s)
+#define OPENED(cam) ((cam) && (cam)->opened)
+
+static struct{
+    double width, height, pixsize, readout, maxshort, bias, ron, gain, dark, sky;
+    double stars, fwhm, maxflux, seed, ambient, coolrate, coolmax, filters, shutter, cameras;
+    double bayer, driftx, drifty, guiderate, skytrend;
+} conf = {
+    .width = 1392, .height = 1040, .pixsize = 6.45, .readout = 0.5, .maxshort = 2.,
+    .bias = 1000., .ron = 8., .gain = 0.5, .dark = 0.1, .sky = 20.,
+    .stars = 100., .fwhm = 3., .maxflux = 1e5, .seed = 1., .ambient = 20.,
+    .coolrate = 0.5, .coolmax = 40., .filters = 5., .shutter = 1., .cameras = 1.,
+    .guiderate = 5.
+};
+
+static const struct{
+    const char *key;
+    double *val;
+} confkeys[] = {
+    {"width", &conf.width}, {"height", &conf.height}, {"pixsize", &conf.pixsize},
+    {"readout", &conf.readout}, {"maxshort", &conf.maxshort}, {"bias", &conf.bias},
+    {"ron", &conf.ron}, {"gain", &conf.gain}, {"dark", &conf.dark}, {"sky", &conf.sky},
+    {"stars", &conf.stars}, {"fwhm", &conf.fwhm}, {"maxflux", &conf.maxflux},
+    {"seed", &conf.seed}, {"ambient", &conf.ambient}, {"coolrate", &conf.coolrate},
+    {"coolmax", &conf.coolmax}, {"filters", &conf.filters}, {"shutter", &conf.shutter},
+    {"cameras", &conf.cameras}, {"bayer", &conf.bayer},
+    {"driftx", &conf.driftx}, {"drifty", &conf.drifty}, {"guiderate", &conf.guiderate},
+    {"skytrend", &conf.skytrend}, {NULL, NULL}
+};
+
+struct atikcam{
+    char name[CAMLENGTH+1];
+    int opened;
+    int shutter;            // shutter is opened by command
+    int darkmode, mode8bit, preview;
+    int exposing;           // long exposure is going on
+    double expstart;        // its start time
+    double temp, target;    // CCD temperature & setpoint
+    double tlast;           // time of last temperature update
+    int cooling, warming;
+    double power;           // cooler power (%)
+    unsigned int filter, ftarget; // current & target filter wheel positions
+    double fwstart;         // time of filter wheel movement start
+    unsigned short relays, gpio, gpiodir;
+    double mx, my;          // shift of star field by mount drift & guiding (pix)
+    double mlast;           // time of its last update
+    double topen;           // time of opening
+    int gain, offset;
+    uint16_t *image;        // last image read
+    unsigned int imgsize;   // its size (pixels)
+    AtikCapabilities camcapabilities;
+    float *field;           // stars' flux (e-/s/pix)
+    uint64_t rndstate;
+    char binList[CAMLENGTH+1];
+    char cfwList[CAMLENGTH+1];
+};
+
+static atikcam cams[MAX_CAMERA];
+static int ncams = 0;       // amount of listed cameras
+static float gauss[NGAUSS]; // normal distribution (common for all cameras)
+static char cameraList[MAX_CAMERA * (CAMLENGTH+1) + 1];
+
+static double mono(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void simsleep(double t){
+    if(t <= 0.) return;
+    struct timespec ts = {.tv_sec = (time_t)t, .tv_nsec = (long)((t - (time_t)t) * 1e9)};
+    while(nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+// xorshift64*
+static inline uint64_t rnd(uint64_t *state){
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static double urnd(uint64_t *state){ // (0, 1]
+    return ((rnd(state) >> 11) + 1.) / 9007199254740992.;
+}
+
+static void readconf(){
+    char *env = getenv("ATIKSIM");
+    if(!env) return;
+    char *str = strdup(env), *saveptr = NULL;
+    for(char *tok = strtok_r(str, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)){
+        char *val = strchr(tok, '=');
+        int found = 0;
+        if(val){
+            *val++ = 0;
+            for(int i = 0; confkeys[i].key; ++i){
+                if(strcmp(tok, confkeys[i].key)) continue;
+                char *eptr;
+                double d = strtod(val, &eptr);
+                if(eptr != val && !*eptr){
+                    *confkeys[i].val = d;
+                    found = 1;
+                }
+                break;
+            }
+        }
+        if(!found) WARNX("ATIKSIM: bad parameter '%s'", tok);
+    }
+    FREE(str);
+    if(conf.width < 1.) conf.width = 1.;
+    if(conf.height < 1.) conf.height = 1.;
+    if(conf.gain <= 0.) conf.gain = 1.;
+    if(conf.fwhm <= 0.) conf.fwhm = 1.;
+    if(conf.cameras < 1.) conf.cameras = 1.;
+    if(conf.cameras > MAX_CAMERA) conf.cameras = MAX_CAMERA;
+}
+
+// table of normal distribution
+static void mkgauss(){
+    uint64_t state = (uint64_t)conf.seed * 0x9E3779B97F4A7C15ULL + 1;
+    for(int i = 0; i < NGAUSS; i += 2){ // Box-Muller
+        double r = sqrt(-2. * log(urnd(&state))), phi = 2. * M_PI * urnd(&state);
+        gauss[i] = r * cos(phi);
+        gauss[i+1] = r * sin(phi);
+    }
+}
+
+// make star field of camera (different cameras look at different fields)
+static void mkfield(atikcam *cam){
+    int w = (int)conf.width, h = (int)conf.height;
+    uint64_t *st = &cam->rndstate;
+    *st = ((uint64_t)conf.seed + (cam - cams)) * 0x9E3779B97F4A7C15ULL + 1;
+    FREE(cam->field);
+    float *field = cam->field = MALLOC(float, (size_t)w * h);
+    double sigma = conf.fwhm / 2.3548, s2 = 2. * sigma * sigma;
+    int rad = (int)(3. * conf.fwhm) + 1;
+    for(int n = 0; n < (int)conf.stars; ++n){
+        double x0 = urnd(st) * w, y0 = urnd(st) * h, u = urnd(st);
+        double flux = conf.maxflux * u * u * u; // more faint stars
+        double amp = flux / (M_PI * s2);
+        for(int y = (int)y0 - rad; y <= (int)y0 + rad; ++y){
+            if(y < 0 || y >= h) continue;
+            float *row = &field[(size_t)y * w];
+            double dy2 = (y + 0.5 - y0) * (y + 0.5 - y0);
+            for(int x = (int)x0 - rad; x <= (int)x0 + rad; ++x){
+                if(x < 0 || x >= w) continue;
+                double dx = x + 0.5 - x0;
+                row[x] += (float)(amp * exp(-(dx * dx + dy2) / s2));
+            }
+        }
+    }
+}
+
+// change CCD temperature since last call
+static void update_temp(atikcam *cam){
+    double now = mono(), dt = now - cam->tlast;
+    cam->tlast = now;
+    double goal = conf.ambient;
+    if(cam->cooling && !cam->warming){
+        goal = cam->target;
+        if(goal < conf.ambient - conf.coolmax) goal = conf.ambient - conf.coolmax;
+    }
+    double d = goal - cam->temp, step = conf.coolrate * dt;
+    if(fabs(d) <= step){
+        cam->temp = goal;
+        if(cam->warming) cam->warming = cam->cooling = 0;
+    }else cam->temp += (d > 0.) ? step : -step;
+    cam->power = (cam->cooling && conf.coolmax > 0.) ? 100. * (conf.ambient - cam->temp) / conf.coolmax : 0.;
+    if(cam->power < 0.) cam->power = 0.;
+}
+
+// move mount since last call
+static void update_mount(atikcam *cam){
+    double now = mono(), dt = now - cam->mlast;
+    cam->mlast = now;
+    int ew = !!(cam->relays & GUIDE_EAST) - !!(cam->relays & GUIDE_WEST);
+    int ns = !!(cam->relays & GUIDE_NORTH) - !!(cam->relays & GUIDE_SOUTH);
+    cam->mx += (conf.driftx + ew * conf.guiderate) * dt;
+    cam->my += (conf.drifty + ns * conf.guiderate) * dt;
+}
+
+// flux of shifted star field in sensor pixel (x, y), bilinear interpolation
+static float field_at(const atikcam *cam, unsigned int x, unsigned int y){
+    int w = (int)conf.width, h = (int)conf.height;
+    double fx = x - cam->mx, fy = y - cam->my;
+    int ix = (int)floor(fx), iy = (int)floor(fy);
+    float tx = (float)(fx - ix), ty = (float)(fy - iy), v = 0.f;
+    for(int j = 0; j < 2; ++j){
+        int yy = iy + j;
+        if(yy < 0 || yy >= h) continue;
+        const float *row = &cam->field[(size_t)yy * w];
+        float wy = j ? ty : 1.f - ty;
+        if(ix >= 0 && ix < w) v += wy * (1.f - tx) * row[ix];
+        if(ix + 1 >= 0 && ix + 1 < w) v += wy * tx * row[ix + 1];
+    }
+    return v;
+}
+
+/**
+ * Make simulated image of given part of sensor
+ * @param exptime - exposure time (s)
+ * @return 1 if all OK
+ */
+static int mkimage(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY,
+                   unsigned int binX, unsigned int binY, double exptime){
+    unsigned int w = (unsigned int)conf.width, h = (unsigned int)conf.height;
+    if(!OPENED(cam) || binX < 1 || binY < 1 || startX >= w || startY >= h) return 0;
+    if(startX + sizeX > w) sizeX = w - startX;
+    if(startY + sizeY > h) sizeY = h - startY;
+    unsigned int ow = sizeX / binX, oh = sizeY / binY;
+    if(!ow || !oh) return 0;
+    double t0 = mono();
+    if(cam->imgsize != ow * oh){
+        FREE(cam->image);
+        cam->imgsize = ow * oh;
+        cam->image = MALLOC(uint16_t, cam->imgsize);
+    }
+    update_temp(cam);
+    update_mount(cam);
+    int shifted = (cam->mx != 0. || cam->my != 0.);
+    int light = !cam->darkmode;
+    double nb = binX * binY;
+    double darke = conf.dark * pow(2., cam->temp / 6.) * exptime * nb;
+    double sky = conf.sky * exp(conf.skytrend * (t0 - exptime / 2. - cam->topen));
+    double skye = light ? sky * exptime * nb : 0.;
+    double ron2 = conf.ron * conf.ron * nb;
+    uint16_t *out = cam->image;
+    for(unsigned int y = 0; y < oh; ++y){
+        for(unsigned int x = 0; x < ow; ++x){
+            double s = darke + skye;
+            if(light){
+                float flux = 0.f;
+                for(unsigned int by = 0; by < binY; ++by){
+                    unsigned int sy = startY + y * binY + by, sx = startX + x * binX;
+                    if(shifted){
+                        for(unsigned int bx = 0; bx < binX; ++bx) flux += field_at(cam, sx + bx, sy);
+                        continue;
+                    }
+                    const float *in = &cam->field[(size_t)sy * w + sx];
+                    for(unsigned int bx = 0; bx < binX; ++bx) flux += in[bx];
+                }
+                s += flux * exptime;
+            }
+            double v = conf.bias + (s + sqrt(s + ron2) * gauss[rnd(&cam->rndstate) & (NGAUSS - 1)]) / conf.gain;
+            if(v < 0.) v = 0.;
+            else if(v > 65535.) v = 65535.;
+            if(cam->mode8bit) v /= 256.;
+            *out++ = (uint16_t)v;
+        }
+    }
+    // readout time proportional to amount of pixels read
+    simsleep(conf.readout * ((double)sizeX * sizeY) / ((double)w * h) - (mono() - t0));
+    return 1;
+}
+
+int atik_list_create(){
+    readconf();
+    mkgauss();
+    ncams = (int)conf.cameras;
+    cameraList[0] = 0;
+    for(int i = 0; i < ncams; ++i){
+        if(i) snprintf(cams[i].name, CAMLENGTH, SIMNAME " %d", i + 1);
+        else snprintf(cams[i].name, CAMLENGTH, SIMNAME);
+        strcat(cameraList, "|");
+        strcat(cameraList, cams[i].name);
+    }
+    return ncams;
+}
+
+char *atik_list_get(){
+    return cameraList;
+}
+
+void atik_list_destroy(){
+    for(int i = 0; i < ncams; ++i){
+        atik_camera_close(&cams[i]);
+        FREE(cams[i].field);
+        FREE(cams[i].image);
+        cams[i].imgsize = 0;
+    }
+    ncams = 0;
+}
+
+int atik_list_cleanup(_U_ char *camname){
+    return 1;
+}
+
+int atik_list_item_count(){
+    return ncams;
+}
+
+int atik_list_item_destroy(char *camname){
+    for(int i = 0; i < ncams; ++i)
+        if(strcmp(camname, cams[i].name) == 0) return 1;
+    return 0;
+}
+
+const char *atik_camera_name(atikcam *cam){
+    return cam ? cam->name : "";
+}
+
+atikcam *atik_camera_open(const char *camname){
+    atikcam *cam = NULL;
+    for(int i = 0; i < ncams; ++i){
+        if(cams[i].opened) continue;
+        if(camname && strcmp(camname, cams[i].name)) continue;
+        cam = &cams[i];
+        break;
+    }
+    if(!cam) return NULL;
+    AtikCapabilities *c = &cam->camcapabilities;
+    memset(c, 0, sizeof(AtikCapabilities));
+    c->hasShutter = (conf.shutter > 0.);
+    c->hasGuidePort = 1;
+    c->has8BitMode = 1;
+    c->hasFilterWheel = (conf.filters >= 1.);
+    c->lineCount = (unsigned int)conf.height;
+    c->pixelCountX = (unsigned int)conf.width;
+    c->pixelCountY = (unsigned int)conf.height;
+    c->pixelSizeX = c->pixelSizeY = conf.pixsize;
+    c->maxBinX = c->maxBinY = 8;
+    c->tempSensorCount = 1;
+    c->cooler = COOLER_SETPOINT;
+    c->colour = COLOUR_NONE;
+    int bayer = (int)conf.bayer;
+    if(bayer > 0 && bayer < 5){ // offsets of RGGB array as in real camera
+        c->colour = COLOUR_RGGB;
+        c->offsetX = (bayer == 3 || bayer == 4);
+        c->offsetY = (bayer == 1 || bayer == 4);
+    }
+    c->supportsLongExposure = 1;
+    c->minShortExposure = 0.001;
+    c->maxShortExposure = conf.maxshort;
+    cam->binList[0] = 0;
+    for(int i = 1; i <= 8; ++i){
+        char tmpstr[16];
+        sprintf(tmpstr, "%dx%d|", i, i);
+        strcat(cam->binList, tmpstr);
+    }
+    strcat(cam->binList, ":0");
+    cam->cfwList[0] = 0;
+    if(c->hasFilterWheel) snprintf(cam->cfwList, CAMLENGTH, "%u-CFW|:0", (unsigned int)conf.filters);
+    mkfield(cam);
+    cam->temp = conf.ambient;
+    cam->tlast = cam->mlast = cam->topen = mono();
+    cam->mx = cam->my = 0.;
+    cam->relays = 0;
+    cam->cooling = cam->warming = 0;
+    cam->filter = cam->ftarget = 0;
+    cam->opened = 1;
+    DBG("simulated camera '%s' %gx%g, %g stars", cam->name, conf.width, conf.height, conf.stars);
+    return cam;
+}
+
+void atik_camera_close(atikcam *cam){
+    if(!cam) return;
+    cam->opened = 0;
+    cam->exposing = 0;
+}
+
+int atik_camera_setParam(atikcam *cam, _U_ PARAM_TYPE code, _U_ long value){
+    return OPENED(cam);
+}
+
+AtikCapabilities *atik_camera_getCapabilities(atikcam *cam){
+    return cam ? &cam->camcapabilities : NULL;
+}
+
+CAMERA_TYPE atik_camera_getType(_U_ atikcam *cam){
+    return SONY_SCI;
+}
+
+int atik_camera_getTemperatureSensorStatus(atikcam *cam, unsigned int sensor, float *currentTemp){
+    if(!OPENED(cam) || sensor != 1) return 0;
+    update_temp(cam);
+    if(currentTemp) *currentTemp = (float)cam->temp;
+    return 1;
+}
+
+int atik_camera_getCoolingStatus(atikcam *cam, COOLING_STATE *state, float *targetTemp, float *power){
+    if(!OPENED(cam)) return 0;
+    update_temp(cam);
+    if(state){
+        if(cam->warming) *state = WARMING_UP;
+        else if(cam->cooling) *state = COOLING_SETPOINT;
+        else *state = COOLING_INACTIVE;
+    }
+    if(targetTemp) *targetTemp = (float)cam->target;
+    if(power) *power = (float)cam->power;
+    return 1;
+}
+
+int atik_camera_setCooling(atikcam *cam, float targetTemp){
+    if(!OPENED(cam)) return 0;
+    update_temp(cam);
+    cam->target = targetTemp;
+    cam->cooling = 1;
+    cam->warming = 0;
+    return 1;
+}
+
+int atik_camera_initiateWarmUp(atikcam *cam){
+    if(!OPENED(cam)) return 0;
+    update_temp(cam);
+    if(cam->cooling) cam->warming = 1;
+    return 1;
+}
+
+int atik_camera_getFilterWheelStatus(atikcam *cam, unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target){
+    if(!OPENED(cam) || !cam->camcapabilities.hasFilterWheel) return 0;
+    unsigned int n = (unsigned int)conf.filters;
+    unsigned int dist = (cam->ftarget + n - cam->filter) % n; // wheel rotates in one direction
+    int mv = (mono() - cam->fwstart < dist * FWMOVETIME);
+    if(!mv) cam->filter = cam->ftarget;
+    if(filterCount) *filterCount = n;
+    if(moving) *moving = mv;
+    if(current) *current = cam->filter;
+    if(target) *target = cam->ftarget;
+    return 1;
+}
+
+int atik_camera_setFilter(atikcam *cam, unsigned int index){
+    if(!OPENED(cam) || !cam->camcapabilities.hasFilterWheel || index >= (unsigned int)conf.filters) return 0;
+    atik_camera_getFilterWheelStatus(cam, NULL, NULL, NULL, NULL);
+    cam->ftarget = index;
+    cam->fwstart = mono();
+    return 1;
+}
+
+int atik_camera_setPreviewMode(atikcam *cam, int useMode){
+    if(!OPENED(cam)) return 0;
+    cam->preview = (useMode != 0);
+    return 1;
+}
+
+int atik_camera_set8BitMode(atikcam *cam, int useMode){
+    if(!OPENED(cam)) return 0;
+    cam->mode8bit = (useMode != 0);
+    return 1;
+}
+
+int atik_camera_setDarkFrameMode(atikcam *cam, int useMode){
+    if(!OPENED(cam)) return 0;
+    cam->darkmode = (useMode != 0);
+    return 1;
+}
+
+int atik_camera_startExposure(atikcam *cam, _U_ int amp){
+    if(!OPENED(cam)) return 0;
+    cam->exposing = 1;
+    cam->expstart = mono();
+    return 1;
+}
+
+int atik_camera_abortExposure(atikcam *cam){
+    if(!OPENED(cam)) return 0;
+    cam->exposing = 0;
+    return 1;
+}
+
+int atik_camera_readCCD(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY){
+    if(!OPENED(cam) || !cam->exposing) return 0;
+    cam->exposing = 0;
+    return mkimage(cam, startX, startY, sizeX, sizeY, binX, binY, mono() - cam->expstart);
+}
+
+int atik_camera_readCCD_delay(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay){
+    if(!OPENED(cam)) return 0;
+    simsleep(delay);
+    return mkimage(cam, startX, startY, sizeX, sizeY, binX, binY, delay);
+}
+
+int atik_camera_getImage(atikcam *cam, unsigned short *imgBuf, unsigned int imgSize){
+    if(!cam || !cam->image || !imgBuf) return 0;
+    if(imgSize > cam->imgsize) imgSize = cam->imgsize;
+    memcpy(imgBuf, cam->image, imgSize * sizeof(uint16_t));
+    return 1;
+}
+
+int atik_camera_setShutter(atikcam *cam, int open){
+    if(!OPENED(cam) || !cam->camcapabilities.hasShutter) return 0;
+    cam->shutter = (open != 0);
+    return 1;
+}
+
+int atik_camera_setGuideRelays(atikcam *cam, unsigned short mask){
+    if(!OPENED(cam)) return 0;
+    update_mount(cam); // movement by previous state of relays
+    cam->relays = mask;
+    return 1;
+}
+
+int atik_camera_setGPIODirection(atikcam *cam, unsigned short mask){
+    if(!OPENED(cam)) return 0;
+    cam->gpiodir = mask;
+    return 1;
+}
+
+int atik_camera_getGPIO(atikcam *cam, unsigned short *mask){
+    if(!OPENED(cam)) return 0;
+    if(mask) *mask = cam->gpio;
+    return 1;
+}
+
+int atik_camera_setGPIO(atikcam *cam, unsigned short mask){
+    if(!OPENED(cam)) return 0;
+    cam->gpio = mask;
+    return 1;
+}
+
+int atik_camera_getGain(atikcam *cam, int *gain, int *offset){
+    if(!OPENED(cam)) return 0;
+    if(gain) *gain = cam->gain;
+    if(offset) *offset = cam->offset;
+    return 1;
+}
+
+int atik_camera_setGain(atikcam *cam, int gain, int offset){
+    if(!OPENED(cam)) return 0;
+    cam->gain = gain;
+    cam->offset = offset;
+    return 1;
+}
+
+unsigned int atik_camera_delay(_U_ atikcam *cam, double delay){
+    return (unsigned int)(delay * 1e6);
+}
+
+unsigned int atik_camera_imageWidth(_U_ atikcam *cam, unsigned int width, unsigned int binX){
+    return binX ? width / binX : 0;
+}
+
+unsigned int atik_camera_imageHeight(_U_ atikcam *cam, unsigned int height, unsigned int binY){
+    return binY ? height / binY : 0;
+}
+
+int atik_camera_getColorId(atikcam *cam){
+    if(!cam || cam->camcapabilities.colour != COLOUR_RGGB) return -1;
+    int ox = cam->camcapabilities.offsetX, oy = cam->camcapabilities.offsetY;
+    if(ox && oy) return 4;
+    if(ox) return 3;
+    if(oy) return 1;
+    return 2;
+}
+
+char *atik_camera_getBinList(atikcam *cam){
+    return cam ? cam->binList : NULL;
+}
+
+char *atik_camera_getCfwList(atikcam *cam){
+    return cam ? cam->cfwList : NULL;
+}
+
+#endif // ATIK_SIMULATOR
@@ -0,0 +1,137 @@
+/*
+ * autoexp.c - automatic exposure time
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Exposure time of next frame is predicted by median level of current one
+ * (found by sparse sample, so it is ready right after readout, before next
+ * exposure starts). Signal rate r = (level - bias) / texp is assumed to change
+ * exponentially (as twilight sky does): its logarithmic slope is found by rates
+ * of two last frames and rate is extrapolated to the middle of next exposure,
+ * so texp = (target - bias) / r(tnext + texp/2) is solved by iterations.
+ * Unknown bias is found by first two valid frames with different exposures
+ * (L = bias + r*texp), rates found before that are dropped. Saturated or too
+ * dark frames change exposure by AUTOEXP_MAXSTEP times; each step is limited
+ * by this factor too.
+ */
+
+#include <math.h>
+#include "autoexp.h"
+#include "imstat.h"
+#include "usefull_macros.h"
+
+// max amount of pixels in sample for median level
+#define LEVEL_SAMPLE    (16384)
+// min signal above bias to estimate rate (ADU)
+#define MINSIGNAL       (20.)
+// max change of rate extrapolated by trend (times e)
+#define MAXTREND        (1.)
+// min relative difference of exposures for bias estimation
+#define BIASDIFF        (0.3)
+
+/**
+ * Init controller
+ * @param a      - controller
+ * @param target - target median level (ADU)
+ * @param bias   - level of zero exposure (ADU, <0 - unknown)
+ * @param tmin   - min exposure time (s)
+ * @param tmax   - max exposure time (s)
+ */
+void autoexp_init(autoexp *a, double target, double bias, double tmin, double tmax){
+    a->target = target;
+    a->biasknown = (bias > -1. && bias < target);
+    a->bias = a->biasknown ? bias : 0.;
+    a->havefirst = 0;
+    a->tmin = tmin; a->tmax = (tmax > tmin) ? tmax : tmin;
+    a->haverate = 0;
+    a->predicted = -1.;
+}
+
+/**
+ * Median level of image by sparse sample
+ * @param img  - image
+ * @param w, h - its size
+ * @return median value
+ */
+double autoexp_level(const uint16_t *img, int w, int h){
+    size_t npix = (size_t)w * h, step = npix / LEVEL_SAMPLE + 1;
+    long n = 0;
+    if(!npix) return 0.;
+    if(step > 1 && step % w == 0) ++step; // not the same column of each row
+    uint16_t *sample = MALLOC(uint16_t, npix / step + 1);
+    for(size_t i = 0; i < npix; i += step) sample[n++] = img[i];
+    double med = imstat_select(sample, n, n / 2);
+    FREE(sample);
+    return med;
+}
+
+/**
+ * Predict exposure time of next frame
+ * @param a     - controller
+ * @param texp  - exposure time of current frame (s)
+ * @param tmid  - time of its middle (s)
+ * @param level - its median level
+ * @param tnext - time of next exposure start (s)
+ * @return exposure time of next frame; a->predicted is its expected level
+ */
+double autoexp_next(autoexp *a, double texp, double tmid, double level, double tnext){
+    double t, r = 0., g = 0.;
+    a->predicted = -1.;
+    if(!a->biasknown && level < IMSTAT_OVERLOAD && level - a->bias >= MINSIGNAL && texp > 0.){
+        if(a->havefirst && fabs(texp - a->t0) > BIASDIFF * a->t0){
+            double b = (a->l0 * texp - level * a->t0) / (texp - a->t0);
+            double bmax = ((a->l0 < level) ? a->l0 : level) - MINSIGNAL;
+            a->bias = (b < 0. || bmax < 0.) ? 0. : (b > bmax) ? bmax : b;
+            a->biasknown = 1;
+            a->haverate = 0; // it was found with wrong bias
+        }else{
+            a->havefirst = 1;
+            a->t0 = texp; a->l0 = level;
+        }
+    }
+    double want = a->target - a->bias, sig = level - a->bias;
+    if(level >= IMSTAT_OVERLOAD || sig < MINSIGNAL || texp <= 0.){ // rate is unknown
+        a->haverate = 0;
+        t = (sig < MINSIGNAL) ? texp * AUTOEXP_MAXSTEP : texp / AUTOEXP_MAXSTEP;
+    }else{
+        r = sig / texp;
+        if(a->haverate && tmid > a->tmid) g = log(r / a->rate) / (tmid - a->tmid);
+        a->rate = r; a->tmid = tmid; a->haverate = 1;
+        t = want / r;
+        for(int i = 0; i < 8 && g != 0.; ++i){
+            double e = g * (tnext + t / 2. - tmid);
+            if(e > MAXTREND) e = MAXTREND;
+            else if(e < -MAXTREND) e = -MAXTREND;
+            t = want / (r * exp(e));
+        }
+        if(t > texp * AUTOEXP_MAXSTEP) t = texp * AUTOEXP_MAXSTEP;
+        else if(t < texp / AUTOEXP_MAXSTEP) t = texp / AUTOEXP_MAXSTEP;
+    }
+    if(t < a->tmin) t = a->tmin;
+    if(t > a->tmax) t = a->tmax;
+    if(r > 0.){
+        double e = g * (tnext + t / 2. - tmid);
+        if(e > MAXTREND) e = MAXTREND;
+        else if(e < -MAXTREND) e = -MAXTREND;
+        a->predicted = a->bias + r * exp(e) * t;
+        if(a->predicted > 65535.) a->predicted = 65535.;
+    }
+    return t;
+}
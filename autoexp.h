@@ -0,0 +1,50 @@
+/*
+ * autoexp.h - automatic exposure time
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __AUTOEXP_H__
+#define __AUTOEXP_H__
+
+#include <stdint.h>
+
+// max change of exposure time by one frame (times)
+#define AUTOEXP_MAXSTEP     (10.)
+// default max exposure time (s)
+#define AUTOEXP_MAXEXP      (300.)
+
+// state of controller
+typedef struct{
+    double target;      // target median level (ADU)
+    double bias;        // level of zero exposure (ADU)
+    int biasknown;      // bias is given or found
+    int havefirst;      // first valid frame (for bias estimation) is known
+    double t0, l0;      // its exposure time & level
+    double tmin, tmax;  // limits of exposure time (s)
+    int haverate;       // rate of previous frame is known
+    double rate;        // its signal rate (ADU/s)
+    double tmid;        // and time of its middle (s)
+    double predicted;   // predicted level of next frame (<0 - unknown)
+} autoexp;
+
+void autoexp_init(autoexp *a, double target, double bias, double tmin, double tmax);
+double autoexp_level(const uint16_t *img, int w, int h);
+double autoexp_next(autoexp *a, double texp, double tmid, double level, double tnext);
+
+#endif // __AUTOEXP_H__
@@ -0,0 +1,421 @@
+/*
+ * bayer.c - demosaicing of colour frames
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Colour frame is converted into three planes (R, G, B) of the same size.
+ * Bilinear mode: for each row four uniform rows are calculated by vector
+ * kernels (AVX2, SSE4.1 or plain C, selected at runtime by CPUID): horizontal,
+ * vertical, diagonal & cross means of neighbours; then each plane row is a
+ * blend of two of them (or of raw row) for even & odd pixels.
+ * Edge mode: green at red & blue pixels is interpolated along direction of
+ * smaller gradient (Hamilton-Adams), then red & blue are restored by bilinear
+ * interpolation of colour differences (R-G, B-G), so edges don't get colour
+ * fringes; it needs two passes as second one uses green of neighbour rows.
+ * Frame is processed by bands of rows shared between threads; borders are
+ * mirrored (preserving colours of pixels).
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include "bayer.h"
+#include "usefull_macros.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+// rows in band processed by one thread at once
+#define BAND_ROWS   (32)
+// mirrored pixels at each side of padded row
+#define PAD         (2)
+
+enum{ R, G, B };
+
+// colours of pixels (y & 1, x & 1) for each pattern
+static const uint8_t colours[][2][2] = {
+    [BAYER_RGGB] = {{R, G}, {G, B}},
+    [BAYER_GRBG] = {{G, R}, {B, G}},
+    [BAYER_GBRG] = {{G, B}, {R, G}},
+    [BAYER_BGGR] = {{B, G}, {G, R}}
+};
+
+static const char *patnames[] = {
+    [BAYER_NONE] = "none", [BAYER_RGGB] = "RGGB", [BAYER_GRBG] = "GRBG",
+    [BAYER_GBRG] = "GBRG", [BAYER_BGGR] = "BGGR"
+};
+
+static const char *modenames[] = {
+    [DEMOSAIC_BILINEAR] = "bilinear", [DEMOSAIC_EDGE] = "edge"
+};
+
+const char *bayer_name(bayer_pattern p){
+    if(p < BAYER_NONE || p > BAYER_BGGR) return "unknown";
+    return patnames[p];
+}
+
+const char *demosaic_name(demosaic_mode mode){
+    if(mode < DEMOSAIC_BILINEAR || mode > DEMOSAIC_EDGE) return "unknown";
+    return modenames[mode];
+}
+
+int demosaic_parse(const char *str, demosaic_mode *mode){
+    if(!str) return 1;
+    for(int i = DEMOSAIC_BILINEAR; i <= DEMOSAIC_EDGE; ++i)
+        if(strcasecmp(str, modenames[i]) == 0){
+            *mode = (demosaic_mode)i;
+            return 0;
+        }
+    return 1;
+}
+
+/**
+ * Pattern by colorId of atik_camera_getColorId() (shift of RGGB by sensor offsets)
+ * @param colorId - 2: no shift, 3: by X, 1: by Y, 4: by both; other - monochrome
+ */
+bayer_pattern bayer_fromid(int colorId){
+    switch(colorId){
+        case 1: return BAYER_GBRG;
+        case 2: return BAYER_RGGB;
+        case 3: return BAYER_GRBG;
+        case 4: return BAYER_BGGR;
+        default: return BAYER_NONE;
+    }
+}
+
+/**
+ * Pattern of subframe
+ * @param p      - pattern of full frame
+ * @param dx, dy - coordinates of subframe corner
+ */
+bayer_pattern bayer_shift(bayer_pattern p, int dx, int dy){
+    if(p <= BAYER_NONE || p > BAYER_BGGR) return BAYER_NONE;
+    dx &= 1; dy &= 1;
+    for(int i = BAYER_RGGB; i <= BAYER_BGGR; ++i){
+        int ok = 1;
+        for(int y = 0; y < 2 && ok; ++y)
+            for(int x = 0; x < 2; ++x)
+                if(colours[i][y][x] != colours[p][(y + dy) & 1][(x + dx) & 1]){ ok = 0; break; }
+        if(ok) return (bayer_pattern)i;
+    }
+    return BAYER_NONE;
+}
+
+// mean of two rows
+static void avg2_scalar(const uint16_t *a, const uint16_t *b, uint16_t *out, size_t n){
+    for(size_t i = 0; i < n; ++i) out[i] = (uint16_t)((a[i] + b[i] + 1) >> 1);
+}
+
+// mean of four rows
+static void avg4_scalar(const uint16_t *a, const uint16_t *b, const uint16_t *c, const uint16_t *d,
+                        uint16_t *out, size_t n){
+    for(size_t i = 0; i < n; ++i) out[i] = (uint16_t)((a[i] + b[i] + c[i] + d[i] + 2) >> 2);
+}
+
+// even pixels from `ev`, odd from `od`
+static void blend_scalar(const uint16_t *ev, const uint16_t *od, uint16_t *out, size_t n){
+    size_t i = 0;
+    for(; i + 1 < n; i += 2){
+        out[i] = ev[i];
+        out[i+1] = od[i+1];
+    }
+    if(i < n) out[i] = ev[i];
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void avg2_avx2(const uint16_t *a, const uint16_t *b, uint16_t *out, size_t n){
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_avg_epu16(
+            _mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+    avg2_scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void avg4_avx2(const uint16_t *a, const uint16_t *b, const uint16_t *c, const uint16_t *d,
+                      uint16_t *out, size_t n){
+    const __m256i two = _mm256_set1_epi32(2);
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16){
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i)), vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i vc = _mm256_loadu_si256((const __m256i*)(c + i)), vd = _mm256_loadu_si256((const __m256i*)(d + i));
+        __m256i lo = _mm256_add_epi32(_mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(va)),
+                                                       _mm256_cvtepu16_epi32(_mm256_castsi256_si128(vb))),
+                                      _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(vc)),
+                                                       _mm256_cvtepu16_epi32(_mm256_castsi256_si128(vd))));
+        __m256i hi = _mm256_add_epi32(_mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(va, 1)),
+                                                       _mm256_cvtepu16_epi32(_mm256_extracti128_si256(vb, 1))),
+                                      _mm256_add_epi32(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(vc, 1)),
+                                                       _mm256_cvtepu16_epi32(_mm256_extracti128_si256(vd, 1))));
+        lo = _mm256_srli_epi32(_mm256_add_epi32(lo, two), 2);
+        hi = _mm256_srli_epi32(_mm256_add_epi32(hi, two), 2);
+        // packing goes by 128-bit lanes: restore order of quadwords
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + i), r);
+    }
+    avg4_scalar(a + i, b + i, c + i, d + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void blend_avx2(const uint16_t *ev, const uint16_t *od, uint16_t *out, size_t n){
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16)
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_blend_epi16(
+            _mm256_loadu_si256((const __m256i*)(ev + i)), _mm256_loadu_si256((const __m256i*)(od + i)), 0xAA));
+    blend_scalar(ev + i, od + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void avg2_sse41(const uint16_t *a, const uint16_t *b, uint16_t *out, size_t n){
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i*)(out + i), _mm_avg_epu16(
+            _mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    avg2_scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void avg4_sse41(const uint16_t *a, const uint16_t *b, const uint16_t *c, const uint16_t *d,
+                       uint16_t *out, size_t n){
+    const __m128i two = _mm_set1_epi32(2);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i)), vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i vc = _mm_loadu_si128((const __m128i*)(c + i)), vd = _mm_loadu_si128((const __m128i*)(d + i));
+        __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_cvtepu16_epi32(va), _mm_cvtepu16_epi32(vb)),
+                                   _mm_add_epi32(_mm_cvtepu16_epi32(vc), _mm_cvtepu16_epi32(vd)));
+        __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(va, 8)),
+                                                 _mm_cvtepu16_epi32(_mm_srli_si128(vb, 8))),
+                                   _mm_add_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(vc, 8)),
+                                                 _mm_cvtepu16_epi32(_mm_srli_si128(vd, 8))));
+        lo = _mm_srli_epi32(_mm_add_epi32(lo, two), 2);
+        hi = _mm_srli_epi32(_mm_add_epi32(hi, two), 2);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi32(lo, hi));
+    }
+    avg4_scalar(a + i, b + i, c + i, d + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void blend_sse41(const uint16_t *ev, const uint16_t *od, uint16_t *out, size_t n){
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i*)(out + i), _mm_blend_epi16(
+            _mm_loadu_si128((const __m128i*)(ev + i)), _mm_loadu_si128((const __m128i*)(od + i)), 0xAA));
+    blend_scalar(ev + i, od + i, out + i, n - i);
+}
+#endif // X86_KERNELS
+
+static void (*avg2)(const uint16_t*, const uint16_t*, uint16_t*, size_t) = avg2_scalar;
+static void (*avg4)(const uint16_t*, const uint16_t*, const uint16_t*, const uint16_t*,
+                    uint16_t*, size_t) = avg4_scalar;
+static void (*blend)(const uint16_t*, const uint16_t*, uint16_t*, size_t) = blend_scalar;
+static const char *kernelname = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(){
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        avg2 = avg2_avx2; avg4 = avg4_avx2; blend = blend_avx2;
+        kernelname = "AVX2";
+    }else if(__builtin_cpu_supports("sse4.1")){
+        avg2 = avg2_sse41; avg4 = avg4_sse41; blend = blend_sse41;
+        kernelname = "SSE4.1";
+    }
+#endif
+}
+
+// name of demosaicing kernel
+const char *bayer_kernel(){
+    pthread_once(&kernel_once, select_kernel);
+    return kernelname;
+}
+
+typedef struct{
+    const uint16_t *in;
+    int w, h;
+    bayer_pattern p;
+    uint16_t *out;          // planes R, G, B
+    int pass;               // 0 - bilinear, 1 & 2 - passes of edge mode
+    int nbands, next;       // amount of bands & next band to process
+} bayerjob;
+
+// mirrored row index
+static inline int mirror(int y, int h){
+    if(y < 0) return -y;
+    if(y >= h) return 2*h - 2 - y;
+    return y;
+}
+
+// copy row into buffer with PAD mirrored pixels at each side, return pointer to its first pixel
+static const uint16_t *padrow(const uint16_t *row, int w, uint16_t *buf){
+    memcpy(buf + PAD, row, w * sizeof(uint16_t));
+    for(int i = 1; i <= PAD; ++i){
+        buf[PAD - i] = row[i];
+        buf[PAD + w - 1 + i] = row[w - 1 - i];
+    }
+    return buf + PAD;
+}
+
+static inline uint16_t clamp16(int v){
+    return (v < 0) ? 0 : (v > 65535) ? 65535 : (uint16_t)v;
+}
+
+static void bilinear_row(bayerjob *job, int y, uint16_t *buf){
+    int w = job->w, h = job->h, py = y & 1;
+    size_t W = w + 2*PAD, npix = (size_t)w * h;
+    const uint16_t *U = padrow(job->in + (size_t)mirror(y - 1, h) * w, w, buf);
+    const uint16_t *C = padrow(job->in + (size_t)y * w, w, buf + W);
+    const uint16_t *D = padrow(job->in + (size_t)mirror(y + 1, h) * w, w, buf + 2*W);
+    uint16_t *Hr = buf + 3*W, *Vr = Hr + w, *Xr = Vr + w, *Pr = Xr + w;
+    avg2(C - 1, C + 1, Hr, w);
+    avg2(U, D, Vr, w);
+    avg4(U - 1, U + 1, D - 1, D + 1, Xr, w);
+    avg4(C - 1, C + 1, U, D, Pr, w);
+    const uint16_t *src[3][2]; // sources of planes for even & odd pixels
+    for(int px = 0; px < 2; ++px){
+        int s = colours[job->p][py][px];
+        if(s == G){
+            int ch = colours[job->p][py][px ^ 1]; // colour of horizontal neighbours
+            src[G][px] = C;
+            src[ch][px] = Hr;
+            src[ch == R ? B : R][px] = Vr;
+        }else{
+            src[s][px] = C;
+            src[G][px] = Pr;
+            src[s == R ? B : R][px] = Xr;
+        }
+    }
+    for(int k = 0; k < 3; ++k)
+        blend(src[k][0], src[k][1], job->out + k * npix + (size_t)y * w, w);
+}
+
+// green at all pixels: along direction with smaller gradient
+static void green_row(bayerjob *job, int y, uint16_t *buf){
+    int w = job->w, h = job->h, py = y & 1;
+    size_t W = w + 2*PAD;
+    const uint16_t *r[5];
+    for(int i = 0; i < 5; ++i)
+        r[i] = padrow(job->in + (size_t)mirror(y + i - 2, h) * w, w, buf + i * W);
+    const uint16_t *C = r[2];
+    uint16_t *out = job->out + (size_t)job->w * job->h + (size_t)y * w;
+    for(int x = 0; x < w; ++x){
+        if(colours[job->p][py][x & 1] == G){
+            out[x] = C[x];
+            continue;
+        }
+        int c2 = 2 * C[x];
+        int lh = c2 - C[x-2] - C[x+2], lv = c2 - r[0][x] - r[4][x];
+        int gh = abs(C[x-1] - C[x+1]) + abs(lh), gv = abs(r[1][x] - r[3][x]) + abs(lv);
+        int vh = (2 * (C[x-1] + C[x+1]) + lh) / 4, vv = (2 * (r[1][x] + r[3][x]) + lv) / 4;
+        out[x] = clamp16(gh < gv ? vh : gv < gh ? vv : (vh + vv) / 2);
+    }
+}
+
+// red & blue by interpolation of colour differences
+static void colour_row(bayerjob *job, int y, uint16_t *buf){
+    int w = job->w, h = job->h, py = y & 1;
+    size_t W = w + 2*PAD, npix = (size_t)w * h;
+    const uint16_t *g = job->out + npix;
+    int yu = mirror(y - 1, h), yd = mirror(y + 1, h);
+    const uint16_t *U = padrow(job->in + (size_t)yu * w, w, buf);
+    const uint16_t *C = padrow(job->in + (size_t)y * w, w, buf + W);
+    const uint16_t *D = padrow(job->in + (size_t)yd * w, w, buf + 2*W);
+    const uint16_t *GU = padrow(g + (size_t)yu * w, w, buf + 3*W);
+    const uint16_t *GC = padrow(g + (size_t)y * w, w, buf + 4*W);
+    const uint16_t *GD = padrow(g + (size_t)yd * w, w, buf + 5*W);
+    uint16_t *plane[3] = {job->out + (size_t)y * w, NULL, job->out + 2*npix + (size_t)y * w};
+    for(int x = 0; x < w; ++x){
+        int s = colours[job->p][py][x & 1], gc = GC[x];
+        if(s == G){
+            int ch = colours[job->p][py][(x & 1) ^ 1], cv = (ch == R) ? B : R;
+            plane[ch][x] = clamp16(gc + ((C[x-1] - GC[x-1]) + (C[x+1] - GC[x+1])) / 2);
+            plane[cv][x] = clamp16(gc + ((U[x] - GU[x]) + (D[x] - GD[x])) / 2);
+        }else{
+            int o = (s == R) ? B : R;
+            plane[s][x] = C[x];
+            plane[o][x] = clamp16(gc + ((U[x-1] - GU[x-1]) + (U[x+1] - GU[x+1]) +
+                                        (D[x-1] - GD[x-1]) + (D[x+1] - GD[x+1])) / 4);
+        }
+    }
+}
+
+static void *bayer_worker(void *arg){
+    bayerjob *job = (bayerjob*)arg;
+    // padded rows (up to 6) and four rows of means
+    uint16_t *buf = MALLOC(uint16_t, 6 * (job->w + 2*PAD) + 4 * job->w);
+    int b;
+    while((b = __sync_fetch_and_add(&job->next, 1)) < job->nbands){
+        int y0 = b * BAND_ROWS, y1 = y0 + BAND_ROWS;
+        if(y1 > job->h) y1 = job->h;
+        for(int y = y0; y < y1; ++y){
+            if(job->pass == 0) bilinear_row(job, y, buf);
+            else if(job->pass == 1) green_row(job, y, buf);
+            else colour_row(job, y, buf);
+        }
+    }
+    FREE(buf);
+    return NULL;
+}
+
+// process all bands by several threads
+static void run_bands(bayerjob *job, int nthreads){
+    job->next = 0;
+    if(nthreads > job->nbands) nthreads = job->nbands;
+    pthread_t *workers = MALLOC(pthread_t, nthreads);
+    sigset_t all, old;
+    sigfillset(&all); // signals are processed by main thread only
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int nw = 0;
+    for(; nw < nthreads - 1; ++nw)
+        if(pthread_create(&workers[nw], NULL, bayer_worker, job)) break;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    bayer_worker(job);
+    for(int i = 0; i < nw; ++i) pthread_join(workers[i], NULL);
+    FREE(workers);
+}
+
+/**
+ * Demosaic colour frame
+ * @param in       - raw frame
+ * @param w, h     - its size (at least 4x4)
+ * @param p        - colour filter array of frame
+ * @param mode     - interpolation mode
+ * @param out      - (o) planes R, G, B (3*w*h values)
+ * @param nthreads - amount of threads (<1 - all CPUs)
+ * @return 0 if all OK
+ */
+int bayer_demosaic(const uint16_t *in, int w, int h, bayer_pattern p, demosaic_mode mode,
+                   uint16_t *out, int nthreads){
+    if(!in || !out || w < 4 || h < 4 || p <= BAYER_NONE || p > BAYER_BGGR) return 1;
+    pthread_once(&kernel_once, select_kernel);
+    bayerjob job = {.in = in, .w = w, .h = h, .p = p, .out = out,
+        .nbands = (h + BAND_ROWS - 1) / BAND_ROWS};
+    if(nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(mode == DEMOSAIC_EDGE){
+        job.pass = 1;
+        run_bands(&job, nthreads);
+        job.pass = 2; // needs green of all rows
+    }
+    run_bands(&job, nthreads);
+    return 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * bayer.h - demosaicing of colour frames
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __BAYER_H__
+#define __BAYER_H__
+
+#include <stdint.h>
+
+// colour filter arrays (colours of pixels (0,0), (1,0), (0,1), (1,1))
+typedef enum{
+    BAYER_NONE,     // monochrome
+    BAYER_RGGB,
+    BAYER_GRBG,
+    BAYER_GBRG,
+    BAYER_BGGR
+} bayer_pattern;
+
+typedef enum{
+    DEMOSAIC_BILINEAR,  // bilinear interpolation
+    DEMOSAIC_EDGE       // green along edges & interpolation of colour differences
+} demosaic_mode;
+
+bayer_pattern bayer_fromid(int colorId);
+bayer_pattern bayer_shift(bayer_pattern p, int dx, int dy);
+const char *bayer_name(bayer_pattern p);
+int demosaic_parse(const char *str, demosaic_mode *mode);
+const char *demosaic_name(demosaic_mode mode);
+int bayer_demosaic(const uint16_t *in, int w, int h, bayer_pattern p, demosaic_mode mode,
+                   uint16_t *out, int nthreads);
+const char *bayer_kernel();
+
+#endif // __BAYER_H__
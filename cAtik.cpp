@@ -41,27 +41,47 @@ providers doing it on their own risk. I did it on my VS60 and spent one weekend
 by trying to revert it back.
 */
 
-//#ifdef HAVE_ATIK
+// with simulated camera (atiksim.c) this file is empty
+#ifndef ATIK_SIMULATOR
 
 #include <iostream>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include <atikccdusb.h>
 #include "atikcore.h"
 #include "usefull_macros.h"
 
 using namespace std;
 
+// opened camera: device and its own capabilities cache; mutex serialises calls
+// to one device, different cameras work independently
+struct atikcam
+{
+    AtikCamera *device;
+    CAMERA_TYPE camtype;
+    AtikCapabilities camcapabilities;
+    int colorId;
+    char binList[CAMLENGTH+1];
+    char cfwList[CAMLENGTH+1];
+    pthread_mutex_t mutex;
+};
+
 static AtikCamera *listDevices[MAX_CAMERA];
-static AtikCamera *selectedDevice = NULL;
-static CAMERA_TYPE camtype;
-static AtikCapabilities camcapabilities;
+static atikcam *openedCams[MAX_CAMERA]; // handles of opened devices (by index in list)
 static int cameraCount = 0;
 static char *cameraList = NULL;
-static int colorId = -1;
-static char binList[CAMLENGTH+1];
-static char cfwList[CAMLENGTH+1];
+static pthread_mutex_t listmutex = PTHREAD_MUTEX_INITIALIZER;
+
+// call method of device, return 0 if there's no camera
+#define CAMCALL(cam, call) do{                  \
+    if (cam == NULL) return 0;                  \
+    pthread_mutex_lock(&cam->mutex);            \
+    int r = cam->device->call;                  \
+    pthread_mutex_unlock(&cam->mutex);          \
+    return r;                                   \
+}while(0)
 
 int atik_list_create()
 {
@@ -74,6 +94,7 @@ int atik_list_create()
     for (int i = 0; i < cameraCount; i++)
     {
         AtikCamera *device = listDevices[i];
+        openedCams[i] = NULL;
         strcpy(curName, device->getName());
         cameraList = (char *)realloc(cameraList, strlen(cameraList)+strlen(curName)+2);
         strcat(cameraList, "|");
@@ -85,7 +106,6 @@ int atik_list_create()
     #if (ATIK_DEBUG==1)
         cerr << endl << "cameraList " << cameraList << " --------------------" << endl << endl;
     #endif
-    selectedDevice = listDevices[0];
     return cameraCount;
 }
 
@@ -101,9 +121,10 @@ void atik_list_destroy()
         #if (ATIK_DEBUG==1)
             cerr << endl << "destroy " << listDevices[i]->getName() << " --------------------" << endl << endl;
         #endif
+        if (openedCams[i] != NULL) atik_camera_close(openedCams[i]);
         AtikCamera_destroy(listDevices[i]);
     }
-    selectedDevice = NULL;
+    cameraCount = 0;
 }
 
 int atik_list_cleanup(char *camname)
@@ -130,26 +151,6 @@ int atik_list_item_count()
     return cameraCount;
 }
 
-int atik_list_item_select(char *camname)
-{
-    int retval = 0;
-
-    for (int i = 0; i < cameraCount; i++)
-    {
-        AtikCamera *device = listDevices[i];
-        if  (strcmp(camname, device->getName()) == 0)
-        {
-            selectedDevice = listDevices[i];
-            retval = 1;
-            #if (ATIK_DEBUG==1)
-                cerr << endl << "selected " << selectedDevice->getName() << " --------------------" << endl << endl;
-            #endif
-            break;
-        }
-    }
-    return (retval);
-}
-
 int atik_list_item_destroy(char *camname)
 {
     int retval = 0;
@@ -170,225 +171,264 @@ int atik_list_item_destroy(char *camname)
     return (retval);
 }
 
-const char *atik_camera_name()
+const char *atik_camera_name(atikcam *cam)
 {
-    return (selectedDevice == NULL) ? "" : selectedDevice->getName();
+    return (cam == NULL) ? "" : cam->device->getName();
 }
 
-int atik_camera_open()
+// fill capabilities cache of just opened camera
+static int getcaps(atikcam *cam)
 {
-    int retval = 0;
     int maxBin = 1;
     int i;
     char tmpstr[CAMLENGTH+1];
     unsigned int filterCount;
+    AtikCapabilities *caps = &cam->camcapabilities;
+
+    if (!cam->device->getCapabilities(NULL, &cam->camtype, caps)) return 0;
+    // Patch 4 wrong maxBin (255)
+    caps->maxBinX = (caps->maxBinX > 8) ? 8 : caps->maxBinX;
+    caps->maxBinY = (caps->maxBinY > 8) ? 8 : caps->maxBinY;
+    //ColorId
+    cam->colorId = -1;
+    if (caps->colour == 2)
+    {
+        cam->colorId = 2;
+        if ((caps->offsetX) && (!caps->offsetY))
+        {
+            cam->colorId = 3;
+        }
+        else if ((!caps->offsetX) && (caps->offsetY))
+        {
+            cam->colorId = 1;
+        }
+        else if ((caps->offsetX) && (caps->offsetY))
+        {
+            cam->colorId = 4;
+        }
+    }
+    //Binlist
+    cam->binList[0] = '\0';
+    maxBin = (caps->maxBinX < caps->maxBinY) ? caps->maxBinX : caps->maxBinY;
 
-    if (selectedDevice->open())
+    for (i = 1; i <= maxBin; i++)
+    {
+        // Compiling binlist
+        sprintf(tmpstr, "%dx%d|", i, i);
+        strcat(cam->binList, tmpstr);
+    }
+    strcat(cam->binList, ":0");
+    //CfwList
+    cam->cfwList[0] = '\0';
+    if (caps->hasFilterWheel)
     {
-        if (selectedDevice->getCapabilities(NULL, &camtype, &camcapabilities))
+        if (cam->device->getFilterWheelStatus(&filterCount, NULL, NULL, NULL))
         {
-            // Patch 4 wrong maxBin (255)
-            camcapabilities.maxBinX = (camcapabilities.maxBinX > 8) ? 8 : camcapabilities.maxBinX;
-            camcapabilities.maxBinY = (camcapabilities.maxBinY > 8) ? 8 : camcapabilities.maxBinY;
-            retval = 1;
-            //ColorId
-            colorId = -1;
-            if (camcapabilities.colour == 2)
-            {
-                colorId = 2;
-                if ((camcapabilities.offsetX) && (!camcapabilities.offsetY))
-                {
-                    colorId = 3;
-                }
-                else if ((!camcapabilities.offsetX) && (camcapabilities.offsetY))
-                {
-                    colorId = 1;
-                }
-                else if ((camcapabilities.offsetX) && (camcapabilities.offsetY))
-                {
-                    colorId = 4;
-                }
-            }
-            //Binlist
-            binList[0] = '\0';
-            maxBin = (camcapabilities.maxBinX < camcapabilities.maxBinY) ? camcapabilities.maxBinX : camcapabilities.maxBinY;
-
-            for (i = 1; i <= maxBin; i++)
-            {
-                // Compiling binlist
-                sprintf(tmpstr, "%dx%d|", i, i);
-                strcat(binList, tmpstr);
-            }
-            strcat(binList, ":0");
-            //CfwList
-            cfwList[0] = '\0';
-            if (camcapabilities.hasFilterWheel)
-            {
-                if (selectedDevice->getFilterWheelStatus(&filterCount, NULL, NULL, NULL))
-                {
-                    sprintf(binList, "%u-CFW|:0", filterCount);
-                }
-            }
+            sprintf(cam->cfwList, "%u-CFW|:0", filterCount);
         }
     }
-    return (retval);
+    return 1;
+}
+
+/**
+ * Open camera by name
+ * @param camname - name from list (NULL - first camera which isn't opened yet)
+ * @return handle of camera or NULL if failed
+ */
+atikcam *atik_camera_open(const char *camname)
+{
+    atikcam *cam = NULL;
+
+    pthread_mutex_lock(&listmutex);
+    for (int i = 0; i < cameraCount; i++)
+    {
+        if (openedCams[i] != NULL) continue;
+        AtikCamera *device = listDevices[i];
+        if (camname != NULL && strcmp(camname, device->getName()) != 0) continue;
+        #if (ATIK_DEBUG==1)
+            cerr << endl << "open " << device->getName() << " --------------------" << endl << endl;
+        #endif
+        if (!device->open()) break;
+        cam = (atikcam *)calloc(1, sizeof(atikcam));
+        cam->device = device;
+        pthread_mutex_init(&cam->mutex, NULL);
+        if (!getcaps(cam))
+        {
+            device->close();
+            pthread_mutex_destroy(&cam->mutex);
+            free(cam);
+            cam = NULL;
+            break;
+        }
+        openedCams[i] = cam;
+        break;
+    }
+    pthread_mutex_unlock(&listmutex);
+    return cam;
 }
 
-void atik_camera_close()
+void atik_camera_close(atikcam *cam)
 {
-    if (!(selectedDevice == NULL))
+    if (cam == NULL) return;
+    pthread_mutex_lock(&listmutex);
+    for (int i = 0; i < cameraCount; i++)
     {
-        selectedDevice->close();
+        if (openedCams[i] == cam) openedCams[i] = NULL;
     }
+    pthread_mutex_unlock(&listmutex);
+    cam->device->close();
+    pthread_mutex_destroy(&cam->mutex);
+    free(cam);
 }
 
-int atik_camera_setParam(PARAM_TYPE code, long value)
+int atik_camera_setParam(atikcam *cam, PARAM_TYPE code, long value)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setParam(code, value);
+    CAMCALL(cam, setParam(code, value));
 }
 
-AtikCapabilities *atik_camera_getCapabilities()
+AtikCapabilities *atik_camera_getCapabilities(atikcam *cam)
 {
-    return &camcapabilities;
+    return (cam == NULL) ? NULL : &cam->camcapabilities;
 }
 
-CAMERA_TYPE atik_camera_getType()
+CAMERA_TYPE atik_camera_getType(atikcam *cam)
 {
-    return camtype;
+    return (cam == NULL) ? (CAMERA_TYPE)0 : cam->camtype;
 }
 
-int atik_camera_getTemperatureSensorStatus(unsigned int sensor, float *currentTemp)
+int atik_camera_getTemperatureSensorStatus(atikcam *cam, unsigned int sensor, float *currentTemp)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->getTemperatureSensorStatus(sensor, currentTemp);
+    CAMCALL(cam, getTemperatureSensorStatus(sensor, currentTemp));
 }
 
-int atik_camera_getCoolingStatus(COOLING_STATE *state, float *targetTemp, float *power)
+int atik_camera_getCoolingStatus(atikcam *cam, COOLING_STATE *state, float *targetTemp, float *power)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->getCoolingStatus(state, targetTemp, power);
+    CAMCALL(cam, getCoolingStatus(state, targetTemp, power));
 }
 
-int atik_camera_setCooling(float targetTemp)
+int atik_camera_setCooling(atikcam *cam, float targetTemp)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setCooling(targetTemp);
+    CAMCALL(cam, setCooling(targetTemp));
 }
 
-int atik_camera_initiateWarmUp()
+int atik_camera_initiateWarmUp(atikcam *cam)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->initiateWarmUp();
+    CAMCALL(cam, initiateWarmUp());
 }
 
-int atik_camera_getFilterWheelStatus(unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target)
+int atik_camera_getFilterWheelStatus(atikcam *cam, unsigned int *filterCount, int *moving, unsigned int *current, unsigned int *target)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->getFilterWheelStatus(filterCount, (bool *)moving, current, target);
+    CAMCALL(cam, getFilterWheelStatus(filterCount, (bool *)moving, current, target));
 }
 
-int atik_camera_setFilter(unsigned int index)
+int atik_camera_setFilter(atikcam *cam, unsigned int index)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setFilter(index);
+    CAMCALL(cam, setFilter(index));
 }
 
-int atik_camera_setPreviewMode(int useMode)
+int atik_camera_setPreviewMode(atikcam *cam, int useMode)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setPreviewMode((useMode != 0));
+    CAMCALL(cam, setPreviewMode((useMode != 0)));
 }
 
-int atik_camera_set8BitMode(int useMode)
+int atik_camera_set8BitMode(atikcam *cam, int useMode)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->set8BitMode((useMode != 0));
+    CAMCALL(cam, set8BitMode((useMode != 0)));
 }
 
-int atik_camera_startExposure(int amp)
+int atik_camera_startExposure(atikcam *cam, int amp)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->startExposure((amp != 0));
+    CAMCALL(cam, startExposure((amp != 0)));
 }
 
-int atik_camera_abortExposure()
+// not locked: exposure should be aborted even while other call waits for camera
+int atik_camera_abortExposure(atikcam *cam)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->abortExposure();
+    return (cam == NULL) ? 0 : cam->device->abortExposure();
 }
 
-int atik_camera_readCCD(unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY)
+int atik_camera_readCCD(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->readCCD(startX, startY, sizeX, sizeY, binX, binY);
+    CAMCALL(cam, readCCD(startX, startY, sizeX, sizeY, binX, binY));
 }
 
-int atik_camera_readCCD_delay(unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay)
+int atik_camera_readCCD_delay(atikcam *cam, unsigned int startX, unsigned int startY, unsigned int sizeX, unsigned int sizeY, unsigned int binX, unsigned int binY, double delay)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->readCCD(startX, startY, sizeX, sizeY, binX, binY, delay);
+    CAMCALL(cam, readCCD(startX, startY, sizeX, sizeY, binX, binY, delay));
 }
 
-int atik_camera_getImage(unsigned short *imgBuf, unsigned int imgSize)
+int atik_camera_getImage(atikcam *cam, unsigned short *imgBuf, unsigned int imgSize)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->getImage(imgBuf, imgSize);
+    CAMCALL(cam, getImage(imgBuf, imgSize));
 }
 
-int atik_camera_setShutter(int open)
+int atik_camera_setShutter(atikcam *cam, int open)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setShutter(open);
+    CAMCALL(cam, setShutter(open));
 }
 
-int atik_camera_setGuideRelays(unsigned short mask)
+int atik_camera_setGuideRelays(atikcam *cam, unsigned short mask)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setGuideRelays(mask);
+    CAMCALL(cam, setGuideRelays(mask));
 }
 
-int atik_camera_setGPIODirection(unsigned short mask)
+int atik_camera_setGPIODirection(atikcam *cam, unsigned short mask)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setGPIODirection(mask);
+    CAMCALL(cam, setGPIODirection(mask));
 }
 
-int atik_camera_getGPIO(unsigned short *mask)
+int atik_camera_getGPIO(atikcam *cam, unsigned short *mask)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->getGPIO(mask);
+    CAMCALL(cam, getGPIO(mask));
 }
 
-int atik_camera_setGPIO(unsigned short mask)
+int atik_camera_setGPIO(atikcam *cam, unsigned short mask)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setGPIO(mask);
+    CAMCALL(cam, setGPIO(mask));
 }
 
-int atik_camera_getGain(int *gain, int *offset)
+int atik_camera_getGain(atikcam *cam, int *gain, int *offset)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->getGain(gain, offset);
+    CAMCALL(cam, getGain(gain, offset));
 }
 
-int atik_camera_setGain(int gain, int offset)
+int atik_camera_setGain(atikcam *cam, int gain, int offset)
 {
-    return (selectedDevice == NULL) ? 0 : selectedDevice->setGain(gain, offset);
+    CAMCALL(cam, setGain(gain, offset));
 }
 
-unsigned int atik_camera_delay(double delay)
+unsigned int atik_camera_delay(atikcam *cam, double delay)
 {
-    return (selectedDevice == NULL) ? -1 : selectedDevice->delay(delay);
+    return (cam == NULL) ? -1 : cam->device->delay(delay);
 }
 
-unsigned int atik_camera_imageWidth(unsigned int width, unsigned int binX)
+unsigned int atik_camera_imageWidth(atikcam *cam, unsigned int width, unsigned int binX)
 {
-    return (selectedDevice == NULL) ? -1 : selectedDevice->imageWidth(width, binX);
+    return (cam == NULL) ? -1 : cam->device->imageWidth(width, binX);
 }
 
-unsigned int atik_camera_imageHeight(unsigned int height, unsigned int binY)
+unsigned int atik_camera_imageHeight(atikcam *cam, unsigned int height, unsigned int binY)
 {
-    return (selectedDevice == NULL) ? -1 : selectedDevice->imageHeight(height, binY);
+    return (cam == NULL) ? -1 : cam->device->imageHeight(height, binY);
 }
 
-int atik_camera_getColorId()
+int atik_camera_getColorId(atikcam *cam)
 {
-    return colorId;
+    return (cam == NULL) ? -1 : cam->colorId;
 }
 
-char *atik_camera_getBinList()
+char *atik_camera_getBinList(atikcam *cam)
 {
-    return binList;
+    return (cam == NULL) ? NULL : cam->binList;
 }
 
-char *atik_camera_getCfwList()
+char *atik_camera_getCfwList(atikcam *cam)
 {
-    return cfwList;
+    return (cam == NULL) ? NULL : cam->cfwList;
 }
 
-int atik_camera_setDarkFrameMode(int useMode)
+int atik_camera_setDarkFrameMode(atikcam *cam, int useMode)
 {
-    return selectedDevice->setDarkFrameMode((useMode != 0));
+    CAMCALL(cam, setDarkFrameMode((useMode != 0)));
 }
-//#endif //HAVE_ATIK
+#endif // ATIK_SIMULATOR
@@ -0,0 +1,396 @@
+/*
+ * calib.c - calibration of frames by master bias, dark & flat
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Master frames are uncompressed single-HDU FITS files mapped into memory by
+ * My_mmap(), their header is parsed here (no cfitsio). Dark should be bias
+ * subtracted, it is scaled by ratio of frame EXPTIME to its own. All masters
+ * are converted once into float arrays: bias, dark and gain (mean of flat /
+ * flat), so each frame needs one fused pass: out = (raw - bias - dark*scale) *
+ * gain, which also gives statistics of calibrated image; exposure time could
+ * change each frame (auto exposure) without any recalculation. Frame could be
+ * a window of masters (readout ROI), then kernel processes it by rows. Kernel
+ * (AVX2 or plain C) is selected at runtime by CPUID. Histogram for robust statistics covers actual range of
+ * calibrated values (they could be negative after bias & dark subtraction), so
+ * it is filled by second pass when min & max are known: with 1 ADU bins if the
+ * range is narrower than 65536, else with wider ones.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include "calib.h"
+#include "imstat.h"
+#include "usefull_macros.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+#define FITS_BLOCK  (2880)
+#define FITS_CARD   (80)
+// pixels processed by kernel at once
+#define CHUNK       (4096)
+
+typedef struct{
+    char *name;         // file name
+    mmapbuf *map;       // mapped file
+    const unsigned char *data; // pixels (big-endian)
+    int bitpix;
+    long w, h;
+    double bzero, bscale;
+    double exptime;     // <0 if unknown
+} master;
+
+static master bias, dark, flat;
+static int active = 0;
+static long cw = 0, ch = 0;         // size of masters
+static float *offset = NULL;        // bias
+static float *darkrate = NULL;      // dark (NULL if there's no)
+static float *gain = NULL;          // normalized inverse flat
+
+static void cal_scalar(const uint16_t *in, const float *off, const float *dk, float scale,
+                       const float *g, float *out, size_t n, calib_acc *a){
+    double sum = 0., sum2 = 0.;
+    float min = a->min, max = a->max;
+    uint64_t novr = 0;
+    for(size_t i = 0; i < n; ++i){
+        float o = dk ? off[i] + dk[i] * scale : off[i];
+        float v = ((float)in[i] - o) * g[i];
+        out[i] = v;
+        sum += v;
+        sum2 += (double)v * v;
+        if(min > v) min = v;
+        if(max < v) max = v;
+        if(in[i] >= IMSTAT_OVERLOAD) ++novr;
+    }
+    a->sum += sum; a->sum2 += sum2; a->Noverld += novr;
+    a->min = min; a->max = max;
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void cal_avx2(const uint16_t *in, const float *off, const float *dk, float scale,
+                     const float *g, float *out, size_t n, calib_acc *a){
+    const __m256i thr = _mm256_set1_epi32(IMSTAT_OVERLOAD - 1);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    __m256 vmin = _mm256_set1_ps(a->min), vmax = _mm256_set1_ps(a->max);
+    __m256d s0 = _mm256_setzero_pd(), s1 = s0, q0 = s0, q1 = s0;
+    uint64_t novr = 0;
+    size_t nv = n / 8;
+    for(; nv; --nv, in += 8, off += 8, g += 8, out += 8){
+        __m256i raw = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)in));
+        __m256 o = _mm256_loadu_ps(off);
+        if(dk){
+            o = _mm256_add_ps(o, _mm256_mul_ps(_mm256_loadu_ps(dk), vscale));
+            dk += 8;
+        }
+        __m256 v = _mm256_sub_ps(_mm256_cvtepi32_ps(raw), o);
+        v = _mm256_mul_ps(v, _mm256_loadu_ps(g));
+        _mm256_storeu_ps(out, v);
+        vmin = _mm256_min_ps(vmin, v);
+        vmax = _mm256_max_ps(vmax, v);
+        __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+        __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+        s0 = _mm256_add_pd(s0, lo); s1 = _mm256_add_pd(s1, hi);
+        q0 = _mm256_add_pd(q0, _mm256_mul_pd(lo, lo));
+        q1 = _mm256_add_pd(q1, _mm256_mul_pd(hi, hi));
+        int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(raw, thr)));
+        novr += __builtin_popcount(m);
+    }
+    double s[4], q[4];
+    float mn[8], mx[8];
+    _mm256_storeu_pd(s, _mm256_add_pd(s0, s1));
+    _mm256_storeu_pd(q, _mm256_add_pd(q0, q1));
+    _mm256_storeu_ps(mn, vmin);
+    _mm256_storeu_ps(mx, vmax);
+    a->sum += s[0] + s[1] + s[2] + s[3];
+    a->sum2 += q[0] + q[1] + q[2] + q[3];
+    a->Noverld += novr;
+    for(int i = 0; i < 8; ++i){
+        if(a->min > mn[i]) a->min = mn[i];
+        if(a->max < mx[i]) a->max = mx[i];
+    }
+    cal_scalar(in, off, dk, scale, g, out, n % 8, a);
+}
+#endif // X86_KERNELS
+
+typedef void (*cal_kernel)(const uint16_t *in, const float *off, const float *dk, float scale,
+                           const float *g, float *out, size_t n, calib_acc *a);
+static cal_kernel kernel = cal_scalar;
+static const char *kernelname = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(){
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel = cal_avx2; kernelname = "AVX2";
+    }
+#endif
+}
+
+// name of calibration kernel
+const char *calib_kernel(){
+    pthread_once(&kernel_once, select_kernel);
+    return kernelname;
+}
+
+/**
+ * Map master frame & parse its header
+ * @param m    - master
+ * @param name - file name
+ * @return 0 if all OK
+ */
+static int master_open(master *m, char *name){
+    memset(m, 0, sizeof(master));
+    m->bscale = 1.; m->exptime = -1.;
+    if(!(m->map = My_mmap(name))) return 1;
+    m->name = name;
+    const char *start = m->map->data, *p = start, *end = start + m->map->len;
+    int simple = 0, naxis = -1, ended = 0;
+    for(; p + FITS_CARD <= end; p += FITS_CARD){
+        char card[FITS_CARD+1];
+        memcpy(card, p, FITS_CARD);
+        card[FITS_CARD] = 0;
+        if(strncmp(card, "END     ", 8) == 0){
+            ended = 1;
+            p += FITS_CARD;
+            break;
+        }
+        if(strncmp(card + 8, "= ", 2)) continue;
+        card[8] = 0;
+        for(int i = 7; i >= 0 && card[i] == ' '; --i) card[i] = 0;
+        char *val = card + 10;
+        if(strcmp(card, "SIMPLE") == 0) simple = (strchr(val, 'T') != NULL);
+        else if(strcmp(card, "BITPIX") == 0) m->bitpix = atoi(val);
+        else if(strcmp(card, "NAXIS") == 0) naxis = atoi(val);
+        else if(strcmp(card, "NAXIS1") == 0) m->w = atol(val);
+        else if(strcmp(card, "NAXIS2") == 0) m->h = atol(val);
+        else if(strcmp(card, "BZERO") == 0) m->bzero = strtod(val, NULL);
+        else if(strcmp(card, "BSCALE") == 0) m->bscale = strtod(val, NULL);
+        else if(strcmp(card, "EXPTIME") == 0) m->exptime = strtod(val, NULL);
+    }
+    int bpp = abs(m->bitpix) / 8;
+    if(!ended || !simple || naxis != 2 || m->w < 1 || m->h < 1 ||
+        (m->bitpix != 8 && m->bitpix != 16 && m->bitpix != 32 && m->bitpix != -32 && m->bitpix != -64)){
+        /// "%s: неподдерживаемый формат (нужен несжатый двумерный FITS)"
+        WARNX(_("%s: unsupported format (uncompressed 2D FITS needed)"), name);
+        return 1;
+    }
+    size_t hdrsz = (size_t)(p - start + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK;
+    if(hdrsz + (size_t)m->w * m->h * bpp > m->map->len){
+        /// "%s: файл обрезан"
+        WARNX(_("%s: file is truncated"), name);
+        return 1;
+    }
+    m->data = (const unsigned char*)start + hdrsz;
+    DBG("%s: %ldx%ld, BITPIX=%d, EXPTIME=%g", name, m->w, m->h, m->bitpix, m->exptime);
+    return 0;
+}
+
+static void master_close(master *m){
+    if(m->map) My_munmap(m->map);
+    memset(m, 0, sizeof(master));
+}
+
+// physical value of i-th pixel of master
+static double master_pix(const master *m, size_t i){
+    const unsigned char *p = m->data + i * (abs(m->bitpix) / 8);
+    double v;
+    switch(m->bitpix){
+        case 8:
+            v = p[0];
+        break;
+        case 16:
+            v = (int16_t)((p[0] << 8) | p[1]);
+        break;
+        case 32:
+            v = (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]);
+        break;
+        case -32:{
+            uint32_t u = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            v = f;
+        }
+        break;
+        default:{ // -64
+            uint64_t u = 0;
+            for(int j = 0; j < 8; ++j) u = (u << 8) | p[j];
+            memcpy(&v, &u, sizeof(v));
+        }
+    }
+    return v * m->bscale + m->bzero;
+}
+
+/**
+ * Read uncompressed 2D FITS image (the same formats as master frames)
+ * @param name - file name
+ * @param w, h - (o) image size
+ * @return physical values of pixels (should be FREE'd) or NULL if failed
+ */
+float *calib_readfits(char *name, int *w, int *h){
+    master m;
+    if(master_open(&m, name)){
+        master_close(&m);
+        return NULL;
+    }
+    size_t n = (size_t)m.w * m.h;
+    float *img = MALLOC(float, n);
+    for(size_t i = 0; i < n; ++i) img[i] = (float)master_pix(&m, i);
+    *w = (int)m.w; *h = (int)m.h;
+    master_close(&m);
+    return img;
+}
+
+// convert bias & dark into float arrays
+static void calc_offset(){
+    size_t n = (size_t)cw * ch;
+    for(size_t i = 0; i < n; ++i){
+        offset[i] = bias.map ? (float)master_pix(&bias, i) : 0.f;
+        if(darkrate) darkrate[i] = (float)master_pix(&dark, i);
+    }
+}
+
+// calculate gain by flat normalized to its mean
+static void calc_gain(){
+    size_t n = (size_t)cw * ch, ngood = 0;
+    double mean = 0.;
+    for(size_t i = 0; i < n; ++i){
+        double v = flat.map ? master_pix(&flat, i) : 1.;
+        if(v > 0.){ mean += v; ++ngood; }
+    }
+    if(ngood) mean /= ngood;
+    for(size_t i = 0; i < n; ++i){
+        double v = flat.map ? master_pix(&flat, i) : 1.;
+        gain[i] = (v > 0.) ? (float)(mean / v) : 0.f;
+    }
+    DBG("flat mean: %g, %zd good pixels", mean, ngood);
+}
+
+/**
+ * Load master frames (all of them should have the same size)
+ * @param biasname, darkname, flatname - file names (or NULL)
+ * @return 0 if all OK
+ */
+int calib_init(char *biasname, char *darkname, char *flatname){
+    calib_free();
+    if(!biasname && !darkname && !flatname) return 0;
+    if((biasname && master_open(&bias, biasname)) || (darkname && master_open(&dark, darkname)) ||
+        (flatname && master_open(&flat, flatname))) goto bad;
+    master *all[3] = {&bias, &dark, &flat};
+    for(int i = 0; i < 3; ++i){
+        if(!all[i]->map) continue;
+        if(!cw){ cw = all[i]->w; ch = all[i]->h; }
+        else if(cw != all[i]->w || ch != all[i]->h){
+            /// "Размеры калибровочных кадров различаются"
+            WARNX(_("Sizes of master frames are different"));
+            goto bad;
+        }
+    }
+    if(darkname && dark.exptime <= 0.)
+        /// "Нет EXPTIME в %s, темновой не будет масштабирован"
+        WARNX(_("No EXPTIME in %s, dark won't be scaled"), darkname);
+    offset = MALLOC(float, (size_t)cw * ch);
+    if(dark.map) darkrate = MALLOC(float, (size_t)cw * ch);
+    gain = MALLOC(float, (size_t)cw * ch);
+    calc_offset();
+    calc_gain();
+    pthread_once(&kernel_once, select_kernel);
+    active = 1;
+    return 0;
+bad:
+    calib_free();
+    return 1;
+}
+
+void calib_free(){
+    master_close(&bias);
+    master_close(&dark);
+    master_close(&flat);
+    FREE(offset);
+    FREE(darkrate);
+    FREE(gain);
+    cw = ch = 0;
+    active = 0;
+}
+
+int calib_active(){
+    return active;
+}
+
+/**
+ * Get size of master frames
+ * @param w, h - (o) size
+ * @return 1 if calibration is active
+ */
+int calib_size(int *w, int *h){
+    if(!active) return 0;
+    if(w) *w = (int)cw;
+    if(h) *h = (int)ch;
+    return 1;
+}
+
+/**
+ * Calibrate frame & calculate statistics of result
+ * @param in      - raw image
+ * @param x0, y0  - its position on masters (readout window)
+ * @param w, h    - its size (size of masters if there's no window)
+ * @param exptime - its exposure time (for dark scaling)
+ * @param out     - (o) calibrated image
+ * @param acc     - (o) statistics
+ * @param hist    - (o) histogram of calibrated image (or NULL), its bins are
+ *                  given by acc->hzero & acc->hscale
+ * @return 0 if all OK
+ */
+int calib_apply(const uint16_t *in, int x0, int y0, int w, int h, double exptime, float *out,
+                calib_acc *acc, uint32_t *hist){
+    if(!active || x0 < 0 || y0 < 0 || x0 + w > cw || y0 + h > ch) return 1;
+    float scale = (dark.map && dark.exptime > 0.) ? (float)(exptime / dark.exptime) : 1.f;
+    size_t n = (size_t)w * h;
+    // rows of full-width window are contiguous in masters
+    size_t rowlen = (w == cw) ? n : (size_t)w, nrows = n / rowlen;
+    acc->sum = acc->sum2 = 0.;
+    acc->min = FLT_MAX; acc->max = -FLT_MAX;
+    acc->Noverld = 0;
+    for(size_t r = 0; r < nrows; ++r){
+        size_t o = r * rowlen, m = ((size_t)y0 + r) * cw + x0;
+        for(size_t i = 0; i < rowlen; i += CHUNK){
+            size_t l = (rowlen - i < CHUNK) ? rowlen - i : CHUNK;
+            kernel(in + o + i, offset + m + i, darkrate ? darkrate + m + i : NULL, scale, gain + m + i,
+                   out + o + i, l, acc);
+        }
+    }
+    acc->hzero = floor(acc->min);
+    double range = acc->max - acc->hzero;
+    acc->hscale = (range < IMSTAT_NBINS - 1) ? 1. : range / (IMSTAT_NBINS - 1);
+    if(!hist) return 0;
+    memset(hist, 0, IMSTAT_NBINS * sizeof(uint32_t));
+    float zero = (float)acc->hzero, inv = (float)(1. / acc->hscale);
+    for(size_t i = 0; i < n; ++i){
+        int b = (int)((out[i] - zero) * inv + 0.5f);
+        if(b > IMSTAT_NBINS - 1) b = IMSTAT_NBINS - 1;
+        ++hist[b];
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * calib.h - calibration of frames by master bias, dark & flat
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __CALIB_H__
+#define __CALIB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// accumulators of calibrated image statistics
+typedef struct{
+    double sum, sum2;   // sum of values and their squares
+    float min, max;     // min/max values
+    uint64_t Noverld;   // amount of overloaded pixels of raw image
+    double hzero, hscale; // value of histogram bin i is hzero + i*hscale
+} calib_acc;
+
+int calib_init(char *bias, char *dark, char *flat);
+void calib_free();
+int calib_active();
+int calib_size(int *w, int *h);
+int calib_apply(const uint16_t *in, int x0, int y0, int w, int h, double exptime, float *out,
+                calib_acc *acc, uint32_t *hist);
+const char *calib_kernel();
+float *calib_readfits(char *name, int *w, int *h);
+
+#endif // __CALIB_H__
@@ -0,0 +1,215 @@
+/*
+ * camdaemon.c - camera daemon & its client
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Daemon keeps camera opened (and cooled) and waits for requests on local UNIX
+ * socket. Request is the command line of client: uint32_t amount of arguments
+ * and arguments as zero-terminated strings; daemon parses it by the same
+ * parse_args() and runs capture with stdout & stderr redirected to the
+ * client. The end of answer is zero byte followed by exit code.
+ */
+
+// for accept4
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "camdaemon.h"
+#include "usefull_macros.h"
+
+#define MAXREQUEST  (65536)     // max size of request
+#define MAXARGS     (1024)      // max amount of arguments
+
+static char *sockpath = NULL;
+
+static void rmsocket(){
+    if(sockpath) unlink(sockpath);
+}
+
+static int mksockaddr(const char *path, struct sockaddr_un *addr){
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr->sun_path)){
+        WARNX(_("Socket path too long"));
+        return 1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int readall(int fd, void *buf, size_t len){
+    char *ptr = (char*)buf;
+    while(len){
+        ssize_t n = read(fd, ptr, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return 1;
+        ptr += n; len -= n;
+    }
+    return 0;
+}
+
+static int writeall(int fd, const void *buf, size_t len){
+    const char *ptr = (const char*)buf;
+    while(len){
+        ssize_t n = write(fd, ptr, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return 1;
+        ptr += n; len -= n;
+    }
+    return 0;
+}
+
+// read request & run handler with output redirected to client
+static void process_request(int fd, request_handler handler){
+    uint32_t argc, len = 0;
+    char *buf = NULL, **argv = NULL;
+    if(readall(fd, &argc, sizeof(argc)) || readall(fd, &len, sizeof(len)) ||
+        argc < 1 || argc > MAXARGS || len > MAXREQUEST || !len){
+        WARNX(_("Bad request"));
+        return;
+    }
+    buf = MALLOC(char, len + 1);
+    if(readall(fd, buf, len)){
+        WARNX(_("Bad request"));
+        FREE(buf);
+        return;
+    }
+    argv = MALLOC(char*, argc + 1);
+    char *ptr = buf, *end = buf + len;
+    for(uint32_t i = 0; i < argc; ++i){
+        if(ptr >= end) break;
+        argv[i] = ptr;
+        ptr += strlen(ptr) + 1;
+    }
+    if(ptr != end){
+        WARNX(_("Bad request"));
+    }else{
+        int stdout0 = dup(STDOUT_FILENO), stderr0 = dup(STDERR_FILENO);
+        fflush(stdout); fflush(stderr);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        uint8_t ret[2] = {0, (uint8_t)handler((int)argc, argv)};
+        fflush(stdout); fflush(stderr);
+        dup2(stdout0, STDOUT_FILENO);
+        dup2(stderr0, STDERR_FILENO);
+        close(stdout0); close(stderr0);
+        if(writeall(fd, ret, 2)) WARNX(_("Client disconnected"));
+    }
+    FREE(argv);
+    FREE(buf);
+}
+
+/**
+ * Wait for requests & process them (till the end of program or signal)
+ * @param path    - path to socket
+ * @param handler - function processing requests
+ * @param stop    - set by signal handler: stop waiting (or NULL)
+ */
+void daemon_run(const char *path, request_handler handler, volatile sig_atomic_t *stop){
+    struct sockaddr_un addr;
+    if(mksockaddr(path, &addr)) return;
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sock < 0){
+        WARN("socket()");
+        return;
+    }
+    unlink(path); // old socket
+    if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) || listen(sock, 8)){
+        WARN("bind()");
+        close(sock);
+        return;
+    }
+    sockpath = strdup(path);
+    atexit(rmsocket);
+    // broken pipe when client disconnected shouldn't kill daemon
+    signal(SIGPIPE, SIG_IGN);
+    green(_("Wait for requests on %s\n"), path);
+    while(1){
+        int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if(fd < 0){
+            if(errno == EINTR && stop && *stop) break;
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            WARN("accept()");
+            break;
+        }
+        DBG("new request");
+        process_request(fd, handler);
+        close(fd);
+    }
+    close(sock);
+    rmsocket();
+}
+
+/**
+ * Send command line to daemon & show its output
+ * @param path - path to socket
+ * @param argc, argv - command line
+ * @return exit code of request
+ */
+int client_run(const char *path, int argc, char **argv){
+    struct sockaddr_un addr;
+    if(mksockaddr(path, &addr)) return 1;
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr))){
+        WARN(_("Can't connect to %s"), path);
+        if(sock > -1) close(sock);
+        return 1;
+    }
+    uint32_t n = argc, len = 0;
+    for(int i = 0; i < argc; ++i) len += strlen(argv[i]) + 1;
+    int bad = writeall(sock, &n, sizeof(n)) || writeall(sock, &len, sizeof(len));
+    for(int i = 0; i < argc && !bad; ++i)
+        bad = writeall(sock, argv[i], strlen(argv[i]) + 1);
+    if(bad){
+        WARN(_("Can't send request"));
+        close(sock);
+        return 1;
+    }
+    // answer: text, zero byte & exit code
+    char buf[4096];
+    int ret = 1, gotend = 0;
+    while(1){
+        ssize_t r = read(sock, buf, sizeof(buf));
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) break;
+        char *z = gotend ? buf : memchr(buf, 0, r);
+        if(gotend){ // exit code in next packet
+            ret = (uint8_t)buf[0];
+            break;
+        }
+        if(z){
+            fwrite(buf, 1, z - buf, stdout);
+            gotend = 1;
+            if(z - buf + 1 < r){
+                ret = (uint8_t)z[1];
+                break;
+            }
+        }else fwrite(buf, 1, r, stdout);
+    }
+    fflush(stdout);
+    close(sock);
+    if(!gotend) WARNX(_("Connection closed by daemon"));
+    return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ * camdaemon.h - camera daemon & its client
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __CAMDAEMON_H__
+#define __CAMDAEMON_H__
+
+#include <signal.h>
+
+// function processing request (command line arguments from client), returns exit code for client
+typedef int (*request_handler)(int argc, char **argv);
+
+void daemon_run(const char *path, request_handler handler, volatile sig_atomic_t *stop);
+int client_run(const char *path, int argc, char **argv);
+
+#endif // __CAMDAEMON_H__
@@ -24,6 +24,7 @@
 #include <strings.h>
 #include <math.h>
 #include <limits.h>
+#include <getopt.h> // optind
 #include "cmdlnopts.h"
 #include "usefull_macros.h"
 
@@ -52,6 +53,13 @@ glob_pars const Gdefault = {
     .X1 = -1, .Y1 = -1,
     .temperature = 1e6,
     .shtr_cmd = SHUTTER_LEAVE,
+    .qlen = 3,
+    .statthreads = 1,
+    .nwriters = 1,
+    .padding = 4,
+    .stackmem = -1,
+    .guide = -1,
+    .guidekp = -1., .guideki = -1.,
 };
 
 /*
@@ -63,6 +71,7 @@ myoption cmdlnopts[] = {
     {"force",   NO_ARGS,    &rewrite_ifexists,1,arg_none,NULL,              N_("rewrite output file if exists")},
     {"verbose", NO_ARGS,    NULL,   'V',    arg_none,   APTR(&verbose),     N_("verbose level (each -V increase it)")},
     {"camname", NEED_ARG,   NULL,   'c',    arg_string, APTR(&G.camname),   N_("camera device name")},
+    {"cameras", NEED_ARG,   NULL,   0,      arg_string, APTR(&G.cameras),   N_("capture simultaneously by several cameras: comma-separated names or \"all\"")},
     {"dark",    NO_ARGS,    NULL,   'd',    arg_int,    APTR(&G.dark),      N_("not open shutter, when exposing (\"dark frames\")")},
     {"open-shutter",NO_ARGS,&G.shtr_cmd,SHUTTER_OPEN,arg_none,NULL,     N_("open shutter")},
     {"close-shutter",NO_ARGS,&G.shtr_cmd,SHUTTER_CLOSE,arg_none,NULL,   N_("close shutter")},
@@ -85,6 +94,55 @@ myoption cmdlnopts[] = {
     {"warmup",  NO_ARGS,    NULL,   'w',    arg_none,   APTR(&G.warmup),    N_("warm up CCD")},
     {"fast",    NO_ARGS,    NULL,   'f',    arg_none,   APTR(&G.fast),      N_("fast (8-bit) mode")},
     {"preview", NO_ARGS,    NULL,   'e',    arg_none,   APTR(&G.preview),   N_("preview mode")},
+    {"queue",   NEED_ARG,   NULL,   'q',    arg_int,    APTR(&G.qlen),      N_("amount of frame buffers for background writing (default: 3)")},
+    {"hugepages",NO_ARGS,   NULL,   0,      arg_none,   APTR(&G.hugepages), N_("use huge pages for frame buffers")},
+    {"mlock",   NO_ARGS,    NULL,   0,      arg_none,   APTR(&G.mlock),     N_("lock frame buffers in RAM")},
+    {"stat-threads",NEED_ARG,NULL,  0,      arg_int,    APTR(&G.statthreads),N_("amount of threads for image statistics calculation")},
+    {"stat-bench",NO_ARGS,  NULL,   0,      arg_none,   APTR(&G.statbench), N_("run benchmark of statistics calculation on synthetic frames & exit")},
+    {"fast-stat",NO_ARGS,   NULL,   0,      arg_none,   APTR(&G.faststat),  N_("don't calculate median, percentiles and MAD")},
+    {"compress",NEED_ARG,   NULL,   'z',    arg_string, APTR(&G.compress),  N_("write tile-compressed FITS: rice|hcompress|gzip[:level] (level is scale for hcompress)")},
+    {"write-threads",NEED_ARG,NULL, 0,      arg_int,    APTR(&G.nwriters),  N_("amount of threads writing (compressing) different frames simultaneously")},
+    {"series",  NEED_ARG,   NULL,   0,      arg_string, APTR(&G.series),    N_("write whole series into one FITS file: mef (extension per frame) or cube")},
+    {"direct-fits",NO_ARGS, NULL,   0,      arg_none,   APTR(&G.directfits),N_("write pixels of uncompressed FITS directly (cfitsio makes only header)")},
+    {"padding", NEED_ARG,   NULL,   0,      arg_int,    APTR(&G.padding),   N_("minimal amount of digits in numbers of files (default: 4)")},
+    {"fsync",   NO_ARGS,    NULL,   0,      arg_none,   APTR(&G.fsync),     N_("flush each file to disk after writing")},
+    {"swbin",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.swbin),     N_("software binning of frames: NxM[:sum|mean|median][,NxM...] (several products are saved with suffix _bNxM)")},
+    {"bias",    NEED_ARG,   NULL,   0,      arg_string, APTR(&G.bias),      N_("calibrate frames by master bias (uncompressed FITS)")},
+    {"dark-master",NEED_ARG,NULL,   0,      arg_string, APTR(&G.mdark),     N_("calibrate frames by bias-subtracted master dark (scaled by EXPTIME)")},
+    {"flat",    NEED_ARG,   NULL,   0,      arg_string, APTR(&G.flat),      N_("calibrate frames by master flat")},
+    {"calib-format",NEED_ARG,NULL,  0,      arg_string, APTR(&G.calfmt),    N_("format of calibrated frames: float (default) or int16 (scaled)")},
+    {"keep-raw",NO_ARGS,    NULL,   0,      arg_none,   APTR(&G.keepraw),   N_("save raw frames too (calibrated ones get suffix _cal), also save each frame of stack or co-add")},
+    {"stack",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.stack),     N_("stack series into master frame: mean, median or sigclip (saved with suffix _mode)")},
+    {"stack-kappa",NEED_ARG,NULL,   0,      arg_double, APTR(&G.kappa),     N_("threshold of sigma-clipping in sigmas (default: 3)")},
+    {"stack-mem",NEED_ARG,  NULL,   0,      arg_int,    APTR(&G.stackmem),  N_("max size of stack in RAM, MB (default: 1024), larger stacks are kept in temporary file")},
+    {"coadd",   NEED_ARG,   NULL,   0,      arg_string, APTR(&G.coadd),     N_("co-add series without saving each frame: sum or mean (saved with suffix _coadd)")},
+    {"coadd-align",NO_ARGS, NULL,   0,      arg_none,   APTR(&G.coaddalign),N_("shift co-added frames to align their centroids")},
+    {"coadd-snapshot",NEED_ARG,NULL,0,      arg_int,    APTR(&G.snapshot),  N_("save current co-add each N frames")},
+    {"hotpix",  NEED_ARG,   NULL,   0,      arg_string, APTR(&G.hotpix),    N_("replace hot pixels found in given master dark (map is cached in <dark>.hotpix)")},
+    {"hotpix-sigma",NEED_ARG,NULL,  0,      arg_double, APTR(&G.hotsigma),  N_("threshold of hot pixels in sigmas (default: 5)")},
+    {"cosmic",  NO_ARGS,    NULL,   0,      arg_none,   APTR(&G.cosmic),    N_("find & replace cosmic rays")},
+    {"cosmic-sigma",NEED_ARG,NULL,  0,      arg_double, APTR(&G.crsigma),   N_("threshold of cosmic rays in sigmas (default: 5)")},
+    {"demosaic",NEED_ARG,   NULL,   0,      arg_string, APTR(&G.demosaic),  N_("save also RGB cube of colour frames (suffix _rgb): bilinear or edge (edge-aware)")},
+    {"stars",   NO_ARGS,    NULL,   0,      arg_none,   APTR(&G.stars),     N_("find stars on each frame and show their amount, median FWHM & HFD (for focusing)")},
+    {"stars-sigma",NEED_ARG,NULL,   0,      arg_double, APTR(&G.starsigma), N_("detection threshold of stars in sigmas of background noise (default: 5)")},
+    {"guide",   NEED_ARG,   NULL,   0,      arg_int,    APTR(&G.guide),     N_("autoguiding by N cycles of short exposures (0 - till Ctrl+C) instead of series")},
+    {"guide-box",NEED_ARG,  NULL,   0,      arg_int,    APTR(&G.guidebox),  N_("size of guiding subframe, binned pixels (default: 32)")},
+    {"guide-kp",NEED_ARG,   NULL,   0,      arg_double, APTR(&G.guidekp),   N_("proportional gain of guiding (default: 0.7)")},
+    {"guide-ki",NEED_ARG,   NULL,   0,      arg_double, APTR(&G.guideki),   N_("integral gain of guiding (default: 0.1)")},
+    {"guide-cal",NEED_ARG,  NULL,   0,      arg_double, APTR(&G.guidecal),  N_("length of calibration pulses, s (default: 2)")},
+    {"guide-max",NEED_ARG,  NULL,   0,      arg_double, APTR(&G.guidemax),  N_("max length of correction pulse, s (default: 1)")},
+    {"guide-log",NEED_ARG,  NULL,   0,      arg_string, APTR(&G.guidelog),  N_("CSV log of guiding cycles (errors, pulses & latency)")},
+    {"roi",     NEED_ARG,   NULL,   0,      arg_string, APTR(&G.roi),       N_("read only window of WxH sensor pixels around target found on first full frame, window follows target")},
+    {"roi-target",NEED_ARG, NULL,   0,      arg_string, APTR(&G.roitarget), N_("sensor coordinates X,Y of ROI target (default: the brightest star)")},
+    {"autoexp", NEED_ARG,   NULL,   0,      arg_double, APTR(&G.autoexp),   N_("change exposure time of each next frame to get given median level, ADU (first one is given by exptime)")},
+    {"autoexp-max",NEED_ARG,NULL,   0,      arg_double, APTR(&G.autoexpmax),N_("max exposure time of auto exposure, s (default: 300)")},
+    {"live",    NEED_ARG,   NULL,   0,      arg_string, APTR(&G.live),      N_("publish each raw frame into POSIX shared memory segment with given name for live viewers (see liveview.h)")},
+    {"live-only",NO_ARGS,   NULL,   0,      arg_none,   APTR(&G.liveonly),  N_("don't save frames into files, only publish them (with --live)")},
+    {"daemon",  NEED_ARG,   NULL,   0,      arg_string, APTR(&G.daemon),    N_("keep camera opened and wait for requests on given UNIX socket")},
+    {"client",  NEED_ARG,   NULL,   0,      arg_string, APTR(&G.client),    N_("send all other arguments to daemon on given UNIX socket")},
+#ifdef TIMING
+    {"timing-log",NEED_ARG, NULL,   0,      arg_string, APTR(&G.timinglog), N_("log of capture & saving phases duration (CSV if name ends with .csv, else JSON lines)")},
+#endif
     end_option
 };
 
@@ -97,15 +155,34 @@ myoption cmdlnopts[] = {
  * @return allocated structure with global parameters
  */
 glob_pars *parse_args(int argc, char **argv){
+    // strings allocated by previous call (daemon parses each request)
+    static char **dups = NULL;
+    static int ndups = 0;
     void *ptr;
+    for(int i = 0; i < ndups; ++i) FREE(dups[i]);
+    ndups = 0;
     ptr = memcpy(&G, &Gdefault, sizeof(G)); assert(ptr);
+    // could be called several times (in daemon mode)
+    help = 0; rewrite_ifexists = 0; verbose = 0;
+    optind = 0;
     // format of help: "Usage: progname [args]\n"
     change_helpstring("Usage: %s [args] <output file prefix>\n\n\tWhere args are:\n");
     // parse arguments
     parseargs(&argc, &argv, cmdlnopts);
     if(help) showhelp(-1, cmdlnopts);
+    if(!dups){
+        int n = 1; // + outfile
+        for(myoption *o = cmdlnopts; o->name; ++o) ++n;
+        dups = MALLOC(char*, n);
+    }
+    for(myoption *o = cmdlnopts; o->name; ++o){
+        if(o->type != arg_string || !o->argptr) continue;
+        char **s = (char**)o->argptr;
+        char *const *d = (char *const *)((const char*)&Gdefault + ((char*)s - (char*)&G));
+        if(*s && *s != *d) dups[ndups++] = *s; // strdup'ed by parseargs()
+    }
     if(argc > 0){
-        G.outfile = strdup(argv[0]);
+        G.outfile = dups[ndups++] = strdup(argv[0]);
         if(argc > 1){
             WARNX("%d unused parameters:\n", argc - 1);
             for(int i = 1; i < argc; ++i)
@@ -43,6 +43,7 @@ typedef struct{
     char *prog_id;      // programm identificator
     char *author;       // programm author
     char *camname;      // camera name (if several connected)
+    char *cameras;      // names of cameras working simultaneously (comma-separated or "all")
     int warmup;         // warm up CCD
     int dark;           // dark frame
     double exptime;     // time of exposition in ms
@@ -54,6 +55,53 @@ typedef struct{
     int shtr_cmd;       // shutter command
     int fast;           // 8bit mode
     int preview;        // preview mode
+    int qlen;           // amount of frame buffers in writing queue
+    int hugepages;      // use huge pages for frame buffers
+    int mlock;          // lock frame buffers in memory
+    int statthreads;    // amount of threads for statistics calculation
+    int statbench;      // run statistics benchmark & exit
+    int faststat;       // don't calculate robust statistics
+    char *compress;     // FITS compression: "type[:level]"
+    int nwriters;       // amount of writing threads
+    char *series;       // write whole series into one FITS: "mef" or "cube"
+    int directfits;     // write pixels of uncompressed FITS without cfitsio
+    int padding;        // amount of digits in file numbers
+    int fsync;          // fsync() files after writing
+    char *swbin;        // software binning: "NxM[:policy][,NxM[:policy]...]"
+    char *bias;         // master bias
+    char *mdark;        // master dark (bias subtracted)
+    char *flat;         // master flat
+    char *calfmt;       // format of calibrated images: "float" or "int16"
+    int keepraw;        // save raw images with calibrated or stacked
+    char *stack;        // stack series into master frame: "mean", "median" or "sigclip"
+    double kappa;       // sigma-clipping threshold
+    int stackmem;       // max size of stack in RAM (MB)
+    char *coadd;        // co-add series: "sum" or "mean"
+    int coaddalign;     // align co-added frames by centroid
+    int snapshot;       // save co-add each N frames
+    char *hotpix;       // master dark for map of hot pixels
+    double hotsigma;    // threshold of hot pixels
+    int cosmic;         // search & remove cosmic rays
+    double crsigma;     // threshold of cosmic rays
+    char *demosaic;     // demosaicing of colour frames: "bilinear" or "edge"
+    int stars;          // find stars & measure their FWHM/HFD
+    double starsigma;   // detection threshold of stars
+    int guide;          // amount of autoguiding cycles (0 - infinite, -1 - don't guide)
+    int guidebox;       // size of guiding subframe
+    double guidekp;     // gains of guiding PI controller
+    double guideki;
+    double guidecal;    // length of calibration pulses (s)
+    double guidemax;    // max length of correction pulse (s)
+    char *guidelog;     // CSV log of guiding cycles
+    char *roi;          // readout window tracking target: "WxH"
+    char *roitarget;    // its target: "X,Y" (sensor pixels)
+    double autoexp;     // target median level of auto exposure (ADU)
+    double autoexpmax;  // max time of auto exposure (s)
+    char *live;         // publish frames into this shared memory segment
+    int liveonly;       // don't save frames into files (live view only)
+    char *timinglog;    // log of phases duration
+    char *daemon;       // run as daemon listening this socket
+    char *client;       // send request to daemon on this socket
     double temperature; // temperature of CCD
 } glob_pars;
 
@@ -0,0 +1,289 @@
+/*
+ * coadd.c - live co-adding of frame series
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Each frame is added to running sum as soon as it is got, so nothing but
+ * the sum is stored. Accumulators are 32-bit when amount of frames allows
+ * (COADD_MAX32), else 64-bit; rows are added by vector kernel (AVX2, SSE4.1
+ * or plain C, selected at runtime by CPUID). When alignment is on, integer
+ * shift of each frame is found by centroid of pixels above threshold relative
+ * to centroid of first frame, so only overlapping parts of rows are added.
+ * Coverage of pixels (for mean) is kept as 2D difference array of shifted
+ * frame rectangles, so it costs four increments per frame.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include "coadd.h"
+#include "usefull_macros.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+struct coadd{
+    int w, h;
+    long nmax;
+    long n;                 // amount of frames added
+    uint32_t *acc32;        // accumulators (one of these)
+    uint64_t *acc64;
+    int32_t *cover;         // difference array of coverage, (w+1)x(h+1)
+    int align;              // shift frames by centroid
+    int haveref;            // centroid of first frame is known
+    double refx, refy;      // its coordinates
+    pthread_mutex_t mutex;
+};
+
+static void add32_scalar(const uint16_t *p, size_t n, uint32_t *acc){
+    for(size_t i = 0; i < n; ++i) acc[i] += p[i];
+}
+
+static void add64_scalar(const uint16_t *p, size_t n, uint64_t *acc){
+    for(size_t i = 0; i < n; ++i) acc[i] += p[i];
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void add32_avx2(const uint16_t *p, size_t n, uint32_t *acc){
+    size_t nv = n / 16;
+    for(; nv; --nv, p += 16, acc += 16){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 8));
+        _mm256_storeu_si256((__m256i*)acc, _mm256_add_epi32(a0, lo));
+        _mm256_storeu_si256((__m256i*)(acc + 8), _mm256_add_epi32(a1, hi));
+    }
+    add32_scalar(p, n % 16, acc);
+}
+
+__attribute__((target("avx2")))
+static void add64_avx2(const uint16_t *p, size_t n, uint64_t *acc){
+    size_t nv = n / 8;
+    for(; nv; --nv, p += 8, acc += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m256i lo = _mm256_cvtepu16_epi64(v), hi = _mm256_cvtepu16_epi64(_mm_srli_si128(v, 8));
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+        _mm256_storeu_si256((__m256i*)acc, _mm256_add_epi64(a0, lo));
+        _mm256_storeu_si256((__m256i*)(acc + 4), _mm256_add_epi64(a1, hi));
+    }
+    add64_scalar(p, n % 8, acc);
+}
+
+__attribute__((target("sse4.1")))
+static void add32_sse41(const uint16_t *p, size_t n, uint32_t *acc){
+    size_t nv = n / 8;
+    for(; nv; --nv, p += 8, acc += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i lo = _mm_cvtepu16_epi32(v), hi = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+        __m128i a0 = _mm_loadu_si128((const __m128i*)acc);
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(acc + 4));
+        _mm_storeu_si128((__m128i*)acc, _mm_add_epi32(a0, lo));
+        _mm_storeu_si128((__m128i*)(acc + 4), _mm_add_epi32(a1, hi));
+    }
+    add32_scalar(p, n % 8, acc);
+}
+
+__attribute__((target("sse4.1")))
+static void add64_sse41(const uint16_t *p, size_t n, uint64_t *acc){
+    size_t nv = n / 8;
+    for(; nv; --nv, p += 8, acc += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        for(int i = 0; i < 4; ++i, v = _mm_srli_si128(v, 4)){
+            __m128i a = _mm_loadu_si128((const __m128i*)(acc + 2*i));
+            _mm_storeu_si128((__m128i*)(acc + 2*i), _mm_add_epi64(a, _mm_cvtepu16_epi64(v)));
+        }
+    }
+    add64_scalar(p, n % 8, acc);
+}
+#endif // X86_KERNELS
+
+static void (*kernel32)(const uint16_t *p, size_t n, uint32_t *acc) = add32_scalar;
+static void (*kernel64)(const uint16_t *p, size_t n, uint64_t *acc) = add64_scalar;
+static const char *kernelname = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(){
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel32 = add32_avx2; kernel64 = add64_avx2; kernelname = "AVX2";
+    }else if(__builtin_cpu_supports("sse4.1")){
+        kernel32 = add32_sse41; kernel64 = add64_sse41; kernelname = "SSE4.1";
+    }
+#endif
+}
+
+// name of co-adding kernel
+const char *coadd_kernel(){
+    pthread_once(&kernel_once, select_kernel);
+    return kernelname;
+}
+
+/**
+ * Create new co-add
+ * @param w, h  - size of frames
+ * @param nmax  - max amount of frames (selects width of accumulators)
+ * @param align - shift frames by centroid
+ * @return co-add or NULL if failed
+ */
+coadd *coadd_new(int w, int h, long nmax, int align){
+    if(w < 1 || h < 1 || nmax < 1) return NULL;
+    pthread_once(&kernel_once, select_kernel);
+    coadd *c = MALLOC(coadd, 1);
+    size_t npix = (size_t)w * h;
+    c->w = w; c->h = h; c->nmax = nmax;
+    c->align = align;
+    if(nmax > COADD_MAX32) c->acc64 = MALLOC(uint64_t, npix);
+    else c->acc32 = MALLOC(uint32_t, npix);
+    c->cover = MALLOC(int32_t, (size_t)(w + 1) * (h + 1));
+    pthread_mutex_init(&c->mutex, NULL);
+    DBG("co-add %dx%d, %d-bit accumulators", w, h, c->acc64 ? 64 : 32);
+    return c;
+}
+
+void coadd_free(coadd **c){
+    if(!c || !*c) return;
+    FREE((*c)->acc32);
+    FREE((*c)->acc64);
+    FREE((*c)->cover);
+    pthread_mutex_destroy(&(*c)->mutex);
+    FREE(*c);
+}
+
+/**
+ * Centroid of pixels above threshold (weighted by their excess)
+ * @return 0 if found
+ */
+static int centroid(const uint16_t *data, int w, int h, double thres, double *cx, double *cy){
+    double s = 0., sx = 0., sy = 0.;
+    for(int y = 0; y < h; ++y, data += w){
+        double rs = 0., rsx = 0.;
+        for(int x = 0; x < w; ++x){
+            double v = data[x] - thres;
+            if(v <= 0.) continue;
+            rs += v; rsx += v * x;
+        }
+        s += rs; sx += rsx; sy += rs * y;
+    }
+    if(s <= 0.) return 1;
+    *cx = sx / s; *cy = sy / s;
+    return 0;
+}
+
+/**
+ * Add frame to co-add (could be called from several threads)
+ * @param c     - co-add
+ * @param data  - image
+ * @param w, h  - its size
+ * @param thres - threshold of pixels for centroid (when aligned)
+ * @return amount of frames added or -1 if failed
+ */
+long coadd_add(coadd *c, const uint16_t *data, int w, int h, double thres){
+    if(!c || w != c->w || h != c->h) return -1;
+    int dx = 0, dy = 0;
+    double cx, cy;
+    // centroid doesn't need lock
+    int havecen = (c->align && !centroid(data, w, h, thres, &cx, &cy));
+    pthread_mutex_lock(&c->mutex);
+    if(c->n == c->nmax){
+        pthread_mutex_unlock(&c->mutex);
+        return -1;
+    }
+    if(havecen){
+        if(!c->haveref){
+            c->refx = cx; c->refy = cy;
+            c->haveref = 1;
+        }
+        dx = (int)lround(c->refx - cx);
+        dy = (int)lround(c->refy - cy);
+        if(dx <= -w || dx >= w || dy <= -h || dy >= h) dx = dy = 0;
+        DBG("centroid (%.1f, %.1f), shift (%d, %d)", cx, cy, dx, dy);
+    }
+    // output rectangle [x0, x1) x [y0, y1), input pixel is (x - dx, y - dy)
+    int x0 = dx > 0 ? dx : 0, x1 = dx < 0 ? w + dx : w;
+    int y0 = dy > 0 ? dy : 0, y1 = dy < 0 ? h + dy : h;
+    size_t n = x1 - x0;
+    for(int y = y0; y < y1; ++y){
+        const uint16_t *in = data + (size_t)(y - dy) * w + (x0 - dx);
+        size_t o = (size_t)y * w + x0;
+        if(c->acc32) kernel32(in, n, c->acc32 + o);
+        else kernel64(in, n, c->acc64 + o);
+    }
+    int32_t *cv = c->cover;
+    size_t W = w + 1;
+    ++cv[y0 * W + x0]; --cv[y0 * W + x1];
+    --cv[y1 * W + x0]; ++cv[y1 * W + x1];
+    long ret = ++c->n;
+    pthread_mutex_unlock(&c->mutex);
+    return ret;
+}
+
+long coadd_count(coadd *c){
+    if(!c) return 0;
+    pthread_mutex_lock(&c->mutex);
+    long n = c->n;
+    pthread_mutex_unlock(&c->mutex);
+    return n;
+}
+
+/**
+ * Get current state of co-add
+ * @param c    - co-add
+ * @param mean - 0 for sum, 1 for mean (sum divided by coverage of pixel)
+ * @param out  - (o) image (w*h values)
+ * @return 0 if all OK
+ */
+int coadd_get(coadd *c, int mean, double *out){
+    if(!c || !out) return 1;
+    int w = c->w, h = c->h;
+    size_t W = w + 1;
+    int32_t *row = NULL, *cover = NULL;
+    pthread_mutex_lock(&c->mutex);
+    if(!c->n){
+        pthread_mutex_unlock(&c->mutex);
+        return 1;
+    }
+    for(size_t i = 0, npix = (size_t)w * h; i < npix; ++i)
+        out[i] = c->acc32 ? (double)c->acc32[i] : (double)c->acc64[i];
+    if(mean){ // coverage of pixels: prefix sums of difference array
+        row = MALLOC(int32_t, w);   // running sum of columns
+        cover = MALLOC(int32_t, W * h);
+        memcpy(cover, c->cover, W * h * sizeof(int32_t));
+    }
+    pthread_mutex_unlock(&c->mutex);
+    if(!mean) return 0;
+    for(int y = 0; y < h; ++y){
+        int32_t s = 0, *cv = cover + y * W;
+        double *o = out + (size_t)y * w;
+        for(int x = 0; x < w; ++x){
+            row[x] += cv[x];
+            s += row[x];
+            o[x] = s > 0 ? o[x] / s : 0.;
+        }
+    }
+    FREE(row);
+    FREE(cover);
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * coadd.h - live co-adding of frame series
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __COADD_H__
+#define __COADD_H__
+
+#include <stdint.h>
+
+// max amount of frames for 32-bit accumulators (65535 * 65537 == UINT32_MAX)
+#define COADD_MAX32     (65537)
+
+typedef struct coadd coadd;
+
+coadd *coadd_new(int w, int h, long nmax, int align);
+long coadd_add(coadd *c, const uint16_t *data, int w, int h, double thres);
+long coadd_count(coadd *c);
+int coadd_get(coadd *c, int mean, double *out);
+void coadd_free(coadd **c);
+const char *coadd_kernel();
+
+#endif // __COADD_H__
@@ -0,0 +1,379 @@
+/*
+ * defects.c - correction of hot pixels & cosmic rays
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Hot pixels are found once in master dark: pixels above median + sigma*MAD
+ * (scaled to std, but not less than 1 ADU: MAD of bias or integer-valued dark
+ * could be zero); map with more than HOTPIX_MAXFRAC of pixels is refused as
+ * wrong (e.g. dark isn't dark). Their sorted indexes are cached in file "<dark>.hotpix"
+ * which is reused while it is newer than dark and was made with the same
+ * threshold. Each frame needs O(defects) work: hot pixel is replaced by median
+ * of its good neighbours (bitmap of defects marks bad ones). Frame could be a
+ * window of the map (readout ROI): hot pixels of its rows are found by binary
+ * search and converted into window indexes.
+ * Cosmic rays are found by Laplacian: L = v - mean of 4 neighbours should be
+ * above crsigma times its noise (estimated by MAD of sparse sample of frame)
+ * and sharp enough (L > CR_SHARP * (mean of neighbours - background)), so
+ * cores of stars don't pass. Frame is processed by bands of rows in several
+ * threads, found pixels are replaced after detection the same way as hot ones.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "defects.h"
+#include "calib.h"
+#include "imstat.h"
+#include "usefull_macros.h"
+
+// magic of cache file
+#define HOTPIX_MAGIC    "ATIKHOTPIX1"
+// max fraction of hot pixels in map
+#define HOTPIX_MAXFRAC  (0.01)
+// min sharpness of cosmic ray
+#define CR_SHARP        (2.)
+// max amount of pixels in sample for noise estimation
+#define NOISE_SAMPLE    (65536)
+// rows in band processed by one thread at once
+#define BAND_ROWS       (64)
+
+static int hw = 0, hh = 0;          // size of map
+static uint32_t *hot = NULL;        // sorted indexes of hot pixels
+static uint32_t nhot = 0;
+static uint32_t *winhot = NULL;     // indexes of hot pixels inside window of map
+static uint8_t *bitmap = NULL;      // bad pixels of current frame (hot & cosmic)
+static size_t bitmapsz = 0;
+static int active = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // bitmap is common
+
+#define ISBAD(i)    (bitmap[(i) >> 3] & (1 << ((i) & 7)))
+#define SETBAD(i)   do{ bitmap[(i) >> 3] |= (1 << ((i) & 7)); }while(0)
+
+// median & MAD (scaled to std) of array (it is reordered)
+static void robust(float *v, size_t n, double *med, double *sigma){
+    *med = imstat_selectf(v, (long)n, (long)n / 2);
+    for(size_t i = 0; i < n; ++i) v[i] = fabsf(v[i] - (float)*med);
+    *sigma = 1.4826 * imstat_selectf(v, (long)n, (long)n / 2);
+}
+
+// read cached map, return 0 if it is valid
+static int read_cache(const char *name, const struct stat *darkst, double sigma){
+    struct stat st;
+    char magic[sizeof(HOTPIX_MAGIC)];
+    double s;
+    int w, h;
+    uint32_t n;
+    if(stat(name, &st) || st.st_mtime < darkst->st_mtime) return 1;
+    FILE *f = fopen(name, "r");
+    if(!f) return 1;
+    int ok = (fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, HOTPIX_MAGIC, sizeof(magic)) &&
+        fread(&w, sizeof(int), 1, f) == 1 && fread(&h, sizeof(int), 1, f) == 1 &&
+        fread(&s, sizeof(double), 1, f) == 1 && fread(&n, sizeof(uint32_t), 1, f) == 1 &&
+        s == sigma && w > 0 && h > 0 && n <= HOTPIX_MAXFRAC * w * h);
+    if(ok){
+        hot = MALLOC(uint32_t, n ? n : 1);
+        ok = (fread(hot, sizeof(uint32_t), n, f) == n);
+        for(uint32_t i = 1; ok && i < n; ++i) if(hot[i] <= hot[i-1]) ok = 0;
+        if(ok && n && hot[n-1] >= (uint64_t)w * h) ok = 0;
+        if(!ok) FREE(hot);
+    }
+    fclose(f);
+    if(!ok) return 1;
+    hw = w; hh = h; nhot = n;
+    DBG("%u hot pixels read from %s", n, name);
+    return 0;
+}
+
+static void write_cache(const char *name, double sigma){
+    FILE *f = fopen(name, "w");
+    if(!f){
+        WARN("fopen(%s)", name);
+        return;
+    }
+    if(fwrite(HOTPIX_MAGIC, sizeof(HOTPIX_MAGIC), 1, f) != 1 || fwrite(&hw, sizeof(int), 1, f) != 1 ||
+        fwrite(&hh, sizeof(int), 1, f) != 1 || fwrite(&sigma, sizeof(double), 1, f) != 1 ||
+        fwrite(&nhot, sizeof(uint32_t), 1, f) != 1 || fwrite(hot, sizeof(uint32_t), nhot, f) != nhot)
+        WARN("fwrite(%s)", name);
+    fclose(f);
+}
+
+// find hot pixels in master dark
+static int build_map(char *dark, double sigma){
+    int w, h;
+    float *img = calib_readfits(dark, &w, &h);
+    if(!img) return 1;
+    size_t n = (size_t)w * h;
+    float *tmp = MALLOC(float, n);
+    memcpy(tmp, img, n * sizeof(float));
+    double med, sd;
+    robust(tmp, n, &med, &sd);
+    FREE(tmp);
+    if(sd < 1.) sd = 1.; // at least 1 ADU of noise
+    float thres = (float)(med + sigma * sd);
+    uint32_t cnt = 0;
+    for(size_t i = 0; i < n; ++i) if(img[i] > thres) ++cnt;
+    if(cnt > HOTPIX_MAXFRAC * n){
+        /// "%s: %u пикселей выше %g (больше %g%%), карта горячих пикселей не создана"
+        WARNX(_("%s: %u pixels above %g (more than %g%%), map of hot pixels isn't made"),
+              dark, cnt, thres, HOTPIX_MAXFRAC * 100.);
+        FREE(img);
+        return 1;
+    }
+    hot = MALLOC(uint32_t, cnt ? cnt : 1);
+    for(size_t i = 0; i < n; ++i) if(img[i] > thres) hot[nhot++] = (uint32_t)i;
+    FREE(img);
+    hw = w; hh = h;
+    DBG("dark median=%g, sigma=%g: %u hot pixels above %g", med, sd, nhot, thres);
+    return 0;
+}
+
+/**
+ * Load map of hot pixels (or build it by master dark & cache)
+ * @param dark  - master dark (NULL - no map)
+ * @param sigma - threshold in sigmas
+ * @return 0 if all OK
+ */
+int defects_init(char *dark, double sigma){
+    defects_free();
+    active = 1; // cosmic rays could be searched without map
+    if(!dark) return 0;
+    struct stat st;
+    char cache[PATH_MAX];
+    if(sigma <= 0.) sigma = DEFECTS_HOTSIGMA;
+    if(stat(dark, &st)){
+        WARN("%s", dark);
+        return 1;
+    }
+    snprintf(cache, PATH_MAX, "%s.hotpix", dark);
+    if(read_cache(cache, &st, sigma)){
+        if(build_map(dark, sigma)) return 1;
+        write_cache(cache, sigma);
+    }
+    /// "%u горячих пикселей"
+    green(_("%u hot pixels\n"), nhot);
+    return 0;
+}
+
+void defects_free(){
+    FREE(hot);
+    FREE(winhot);
+    FREE(bitmap);
+    nhot = 0; bitmapsz = 0;
+    hw = hh = 0;
+    active = 0;
+}
+
+int defects_active(){
+    return active;
+}
+
+/**
+ * Get size of hot pixels map
+ * @param w, h - (o) size
+ * @return 1 if there's map
+ */
+int defects_size(int *w, int *h){
+    if(!hot) return 0;
+    if(w) *w = hw;
+    if(h) *h = hh;
+    return 1;
+}
+
+// median of good neighbours of pixel (original value if there's none)
+static uint16_t repair(const uint16_t *data, int w, int h, size_t idx){
+    uint16_t v[8];
+    int n = 0, x = (int)(idx % w), y = (int)(idx / w);
+    for(int dy = -1; dy < 2; ++dy){
+        int yy = y + dy;
+        if(yy < 0 || yy >= h) continue;
+        for(int dx = -1; dx < 2; ++dx){
+            int xx = x + dx;
+            if(xx < 0 || xx >= w || (!dx && !dy)) continue;
+            size_t j = (size_t)yy * w + xx;
+            if(ISBAD(j)) continue;
+            uint16_t p = data[j];
+            int k = n++;
+            for(; k && v[k-1] > p; --k) v[k] = v[k-1];
+            v[k] = p;
+        }
+    }
+    if(!n) return data[idx];
+    return (n & 1) ? v[n/2] : (uint16_t)((v[n/2-1] + v[n/2] + 1) / 2);
+}
+
+typedef struct{
+    const uint16_t *data;
+    int w, h;
+    float bkg, thres;       // background & threshold of Laplacian
+    int nbands, next;       // amount of bands & next band to process
+    pthread_mutex_t mutex;
+    uint32_t *found;        // indexes of cosmic rays
+    size_t nfound, szfound;
+} crjob;
+
+static void *cr_worker(void *arg){
+    crjob *job = (crjob*)arg;
+    const uint16_t *data = job->data;
+    int w = job->w, h = job->h, b;
+    const float bkg = job->bkg, thres = job->thres;
+    uint32_t *loc = MALLOC(uint32_t, 64);
+    size_t nloc = 0, szloc = 64;
+    while((b = __sync_fetch_and_add(&job->next, 1)) < job->nbands){
+        int y0 = b * BAND_ROWS, y1 = y0 + BAND_ROWS;
+        if(y0 < 1) y0 = 1;
+        if(y1 > h - 1) y1 = h - 1;
+        for(int y = y0; y < y1; ++y){
+            const uint16_t *r = data + (size_t)y * w;
+            for(int x = 1; x < w - 1; ++x){
+                float nb = (r[x-1] + r[x+1] + r[x-w] + r[x+w]) * 0.25f, L = r[x] - nb;
+                if(L <= thres || L <= CR_SHARP * (nb - bkg)) continue;
+                if(nloc == szloc){
+                    szloc *= 2;
+                    loc = realloc(loc, szloc * sizeof(uint32_t));
+                    if(!loc) ERR("realloc()");
+                }
+                loc[nloc++] = (uint32_t)((size_t)y * w + x);
+            }
+        }
+    }
+    if(nloc){
+        pthread_mutex_lock(&job->mutex);
+        if(job->nfound + nloc > job->szfound){
+            job->szfound = job->nfound + nloc;
+            job->found = realloc(job->found, job->szfound * sizeof(uint32_t));
+            if(!job->found) ERR("realloc()");
+        }
+        memcpy(job->found + job->nfound, loc, nloc * sizeof(uint32_t));
+        job->nfound += nloc;
+        pthread_mutex_unlock(&job->mutex);
+    }
+    FREE(loc);
+    return NULL;
+}
+
+// find cosmic rays, return their indexes (should be FREE'd)
+static uint32_t *find_cosmic(const uint16_t *data, int w, int h, double crsigma, int nthreads, size_t *n){
+    size_t npix = (size_t)w * h, step = npix / NOISE_SAMPLE + 1, ns = 0;
+    float *sample = MALLOC(float, npix / step + 1);
+    for(size_t i = 0; i < npix; i += step) sample[ns++] = data[i];
+    double bkg, sd;
+    robust(sample, ns, &bkg, &sd);
+    FREE(sample);
+    if(sd < 1.) sd = 1.; // at least 1 ADU of noise
+    // noise of v - mean of 4 neighbours is sqrt(1 + 1/4) of noise of pixel
+    crjob job = {.data = data, .w = w, .h = h, .bkg = (float)bkg,
+        .thres = (float)(crsigma * sd * 1.118), .nbands = (h + BAND_ROWS - 1) / BAND_ROWS};
+    pthread_mutex_init(&job.mutex, NULL);
+    if(nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads > job.nbands) nthreads = job.nbands;
+    pthread_t *workers = MALLOC(pthread_t, nthreads);
+    sigset_t all, old;
+    sigfillset(&all); // signals are processed by main thread only
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int nw = 0;
+    for(; nw < nthreads - 1; ++nw)
+        if(pthread_create(&workers[nw], NULL, cr_worker, &job)) break;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    cr_worker(&job);
+    for(int i = 0; i < nw; ++i) pthread_join(workers[i], NULL);
+    FREE(workers);
+    pthread_mutex_destroy(&job.mutex);
+    *n = job.nfound;
+    return job.found;
+}
+
+static int idxcmp(const void *a, const void *b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// index of first hot pixel not less than idx
+static uint32_t hot_lower(uint64_t idx){
+    uint32_t l = 0, r = nhot;
+    while(l < r){
+        uint32_t m = l + (r - l) / 2;
+        if(hot[m] < idx) l = m + 1;
+        else r = m;
+    }
+    return l;
+}
+
+// hot pixels of window w x h at (x0, y0) of map -> winhot, return their amount
+static uint32_t hot_window(int x0, int y0, int w, int h){
+    if(!winhot) winhot = MALLOC(uint32_t, nhot);
+    uint32_t n = 0, i = hot_lower((uint64_t)y0 * hw), e = hot_lower((uint64_t)(y0 + h) * hw);
+    for(; i < e; ++i){
+        int x = (int)(hot[i] % hw) - x0, y = (int)(hot[i] / hw) - y0;
+        if(x >= 0 && x < w) winhot[n++] = (uint32_t)y * w + x;
+    }
+    return n;
+}
+
+/**
+ * Replace hot pixels & cosmic rays by median of neighbours
+ * @param data     - image (changed in place)
+ * @param x0, y0   - position of image on map (readout window)
+ * @param w, h     - its size (whole map if there's no window)
+ * @param crsigma  - threshold of cosmic rays (<=0 - don't search)
+ * @param nthreads - amount of threads for cosmic rays search (<1 - all CPUs)
+ * @param st       - (o) amount of corrected pixels
+ * @return 0 if all OK
+ */
+int defects_fix(uint16_t *data, int x0, int y0, int w, int h, double crsigma, int nthreads, defects_stat *st){
+    if(!active || !data || w < 3 || h < 3) return 1;
+    if(hot && (x0 < 0 || y0 < 0 || x0 + w > hw || y0 + h > hh)) return 1;
+    size_t ncr = 0, npix = (size_t)w * h;
+    uint32_t *cr = NULL;
+    if(crsigma > 0.) cr = find_cosmic(data, w, h, crsigma, nthreads, &ncr);
+    pthread_mutex_lock(&mutex);
+    if(bitmapsz < (npix + 7) / 8){
+        FREE(bitmap);
+        bitmapsz = (npix + 7) / 8;
+        bitmap = MALLOC(uint8_t, bitmapsz);
+    }
+    const uint32_t *hp = hot; // sorted indexes of hot pixels of image
+    uint32_t nh = nhot;
+    if(nhot && (w != hw || h != hh)){
+        nh = hot_window(x0, y0, w, h);
+        hp = winhot;
+    }
+    for(uint32_t i = 0; i < nh; ++i) SETBAD(hp[i]);
+    for(size_t i = 0; i < ncr; ++i) SETBAD(cr[i]);
+    for(uint32_t i = 0; i < nh; ++i) data[hp[i]] = repair(data, w, h, hp[i]);
+    uint32_t ncosmic = 0;
+    for(size_t i = 0; i < ncr; ++i){
+        if(nh && bsearch(&cr[i], hp, nh, sizeof(uint32_t), idxcmp)) continue; // already repaired
+        data[cr[i]] = repair(data, w, h, cr[i]);
+        ++ncosmic;
+    }
+    // clear only marked bytes: O(defects)
+    for(uint32_t i = 0; i < nh; ++i) bitmap[hp[i] >> 3] = 0;
+    for(size_t i = 0; i < ncr; ++i) bitmap[cr[i] >> 3] = 0;
+    pthread_mutex_unlock(&mutex);
+    FREE(cr);
+    if(st){
+        st->nhot = nh;
+        st->ncosmic = ncosmic;
+    }
+    return 0;
+}
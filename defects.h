@@ -0,0 +1,44 @@
+/*
+ * defects.h - correction of hot pixels & cosmic rays
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __DEFECTS_H__
+#define __DEFECTS_H__
+
+#include <stdint.h>
+
+// default threshold of hot pixels in master dark (in sigmas)
+#define DEFECTS_HOTSIGMA    (5.)
+// default threshold of cosmic rays (in sigmas of Laplacian)
+#define DEFECTS_CRSIGMA     (5.)
+
+// amount of corrected pixels
+typedef struct{
+    uint32_t nhot;      // hot pixels from map
+    uint32_t ncosmic;   // cosmic rays found
+} defects_stat;
+
+int defects_init(char *dark, double sigma);
+void defects_free();
+int defects_active();
+int defects_size(int *w, int *h);
+int defects_fix(uint16_t *data, int x0, int y0, int w, int h, double crsigma, int nthreads, defects_stat *st);
+
+#endif // __DEFECTS_H__
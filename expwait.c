@@ -0,0 +1,142 @@
+/*
+ * expwait.c - waiting for exposure end
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Exposure end is an absolute CLOCK_MONOTONIC deadline of timerfd, telemetry
+ * (temperature etc) is polled by another periodic timerfd, termination signals
+ * come through signalfd: all of them are waited by one epoll_wait(), so readout
+ * starts right after the deadline and Ctrl+C interrupts exposure immediately.
+ * Signal caught by handler before they were blocked is given by flag checked
+ * after blocking, so none of them is lost till the end of exposure.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "expwait.h"
+#include "usefull_macros.h"
+
+static void ts_add(struct timespec *ts, double sec){
+    long ns = (long)((sec - (long)sec) * 1e9);
+    ts->tv_sec += (long)sec;
+    ts->tv_nsec += ns;
+    if(ts->tv_nsec >= 1000000000L){
+        ts->tv_nsec -= 1000000000L;
+        ++ts->tv_sec;
+    }
+}
+
+static double ts_diff(const struct timespec *a, const struct timespec *b){
+    return (double)(a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+static int add_fd(int epfd, int fd){
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * Wait for exposure end
+ * @param start     - exposure start time (CLOCK_MONOTONIC)
+ * @param len       - exposure length (seconds)
+ * @param period    - period of telemetry calls (seconds; <= 0 - no telemetry)
+ * @param telemetry - function for telemetry (called also at start) or NULL
+ * @param arg       - its argument
+ * @param overshoot - (o) delay of wake up after exposure end (microseconds) or NULL
+ * @param caught    - number of signal caught by handler (0 - none) or NULL
+ * @return 0 if exposure ended, number of signal if interrupted or -1 in case of error
+ */
+int expwait(const struct timespec *start, double len, double period,
+            telemetry_handler telemetry, void *arg, double *overshoot,
+            const volatile sig_atomic_t *caught){
+    int ret = -1, epfd = -1, expfd = -1, telfd = -1, sigfd = -1;
+    struct timespec deadline = *start, now;
+    sigset_t sigs, oldmask;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGQUIT);
+    // signals are blocked to be read from signalfd
+    pthread_sigmask(SIG_BLOCK, &sigs, &oldmask);
+    if(caught && *caught){ // came before blocking
+        ret = (int)*caught;
+        goto ret;
+    }
+    ts_add(&deadline, len);
+    struct itimerspec expit = {.it_interval = {0, 0}, .it_value = deadline};
+    if((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+       (expfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0 ||
+       (sigfd = signalfd(-1, &sigs, SFD_CLOEXEC)) < 0 ||
+       timerfd_settime(expfd, TFD_TIMER_ABSTIME, &expit, NULL) ||
+       add_fd(epfd, expfd) || add_fd(epfd, sigfd)){
+        WARN("expwait()");
+        goto ret;
+    }
+    if(telemetry && period > 0.){
+        struct itimerspec telit = {.it_value = {0, 1}}; // first call immediately
+        ts_add(&telit.it_interval, period);
+        if((telfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0 ||
+           timerfd_settime(telfd, 0, &telit, NULL) || add_fd(epfd, telfd)){
+            WARN("expwait()");
+            goto ret;
+        }
+    }
+    while(1){
+        struct epoll_event ev[3];
+        int n = epoll_wait(epfd, ev, 3, -1);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            WARN("epoll_wait()");
+            goto ret;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for(int i = 0; i < n; ++i){
+            int fd = ev[i].data.fd;
+            if(fd == sigfd){
+                struct signalfd_siginfo si;
+                if(read(sigfd, &si, sizeof(si)) == sizeof(si)){
+                    ret = (int)si.ssi_signo;
+                    goto ret;
+                }
+            }else if(fd == expfd){
+                if(overshoot) *overshoot = ts_diff(&now, &deadline) * 1e6;
+                ret = 0;
+                goto ret;
+            }
+        }
+        for(int i = 0; i < n; ++i){ // exposure is still going on
+            if(ev[i].data.fd != telfd) continue;
+            uint64_t ticks;
+            if(read(telfd, &ticks, sizeof(ticks)) == sizeof(ticks))
+                telemetry(ts_diff(&deadline, &now), arg);
+        }
+    }
+ret:
+    if(telfd > -1) close(telfd);
+    if(sigfd > -1) close(sigfd);
+    if(expfd > -1) close(expfd);
+    if(epfd > -1) close(epfd);
+    pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+    return ret;
+}
@@ -0,0 +1,35 @@
+/*
+ * expwait.h - waiting for exposure end
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __EXPWAIT_H__
+#define __EXPWAIT_H__
+
+#include <signal.h>
+#include <time.h>
+
+// function called periodically during exposure; remain - seconds till its end
+typedef void (*telemetry_handler)(double remain, void *arg);
+
+int expwait(const struct timespec *start, double len, double period,
+            telemetry_handler telemetry, void *arg, double *overshoot,
+            const volatile sig_atomic_t *caught);
+
+#endif // __EXPWAIT_H__
@@ -0,0 +1,227 @@
+/*
+ * fitsdirect.c - FITS writer without cfitsio buffers
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Writer of uncompressed FITS files: cfitsio formats only header (in memory
+ * file, with the same keys as writefits() writes), pixels are converted to
+ * FITS representation (big-endian, BZERO=32768) in place, written by one
+ * writev() with header and padding and then converted back. Result is the same
+ * as cfitsio makes, but without copying through its buffers.
+ */
+
+#include <pthread.h>
+#include <sys/uio.h>
+#include "fitsdirect.h"
+#include "timing.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+#define FITS_BLOCK  (2880)
+#define FITS_CARD   (80)
+
+// FITS stores v - 32768 in big-endian order: on little-endian host it is
+// swap(v) ^ 0x0080 and back conversion is swap(v) ^ 0x8000
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define TOFITS      (0x0080)
+#define FROMFITS    (0x8000)
+#else
+#define TOFITS      (0x8000)
+#define FROMFITS    (0x8000)
+#endif
+
+// swap bytes (on little-endian host) & xor by mask
+static void swap_scalar(uint16_t *p, size_t n, uint16_t mask){
+    for(size_t i = 0; i < n; ++i){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        p[i] = (uint16_t)((p[i] << 8) | (p[i] >> 8)) ^ mask;
+#else
+        p[i] ^= mask;
+#endif
+    }
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void swap_avx2(uint16_t *p, size_t n, uint16_t mask){
+    const __m256i shuf = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+                                          1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+    const __m256i sign = _mm256_set1_epi16((short)mask);
+    size_t nv = n / 16;
+    for(; nv; --nv, p += 16){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        v = _mm256_xor_si256(_mm256_shuffle_epi8(v, shuf), sign);
+        _mm256_storeu_si256((__m256i*)p, v);
+    }
+    swap_scalar(p, n % 16, mask);
+}
+
+__attribute__((target("ssse3")))
+static void swap_ssse3(uint16_t *p, size_t n, uint16_t mask){
+    const __m128i shuf = _mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+    const __m128i sign = _mm_set1_epi16((short)mask);
+    size_t nv = n / 8;
+    for(; nv; --nv, p += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        v = _mm_xor_si128(_mm_shuffle_epi8(v, shuf), sign);
+        _mm_storeu_si128((__m128i*)p, v);
+    }
+    swap_scalar(p, n % 8, mask);
+}
+#endif // X86_KERNELS
+
+typedef void (*swap_kernel)(uint16_t *p, size_t n, uint16_t mask);
+static swap_kernel kernel = swap_scalar;
+static const char *kernelname = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(){
+#if defined(X86_KERNELS) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel = swap_avx2; kernelname = "AVX2";
+    }else if(__builtin_cpu_supports("ssse3")){
+        kernel = swap_ssse3; kernelname = "SSSE3";
+    }
+#endif
+}
+
+// name of pixels conversion kernel
+const char *fitsdirect_kernel(){
+    pthread_once(&kernel_once, select_kernel);
+    return kernelname;
+}
+
+static size_t roundup(size_t sz, size_t blk){
+    return (sz + blk - 1) / blk * blk;
+}
+
+// change value of integer key in header made by cfitsio
+static void patch_intkey(char *hdr, int nkeys, const char *key, long val){
+    char buf[32];
+    size_t l = strlen(key);
+    for(int i = 0; i < nkeys; ++i, hdr += FITS_CARD){
+        if(strncmp(hdr, key, l) || hdr[l] != ' ') continue;
+        snprintf(buf, 32, "%20ld", val); // fixed format: columns 11..30
+        memcpy(hdr + 10, buf, 20);
+        return;
+    }
+}
+
+/**
+ * Make FITS header (padded to 2880 bytes) for frame
+ * @param filename - file name (for FILE key)
+ * @param f        - frame
+ * @param len      - (o) header length
+ * @return header (should be FREE'd) or NULL if failed
+ */
+static char *make_header(char *filename, frame *f, size_t *len){
+    // small image: cfitsio shouldn't reserve memory for pixels
+    long naxes[2] = {1, 1};
+    fitsfile *fp;
+    char *cards = NULL, *hdr = NULL;
+    int nkeys = 0, status = 0;
+    fits_create_file(&fp, "mem://", &status);
+    if(status){
+        fits_report_error(stderr, status);
+        return NULL;
+    }
+    if(!fits_write_header(fp, filename, f, naxes))
+        fits_hdr2str(fp, 0, NULL, 0, &cards, &nkeys, &status);
+    if(status) fits_report_error(stderr, status);
+    else if(cards){
+        patch_intkey(cards, nkeys, "NAXIS1", f->w);
+        patch_intkey(cards, nkeys, "NAXIS2", f->h);
+        *len = roundup((size_t)(nkeys + 1) * FITS_CARD, FITS_BLOCK);
+        hdr = MALLOC(char, *len);
+        memcpy(hdr, cards, (size_t)nkeys * FITS_CARD);
+        char *end = hdr + (size_t)nkeys * FITS_CARD;
+        memset(end, ' ', *len - (size_t)nkeys * FITS_CARD);
+        memcpy(end, "END", 3);
+    }
+    status = 0;
+    if(cards) fits_free_memory(cards, &status);
+    status = 0;
+    fits_close_file(fp, &status);
+    return hdr;
+}
+
+// write all buffers (writev could write less than asked)
+static int writeall(int fd, struct iovec *iov, int cnt){
+    while(cnt){
+        ssize_t n = writev(fd, iov, cnt);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return 1;
+        }
+        while(cnt && (size_t)n >= iov->iov_len){
+            n -= iov->iov_len;
+            ++iov; --cnt;
+        }
+        if(cnt){
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Save frame as uncompressed FITS (the same file as writefits() makes)
+ * @param filename - file name ("!" prefix is ignored: file is always rewritten)
+ * @param f        - frame (its data is restored after writing)
+ * @return 0 if all OK
+ */
+int writefits_direct(char *filename, frame *f){
+    static const char zeros[FITS_BLOCK] = {0};
+    size_t hlen, dlen = (size_t)f->w * f->h * sizeof(uint16_t);
+    TIMESTART(th);
+    char *hdr = make_header(filename, f, &hlen);
+    if(!hdr) return -1;
+    TIMEEND(th, f->num, PH_HEADER);
+    TIMESTART(tw);
+    if(*filename == '!') ++filename;
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(fd < 0){
+        WARN("open(%s)", filename);
+        FREE(hdr);
+        return -1;
+    }
+    struct iovec iov[3] = {
+        {.iov_base = hdr, .iov_len = hlen},
+        {.iov_base = f->data, .iov_len = dlen},
+        {.iov_base = (void*)zeros, .iov_len = roundup(dlen, FITS_BLOCK) - dlen}
+    };
+    pthread_once(&kernel_once, select_kernel);
+    kernel(f->data, (size_t)f->w * f->h, TOFITS);
+    int r = writeall(fd, iov, 3);
+    if(r) WARN("writev()");
+    kernel(f->data, (size_t)f->w * f->h, FROMFITS); // convert data back
+    if(close(fd) && !r){
+        WARN("close()");
+        r = 1;
+    }
+    FREE(hdr);
+    TIMEEND(tw, f->num, PH_WRITE);
+    return r ? -1 : 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * fitsseries.c - whole series in one FITS file
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Series of frames is written into one FITS file which stays opened until the
+ * end of series: no name search, file creation and full header for each frame.
+ * MEF: primary HDU has no data and contains keys common for all frames, each
+ * frame is appended as IMAGE extension with its own keys (statistics, time,
+ * temperature, readout window position). Cube: primary HDU is 3-D array with
+ * NAXIS3 equal to amount of frames; per-frame values are collected in memory
+ * and written as binary table "FRAMES" at closing. All functions should be called from one (writing) thread
+ * or after writer stopped.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include "fitsseries.h"
+#ifdef USE_BTA
+#include "bta_print.h"
+#endif
+
+// per-frame values for cube table
+typedef struct{
+    int num;
+    double unixtime;
+    int x0, y0;
+    double exptime;
+    double aexppred, aexplevel;
+    int nstars;
+    float fwhm, hfd;
+    int nhot, ncosmic;
+    double temp0, temp1;
+    int max, min;
+    double avr, std;
+    double med, p01, p99, mad;
+} framerec;
+
+// optional groups of table columns
+#define COLS_ROBUST     (1<<0)  // robust statistics
+#define COLS_AEXP       (1<<1)  // auto exposure levels
+#define COLS_STARS      (1<<2)  // star measurements
+#define COLS_DEFECTS    (1<<3)  // amount of hot & cosmic ray pixels replaced
+
+// column of cube table
+typedef struct{
+    char *ttype, *tform, *tunit;
+    size_t offset;              // offset of value in framerec
+    int group;                  // column is written only if its group present (0 - always)
+} tblcol;
+
+#define COL(name, form, unit, field, grp)  {name, form, unit, offsetof(framerec, field), grp}
+static const tblcol columns[] = {
+    COL("FRAME",    "1J", "",     num,      0),
+    COL("UNIXTIME", "1D", "s",    unixtime, 0),
+    COL("X0",       "1J", "pix",  x0,       0),
+    COL("Y0",       "1J", "pix",  y0,       0),
+    COL("EXPTIME",  "1D", "s",    exptime,  0),
+    COL("AEXPPRED", "1D", "ADU",  aexppred, COLS_AEXP),
+    COL("AEXPLVL",  "1D", "ADU",  aexplevel,COLS_AEXP),
+    COL("NSTARS",   "1J", "",     nstars,   COLS_STARS),
+    COL("FWHM",     "1E", "pix",  fwhm,     COLS_STARS),
+    COL("HFD",      "1E", "pix",  hfd,      COLS_STARS),
+    COL("NHOTPIX",  "1J", "",     nhot,     COLS_DEFECTS),
+    COL("NCOSMIC",  "1J", "",     ncosmic,  COLS_DEFECTS), // 0 if cosmic rays aren't searched
+    COL("TEMP0",    "1D", "degC", temp0,    0),
+    COL("TEMP1",    "1D", "degC", temp1,    0),
+    COL("STATMAX",  "1J", "ADU",  max,      0),
+    COL("STATMIN",  "1J", "ADU",  min,      0),
+    COL("STATAVR",  "1D", "ADU",  avr,      0),
+    COL("STATSTD",  "1D", "ADU",  std,      0),
+    COL("STATMED",  "1D", "ADU",  med,      COLS_ROBUST),
+    COL("STATP01",  "1D", "ADU",  p01,      COLS_ROBUST),
+    COL("STATP99",  "1D", "ADU",  p99,      COLS_ROBUST),
+    COL("STATMAD",  "1D", "ADU",  mad,      COLS_ROBUST),
+};
+#define NCOLUMNS    (sizeof(columns) / sizeof(columns[0]))
+
+static seriesmode smode = SERIES_NONE;
+static fitsfile *fp = NULL;     // opened file
+static char *fname = NULL;      // its name
+static int nplanes = 0;         // cube depth (max amount of frames)
+static int nwritten = 0;        // amount of frames written
+static int colgroups = 0;       // groups of table columns present
+static long fw, fh;             // frame size
+static framerec *recs = NULL;   // values for cube table
+
+/**
+ * Set series mode
+ * @param mode    - "mef" or "cube" (NULL - each frame in its own file)
+ * @param nframes - amount of frames in series
+ * @return 0 if all OK
+ */
+int series_init(const char *mode, int nframes){
+    if(!mode){
+        smode = SERIES_NONE;
+        return 0;
+    }
+    if(strcasecmp(mode, "mef") == 0) smode = SERIES_MEF;
+    else if(strcasecmp(mode, "cube") == 0) smode = SERIES_CUBE;
+    else return 1;
+    nplanes = (nframes > 0) ? nframes : 1;
+    return 0;
+}
+
+// return 1 if series file is opened
+int series_isopen(){
+    return (fp != NULL);
+}
+
+// create file & write primary header
+static int series_open(char *filename, frame *f){
+    fw = f->w; fh = f->h;
+    colgroups = 0;
+    if(f->robust) colgroups |= COLS_ROBUST;
+    if(f->autoexp) colgroups |= COLS_AEXP;
+    if(f->stars) colgroups |= COLS_STARS;
+    if(f->defects) colgroups |= COLS_DEFECTS;
+    nwritten = 0;
+    TRYFITS(fits_create_file, &fp, filename);
+    if(smode == SERIES_MEF){
+        TRYFITS(fits_create_img, fp, USHORT_IMG, 0, NULL);
+        fits_common_keys(fp, filename, f);
+        fits_obs_keys(fp);
+    }else{
+        long naxes[3] = {fw, fh, nplanes};
+        if(fits_setcompression(fp)) return -1;
+        TRYFITS(fits_create_img, fp, USHORT_IMG, 3, naxes);
+        fits_common_keys(fp, filename, f);
+        // keys of first frame: start of series
+        fits_frame_keys(fp, f);
+        fits_obs_keys(fp);
+        #ifdef USE_BTA
+        write_bta_data(fp);
+        #endif
+        FREE(recs);
+        recs = MALLOC(framerec, nplanes);
+    }
+    FREE(fname);
+    fname = strdup((*filename == '!') ? filename + 1 : filename);
+    return 0;
+}
+
+static int write_mef(frame *f){
+    long naxes[2] = {fw, fh};
+    char extname[32];
+    if(fits_setcompression(fp)) return -1;
+    TRYFITS(fits_create_img, fp, USHORT_IMG, 2, naxes);
+    snprintf(extname, 32, "FRAME%04d", f->num);
+    WRITEKEY(fp, TSTRING, "EXTNAME", extname, "Frame number in series");
+    fits_frame_keys(fp, f);
+    #ifdef USE_BTA
+    write_bta_data(fp);
+    #endif
+    TRYFITS(fits_write_img, fp, TUSHORT, 1, fw * fh, f->data);
+    return 0;
+}
+
+static int write_plane(frame *f){
+    if(nwritten >= nplanes){
+        WARNX(_("Data cube is full"));
+        return -1;
+    }
+    long long first = (long long)nwritten * fw * fh + 1;
+    TRYFITS(fits_write_img, fp, TUSHORT, first, fw * fh, f->data);
+    framerec *r = &recs[nwritten];
+    r->num = f->num;
+    r->unixtime = f->expStartsAt.tv_sec + (double)f->expStartsAt.tv_usec/1e6;
+    r->x0 = f->X0; r->y0 = f->Y0;
+    r->exptime = f->exptime;
+    r->aexppred = (f->aexppred > -1.) ? f->aexppred : NAN;
+    r->aexplevel = f->aexplevel;
+    r->nstars = f->nstars; r->fwhm = f->fwhm; r->hfd = f->hfd;
+    r->nhot = (int)f->nhot; r->ncosmic = (int)f->ncosmic;
+    r->temp0 = f->temp0;
+    r->temp1 = (f->temp1 < 100.) ? f->temp1 : NAN;
+    r->max = f->max; r->min = f->min;
+    r->avr = f->avr; r->std = f->std;
+    r->med = f->med; r->p01 = f->p01; r->p99 = f->p99; r->mad = f->mad;
+    return 0;
+}
+
+/**
+ * Add frame to series file
+ * @param filename - name of file to create (used only for first frame)
+ * @param f        - frame to write
+ * @return 0 if all OK
+ */
+int series_write(char *filename, frame *f){
+    if(smode == SERIES_NONE) return -1;
+    if(!fp){
+        if(!filename) return -1;
+        if(series_open(filename, f)){
+            int status = 0;
+            if(fp) fits_close_file(fp, &status);
+            fp = NULL;
+            return -1;
+        }
+    }
+    if(f->w != fw || f->h != fh) return -1;
+    int r = (smode == SERIES_MEF) ? write_mef(f) : write_plane(f);
+    if(!r) ++nwritten;
+    return r;
+}
+
+// write table with per-frame values of cube
+static int write_table(){
+    char *ttype[NCOLUMNS], *tform[NCOLUMNS], *tunit[NCOLUMNS];
+    const tblcol *cols[NCOLUMNS];
+    int ncols = 0;
+    for(size_t c = 0; c < NCOLUMNS; ++c){
+        if(columns[c].group && !(columns[c].group & colgroups)) continue;
+        cols[ncols] = &columns[c];
+        ttype[ncols] = columns[c].ttype; tform[ncols] = columns[c].tform; tunit[ncols] = columns[c].tunit;
+        ++ncols;
+    }
+    TRYFITS(fits_create_tbl, fp, BINARY_TBL, 0, ncols, ttype, tform, tunit, "FRAMES");
+    for(int i = 0; i < nwritten; ++i){
+        char *r = (char*)&recs[i];
+        for(int c = 0; c < ncols; ++c){
+            int type = (tform[c][1] == 'J') ? TINT : (tform[c][1] == 'E') ? TFLOAT : TDOUBLE;
+            TRYFITS(fits_write_col, fp, type, c + 1, i + 1, 1, 1, r + cols[c]->offset);
+        }
+    }
+    return 0;
+}
+
+// finish cube: cut unfilled planes & add table
+static void close_cube(){
+    if(nwritten < nplanes){
+        long naxes[3] = {fw, fh, nwritten};
+        int status = 0;
+        fits_resize_img(fp, USHORT_IMG, 3, naxes, &status);
+        if(status){
+            fits_report_error(stderr, status);
+            WARNX(_("Can't resize data cube, empty planes are filled with zeros"));
+        }
+    }
+    if(write_table())
+        WARNX(_("Can't write table of frame values"));
+}
+
+/**
+ * Close series file (should be called after writer_stop())
+ */
+void series_close(){
+    if(!fp) return;
+    if(smode == SERIES_MEF){
+        int status = 0;
+        fits_movabs_hdu(fp, 1, NULL, &status);
+        fits_update_key(fp, TINT, "NEXTEND", &nwritten, "Number of extensions", &status);
+        if(status) fits_report_error(stderr, status);
+    }else close_cube();
+    int status = 0;
+    fits_close_file(fp, &status);
+    if(status) fits_report_error(stderr, status);
+    fp = NULL;
+    FREE(recs);
+    green(_("%d frames saved in '%s'\n"), nwritten, fname);
+    FREE(fname);
+    nwritten = 0;
+}
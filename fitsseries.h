@@ -0,0 +1,39 @@
+/*
+ * fitsseries.h - whole series in one FITS file
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __FITSSERIES_H__
+#define __FITSSERIES_H__
+
+#include "main.h"
+
+// modes of series writing
+typedef enum{
+    SERIES_NONE,    // each frame in separate file
+    SERIES_MEF,     // each frame is IMAGE extension of one file
+    SERIES_CUBE     // 3-D data cube, per-frame values in binary table
+} seriesmode;
+
+int series_init(const char *mode, int nframes);
+int series_isopen();
+int series_write(char *filename, frame *f);
+void series_close();
+
+#endif // __FITSSERIES_H__
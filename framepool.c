@@ -0,0 +1,156 @@
+/*
+ * framepool.c - preallocated pool of frame buffers
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * All buffers are placed in one anonymous mapping (page- or hugepage-aligned)
+ * which is prefaulted at start, so a series makes no allocations and no page
+ * faults. Each frame has a reference counter: buffer returns to pool when the
+ * last stage releases it. With POOL_FLOAT each buffer also has space for
+ * float copy of image (calibrated frame). Pool has no mutexes (only atomics &
+ * semaphore, waiting time is atomic counter of microseconds as capture threads
+ * of several cameras add to it) except one for frame_getn(): several buffers needed at once are reserved by
+ * one thread at a time, so capture threads can't hold part of them each and
+ * wait for the rest forever.
+ */
+
+#include <semaphore.h>
+#include "framepool.h"
+
+#define HUGEPAGE_SIZE   (2UL*1024UL*1024UL)
+
+static frame *frames = NULL;        // frames descriptors
+static int nframes = 0;             // amount of buffers
+static void *region = NULL;         // mmaped memory for all buffers
+static size_t regionsz = 0;         // its size
+static sem_t nfree;                 // amount of free buffers
+static uint64_t twait = 0;          // total time frame_get() waited for free buffer (us)
+static pthread_mutex_t getnmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t roundup(size_t sz, size_t blk){
+    return (sz + blk - 1) / blk * blk;
+}
+
+/**
+ * Allocate pool of buffers for frames of given size
+ * @param nbufs - amount of buffers
+ * @param w, h  - image size (pixels)
+ * @param flags - POOL_HUGEPAGES, POOL_MLOCK, POOL_FLOAT
+ * @return 0 if all OK
+ */
+int framepool_init(int nbufs, int w, int h, int flags){
+    if(frames || nbufs < 1 || w < 1 || h < 1) return 1;
+    size_t pagesz = (size_t)sysconf(_SC_PAGESIZE);
+    size_t datasz = roundup((size_t)w * h * sizeof(uint16_t), 64);
+    size_t bufsz = datasz + ((flags & POOL_FLOAT) ? (size_t)w * h * sizeof(float) : 0);
+    void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if(flags & POOL_HUGEPAGES){ // reserved huge pages
+        bufsz = roundup(bufsz, HUGEPAGE_SIZE);
+        regionsz = bufsz * nbufs;
+        ptr = mmap(NULL, regionsz, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if(ptr == MAP_FAILED) DBG("no reserved huge pages, try THP");
+    }
+#endif
+    if(ptr == MAP_FAILED){
+        if(!(flags & POOL_HUGEPAGES)) bufsz = roundup(bufsz, pagesz);
+        regionsz = bufsz * nbufs;
+        ptr = mmap(NULL, regionsz, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED){
+            WARN("mmap()");
+            return 1;
+        }
+#ifdef MADV_HUGEPAGE
+        if(flags & POOL_HUGEPAGES) madvise(ptr, regionsz, MADV_HUGEPAGE);
+#endif
+        // prefault all pages: no page faults during series
+        for(size_t i = 0; i < regionsz; i += pagesz) ((volatile char*)ptr)[i] = 0;
+    }
+    if((flags & POOL_MLOCK) && mlock(ptr, regionsz))
+        WARN(_("Can't lock frame buffers in memory"));
+    region = ptr;
+    nframes = nbufs;
+    frames = MALLOC(frame, nframes);
+    for(int i = 0; i < nframes; ++i){
+        frames[i].data = (uint16_t*)((char*)region + i * bufsz);
+        frames[i].cal = (flags & POOL_FLOAT) ? (float*)((char*)frames[i].data + datasz) : NULL;
+        frames[i].w = w; frames[i].h = h;
+        frames[i].refcnt = 0;
+    }
+    sem_init(&nfree, 0, nframes);
+    twait = 0;
+    DBG("pool of %d buffers %zd bytes each", nframes, bufsz);
+    return 0;
+}
+
+void framepool_free(){
+    if(!frames) return;
+    munmap(region, regionsz);
+    region = NULL; regionsz = 0;
+    FREE(frames);
+    nframes = 0;
+    sem_destroy(&nfree);
+}
+
+/**
+ * Get free buffer (with refcnt == 1); blocks while all buffers are busy
+ * @return pointer to frame
+ */
+frame *frame_get(){
+    if(!frames) return NULL;
+    double t0 = dtime();
+    while(sem_wait(&nfree) && errno == EINTR);
+    __atomic_add_fetch(&twait, (uint64_t)((dtime() - t0) * 1e6), __ATOMIC_RELAXED);
+    for(int i = 0; ; i = (i + 1) % nframes){
+        int zero = 0;
+        if(__atomic_compare_exchange_n(&frames[i].refcnt, &zero, 1, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return &frames[i];
+    }
+}
+
+/**
+ * Get several free buffers at once (each with refcnt == 1)
+ * @param f - (o) array of frames
+ * @param n - amount of them
+ */
+void frame_getn(frame **f, int n){
+    pthread_mutex_lock(&getnmutex);
+    for(int i = 0; i < n; ++i) f[i] = frame_get();
+    pthread_mutex_unlock(&getnmutex);
+}
+
+// add one more user of frame
+void frame_ref(frame *f){
+    __atomic_add_fetch(&f->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+// release frame; return buffer to pool when last user released it
+void frame_unref(frame *f){
+    if(__atomic_sub_fetch(&f->refcnt, 1, __ATOMIC_RELEASE) == 0)
+        sem_post(&nfree);
+}
+
+// time (seconds) spent in frame_get() waiting for free buffer
+double framepool_waittime(){
+    return __atomic_load_n(&twait, __ATOMIC_RELAXED) / 1e6;
+}
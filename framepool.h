@@ -0,0 +1,40 @@
+/*
+ * framepool.h - preallocated pool of frame buffers
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __FRAMEPOOL_H__
+#define __FRAMEPOOL_H__
+
+#include "main.h"
+
+// flags for framepool_init()
+#define POOL_HUGEPAGES      (1<<0)  // try to use huge pages
+#define POOL_MLOCK          (1<<1)  // lock buffers in RAM
+#define POOL_FLOAT          (1<<2)  // add float buffer for calibrated image
+
+int framepool_init(int nbufs, int w, int h, int flags);
+void framepool_free();
+frame *frame_get();
+void frame_getn(frame **f, int n);
+void frame_ref(frame *f);
+void frame_unref(frame *f);
+double framepool_waittime();
+
+#endif // __FRAMEPOOL_H__
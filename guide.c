@@ -0,0 +1,287 @@
+/*
+ * guide.c - autoguiding through guide relays of camera
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Guide star is the brightest unsaturated star of full frame (found by
+ * stars_find()) lying not closer than half of box to edges of area, its
+ * centroid is the lock position. Calibration moves mount by pulses EAST, WEST,
+ * NORTH & SOUTH of given length and measures shifts of star, so each axis of
+ * mount gets its vector of speed on sensor (pix/s) - camera could be rotated
+ * and flipped. Each cycle reads subframe box x box around last position of
+ * star by atik_camera_readCCD_delay() and finds its centroid by
+ * stars_centroid(). Error is converted into seconds of pulses of each axis
+ * (inverse of calibration matrix) and goes to PI controller; pulses of both
+ * axes start simultaneously. Latency is time from end of readout till relays
+ * command.
+ */
+
+#include <math.h>
+#include <time.h>
+#include "guide.h"
+#include "stars.h"
+#include "usefull_macros.h"
+
+// min shift of star by calibration pulse (pix)
+#define MINCALSHIFT (2.)
+// shorter pulses are dropped (s)
+#define MINPULSE    (0.002)
+// guiding stops after so many cycles without star
+#define MAXLOST     (10)
+// min size of subframe
+#define MINBOX      (8)
+
+typedef struct{
+    atikcam *cam;
+    const guide_pars *p;
+    int w, h;               // size of area (binned pixels)
+    int bw, bh;             // size of subframe
+    int bx, by;             // its position in area
+    uint16_t *img;          // image buffer
+    double x, y;            // last position of star in area
+    double snr;             // its SNR
+} guider;
+
+static double mono(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// sleep till given time by mono()
+static void sleep_till(double t){
+    double d = t - mono();
+    if(d <= 0.) return;
+    struct timespec ts = {.tv_sec = (time_t)d, .tv_nsec = (long)((d - (time_t)d) * 1e9)};
+    while(nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+// read part of area (binned pixels) into g->img
+static int read_area(guider *g, int x0, int y0, int w, int h){
+    const guide_pars *p = g->p;
+    if(!atik_camera_readCCD_delay(g->cam, p->X0 + x0 * p->hbin, p->Y0 + y0 * p->vbin,
+            w * p->hbin, h * p->vbin, p->hbin, p->vbin, p->exptime)) return 1;
+    if(!atik_camera_getImage(g->cam, g->img, w * h)) return 1;
+    return 0;
+}
+
+// read subframe around last position of star & find its new position
+static int measure(guider *g){
+    int bx = (int)floor(g->x - g->bw / 2. + 0.5), by = (int)floor(g->y - g->bh / 2. + 0.5);
+    if(bx < 0) bx = 0;
+    if(by < 0) by = 0;
+    if(bx > g->w - g->bw) bx = g->w - g->bw;
+    if(by > g->h - g->bh) by = g->h - g->bh;
+    g->bx = bx; g->by = by;
+    if(read_area(g, bx, by, g->bw, g->bh)){
+        /// "Не могу считать кадр"
+        WARNX(_("Can't read frame"));
+        return -1;
+    }
+    double x, y;
+    if(stars_centroid(g->img, g->bw, g->bh, &x, &y, &g->snr)) return 1;
+    g->x = bx + x; g->y = by + y;
+    return 0;
+}
+
+// move mount by pulse & measure shift of star
+static int cal_move(guider *g, unsigned short mask, double *dx, double *dy){
+    double x0 = g->x, y0 = g->y, t = mono();
+    if(!atik_camera_setGuideRelays(g->cam, mask)) return 1;
+    sleep_till(t + g->p->calpulse);
+    atik_camera_setGuideRelays(g->cam, 0);
+    if(measure(g)) return 1;
+    *dx = g->x - x0; *dy = g->y - y0;
+    return 0;
+}
+
+/**
+ * Calibration: speed of star on sensor by positive pulses of each axis
+ * @param ra, dec - (o) vectors (pix/s) of pulses EAST & NORTH
+ * @return 0 if all OK
+ */
+static int calibrate(guider *g, double ra[2], double dec[2]){
+    double e[2], w[2], n[2], s[2], t = g->p->calpulse;
+    if(measure(g) || cal_move(g, GUIDE_EAST, &e[0], &e[1]) || cal_move(g, GUIDE_WEST, &w[0], &w[1]) ||
+       cal_move(g, GUIDE_NORTH, &n[0], &n[1]) || cal_move(g, GUIDE_SOUTH, &s[0], &s[1])){
+        /// "Звезда потеряна во время калибровки"
+        WARNX(_("Star lost while calibration"));
+        return 1;
+    }
+    // opposite pulses compensate drift
+    for(int i = 0; i < 2; ++i){
+        ra[i] = (e[i] - w[i]) / (2. * t);
+        dec[i] = (n[i] - s[i]) / (2. * t);
+    }
+    double lra = hypot(ra[0], ra[1]), ldec = hypot(dec[0], dec[1]);
+    /// "Калибровка: RA %.2f пикс/с (угол %.1f град), DEC %.2f пикс/с (угол %.1f град)\n"
+    printf(_("Calibration: RA %.2f pix/s (angle %.1f degr), DEC %.2f pix/s (angle %.1f degr)\n"),
+           lra, atan2(ra[1], ra[0]) * 180. / M_PI, ldec, atan2(dec[1], dec[0]) * 180. / M_PI);
+    if(lra * t < MINCALSHIFT || ldec * t < MINCALSHIFT){
+        /// "Звезда почти не сдвигается импульсами, увеличьте их длительность"
+        WARNX(_("Calibration pulses move star too little, make them longer"));
+        return 1;
+    }
+    if(fabs(ra[0] * dec[1] - ra[1] * dec[0]) < 0.1 * lra * ldec){
+        /// "Направления осей совпадают"
+        WARNX(_("Directions of axes are the same"));
+        return 1;
+    }
+    return 0;
+}
+
+// find guide star on full area
+static int acquire(guider *g){
+    const guide_pars *p = g->p;
+    stars_stat st;
+    star *list = NULL;
+    if(read_area(g, 0, 0, g->w, g->h)){
+        /// "Не могу считать кадр"
+        WARNX(_("Can't read frame"));
+        return 1;
+    }
+    if(stars_find(g->img, g->w, g->h, p->sigma, p->nthreads, &st, &list)) return 1;
+    int found = -1;
+    for(int i = 0; i < st.nstars && found < 0; ++i){ // sorted by flux
+        star *s = &list[i];
+        if(s->saturated || s->x < g->bw / 2. || s->y < g->bh / 2. ||
+           s->x > g->w - g->bw / 2. || s->y > g->h - g->bh / 2.) continue;
+        found = i;
+    }
+    if(found < 0){
+        FREE(list);
+        /// "Не найдено подходящей звезды для гидирования"
+        WARNX(_("No suitable guide star"));
+        return 1;
+    }
+    star *s = &list[found];
+    g->x = s->x; g->y = s->y;
+    /// "Опорная звезда: x=%.2f, y=%.2f, поток=%.0f, FWHM=%.1f (найдено звёзд: %d)\n"
+    printf(_("Guide star: x=%.2f, y=%.2f, flux=%.0f, FWHM=%.1f (%d stars found)\n"),
+           s->x, s->y, s->flux, s->fwhm, st.nstars);
+    FREE(list);
+    return 0;
+}
+
+/**
+ * Guide: acquire star, calibrate & run control loop
+ * @param cam - camera
+ * @param p   - parameters
+ * @return 0 if all OK
+ */
+int guide_run(atikcam *cam, const guide_pars *p){
+    AtikCapabilities *cap = atik_camera_getCapabilities(cam);
+    guider g = {.cam = cam, .p = p};
+    int ret = 1;
+    if(!cap->hasGuidePort){
+        /// "У камеры нет порта гидирования"
+        WARNX(_("Camera has no guide port"));
+        return 1;
+    }
+    if(p->exptime > cap->maxShortExposure){
+        /// "Экспозиция гидирования должна быть не больше %gс"
+        WARNX(_("Guiding exposure should be not longer than %gs"), cap->maxShortExposure);
+        return 1;
+    }
+    g.w = (p->X1 - p->X0) / p->hbin; g.h = (p->Y1 - p->Y0) / p->vbin;
+    g.bw = (p->box < g.w) ? p->box : g.w;
+    g.bh = (p->box < g.h) ? p->box : g.h;
+    if(g.bw < MINBOX || g.bh < MINBOX){
+        /// "Слишком маленькая область гидирования"
+        WARNX(_("Guiding area is too small"));
+        return 1;
+    }
+    g.img = MALLOC(uint16_t, (size_t)g.w * g.h);
+    if(acquire(&g)) goto done;
+    double tx = g.x, ty = g.y, ra[2], dec[2];
+    if(calibrate(&g, ra, dec)) goto done;
+    // pulses (s) of axes giving shift (dx, dy): inverse of [ra dec]
+    double det = ra[0] * dec[1] - ra[1] * dec[0];
+    double inv[2][2] = {{dec[1] / det, -dec[0] / det}, {-ra[1] / det, ra[0] / det}};
+    double Ira = 0., Idec = 0., Ilim = (p->ki > 0.) ? p->maxpulse / p->ki : 0.;
+    double sx2 = 0., sy2 = 0., sumlat = 0., maxlat = 0., tstart = mono();
+    int nlost = 0, ngood = 0;
+    if(p->log) fprintf(p->log, "cycle,time,x,y,dx,dy,snr,ra_ms,dec_ms,readout_ms,latency_ms\n");
+    ret = 0;
+    for(int i = 0; !p->ncycles || i < p->ncycles; ++i){
+        if(p->stop && *p->stop) break;
+        double t0 = mono();
+        int r = measure(&g);
+        double t1 = mono();
+        if(r < 0){ ret = 1; break; }
+        if(r){
+            /// "Звезда потеряна"
+            WARNX(_("Star lost"));
+            if(++nlost == MAXLOST){ ret = 1; break; }
+            continue;
+        }
+        nlost = 0;
+        double dx = g.x - tx, dy = g.y - ty;
+        double a = inv[0][0] * dx + inv[0][1] * dy, d = inv[1][0] * dx + inv[1][1] * dy;
+        Ira += a; Idec += d;
+        if(Ilim > 0.){ // anti-windup
+            if(Ira > Ilim) Ira = Ilim; else if(Ira < -Ilim) Ira = -Ilim;
+            if(Idec > Ilim) Idec = Ilim; else if(Idec < -Ilim) Idec = -Ilim;
+        }
+        double pra = -(p->kp * a + p->ki * Ira), pdec = -(p->kp * d + p->ki * Idec);
+        if(pra > p->maxpulse) pra = p->maxpulse; else if(pra < -p->maxpulse) pra = -p->maxpulse;
+        if(pdec > p->maxpulse) pdec = p->maxpulse; else if(pdec < -p->maxpulse) pdec = -p->maxpulse;
+        if(fabs(pra) < MINPULSE) pra = 0.;
+        if(fabs(pdec) < MINPULSE) pdec = 0.;
+        unsigned short mask = (pra > 0. ? GUIDE_EAST : pra < 0. ? GUIDE_WEST : 0) |
+                              (pdec > 0. ? GUIDE_NORTH : pdec < 0. ? GUIDE_SOUTH : 0);
+        double t2 = mono();
+        if(mask) atik_camera_setGuideRelays(cam, mask);
+        double lat = (t2 - t1) * 1e3;
+        sumlat += lat;
+        if(lat > maxlat) maxlat = lat;
+        sx2 += dx * dx; sy2 += dy * dy;
+        ++ngood;
+        /// "Цикл %d: dx=%+.2f, dy=%+.2f, SNR=%.0f, RA %+.0f мс, DEC %+.0f мс, задержка %.3f мс\n"
+        printf(_("Cycle %d: dx=%+.2f, dy=%+.2f, SNR=%.0f, RA %+.0f ms, DEC %+.0f ms, latency %.3f ms\n"),
+               i, dx, dy, g.snr, pra * 1e3, pdec * 1e3, lat);
+        fflush(stdout);
+        if(p->log) fprintf(p->log, "%d,%.4f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f,%.2f,%.3f\n", i, t0 - tstart,
+                           g.x, g.y, dx, dy, g.snr, pra * 1e3, pdec * 1e3, (t1 - t0) * 1e3, lat);
+        if(!mask) continue;
+        // shorter pulse ends first
+        double tra = t2 + fabs(pra), tdec = t2 + fabs(pdec);
+        if(pra && pdec){
+            if(tra < tdec){
+                sleep_till(tra);
+                atik_camera_setGuideRelays(cam, mask & GUIDE_CLEAR_WE);
+            }else{
+                sleep_till(tdec);
+                atik_camera_setGuideRelays(cam, mask & GUIDE_CLEAR_NS);
+            }
+        }
+        sleep_till(tra > tdec ? tra : tdec);
+        atik_camera_setGuideRelays(cam, 0);
+    }
+    if(ngood){
+        /// "Гидирование: %d циклов, СКО ошибки %.2f пикс (X %.2f, Y %.2f), задержка средняя %.2f мс, макс. %.2f мс\n"
+        printf(_("Guiding: %d cycles, RMS error %.2f pix (X %.2f, Y %.2f), latency mean %.2f ms, max %.2f ms\n"),
+               ngood, sqrt((sx2 + sy2) / ngood), sqrt(sx2 / ngood), sqrt(sy2 / ngood), sumlat / ngood, maxlat);
+    }
+done:
+    atik_camera_setGuideRelays(cam, 0);
+    FREE(g.img);
+    return ret;
+}
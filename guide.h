@@ -0,0 +1,56 @@
+/*
+ * guide.h - autoguiding through guide relays of camera
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __GUIDE_H__
+#define __GUIDE_H__
+
+#include <signal.h>
+#include <stdio.h>
+#include "atikcore.h"
+
+// default size of guiding subframe (binned pixels)
+#define GUIDE_BOX       (32)
+// default gains of PI controller
+#define GUIDE_KP        (0.7)
+#define GUIDE_KI        (0.1)
+// default length of calibration pulses (s)
+#define GUIDE_CALPULSE  (2.)
+// default max length of correction pulse (s)
+#define GUIDE_MAXPULSE  (1.)
+
+typedef struct{
+    int X0, Y0, X1, Y1;     // part of sensor where guide star could be
+    int hbin, vbin;         // binning
+    double exptime;         // exposure of one cycle (s)
+    int box;                // size of subframe around star (binned pixels)
+    double kp, ki;          // gains of PI controller
+    double calpulse;        // length of calibration pulses (s)
+    double maxpulse;        // max length of correction pulse (s)
+    double sigma;           // threshold of guide star detection (sigmas)
+    int ncycles;            // amount of guiding cycles (0 - infinite)
+    int nthreads;           // threads for star search on full frame
+    FILE *log;              // CSV log of cycles (or NULL)
+    volatile sig_atomic_t *stop; // guiding stops when it isn't zero (or NULL)
+} guide_pars;
+
+int guide_run(atikcam *cam, const guide_pars *p);
+
+#endif // __GUIDE_H__
@@ -0,0 +1,450 @@
+/*
+ * imstat.c - image statistics
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Single pass calculation of sum, sum of squares, min, max and amount of
+ * overloaded pixels with integer accumulators (so result is exact and doesn't
+ * depend on order of summation). Kernel (AVX2, SSE4.1 or plain C) is selected
+ * at runtime by CPUID.
+ * When histogram is needed, the pass only fills it (each thread has its own
+ * copy) and all other values are calculated from histogram; it also gives
+ * exact median, percentiles and MAD without sorting.
+ * Large images are split into row stripes processed by persistent thread pool,
+ * partial results are reduced in order of stripes.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include "imstat.h"
+#include "usefull_macros.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+// amount of vector iterations before flushing of 32-bit sums & 16-bit counters
+#define BLKSZ   (16384)
+
+static void stat_scalar(const uint16_t *p, size_t n, imstat_acc *a){
+    uint64_t sum = 0, sum2 = 0, novr = 0;
+    uint16_t max = a->max, min = a->min;
+    for(size_t i = 0; i < n; ++i){
+        uint32_t v = p[i];
+        sum += v;
+        sum2 += v * v;
+        if(max < v) max = v;
+        if(min > v) min = v;
+        if(v >= IMSTAT_OVERLOAD) ++novr;
+    }
+    a->sum += sum; a->sum2 += sum2; a->Noverld += novr;
+    a->max = max; a->min = min;
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void stat_avx2(const uint16_t *p, size_t n, imstat_acc *a){
+    const __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi16(1);
+    const __m256i thr = _mm256_set1_epi16((short)IMSTAT_OVERLOAD);
+    __m256i vmax = _mm256_set1_epi16((short)a->max), vmin = _mm256_set1_epi16((short)a->min);
+    __m256i vsq = zero;
+    size_t nv = n / 16;
+    uint64_t sum = 0, novr = 0;
+    while(nv){
+        size_t blk = (nv < BLKSZ) ? nv : BLKSZ;
+        nv -= blk;
+        __m256i vsum = zero, vovr = zero;
+        for(; blk; --blk, p += 16){
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            vmax = _mm256_max_epu16(vmax, v);
+            vmin = _mm256_min_epu16(vmin, v);
+            vovr = _mm256_sub_epi16(vovr, _mm256_cmpeq_epi16(_mm256_max_epu16(v, thr), v));
+            __m256i lo = _mm256_unpacklo_epi16(v, zero), hi = _mm256_unpackhi_epi16(v, zero);
+            vsum = _mm256_add_epi32(vsum, _mm256_add_epi32(lo, hi));
+            vsq = _mm256_add_epi64(vsq, _mm256_mul_epu32(lo, lo));
+            vsq = _mm256_add_epi64(vsq, _mm256_mul_epu32(hi, hi));
+            lo = _mm256_srli_epi64(lo, 32); hi = _mm256_srli_epi64(hi, 32);
+            vsq = _mm256_add_epi64(vsq, _mm256_mul_epu32(lo, lo));
+            vsq = _mm256_add_epi64(vsq, _mm256_mul_epu32(hi, hi));
+        }
+        uint32_t s[8]; int32_t o[8];
+        _mm256_storeu_si256((__m256i*)s, vsum);
+        _mm256_storeu_si256((__m256i*)o, _mm256_madd_epi16(vovr, ones));
+        for(int i = 0; i < 8; ++i){ sum += s[i]; novr += o[i]; }
+    }
+    uint64_t q[4]; uint16_t mx[16], mn[16];
+    _mm256_storeu_si256((__m256i*)q, vsq);
+    _mm256_storeu_si256((__m256i*)mx, vmax);
+    _mm256_storeu_si256((__m256i*)mn, vmin);
+    a->sum += sum; a->Noverld += novr;
+    a->sum2 += q[0] + q[1] + q[2] + q[3];
+    for(int i = 0; i < 16; ++i){
+        if(a->max < mx[i]) a->max = mx[i];
+        if(a->min > mn[i]) a->min = mn[i];
+    }
+    stat_scalar(p, n % 16, a);
+}
+
+__attribute__((target("sse4.1")))
+static void stat_sse41(const uint16_t *p, size_t n, imstat_acc *a){
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi16(1);
+    const __m128i thr = _mm_set1_epi16((short)IMSTAT_OVERLOAD);
+    __m128i vmax = _mm_set1_epi16((short)a->max), vmin = _mm_set1_epi16((short)a->min);
+    __m128i vsq = zero;
+    size_t nv = n / 8;
+    uint64_t sum = 0, novr = 0;
+    while(nv){
+        size_t blk = (nv < BLKSZ) ? nv : BLKSZ;
+        nv -= blk;
+        __m128i vsum = zero, vovr = zero;
+        for(; blk; --blk, p += 8){
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            vmax = _mm_max_epu16(vmax, v);
+            vmin = _mm_min_epu16(vmin, v);
+            vovr = _mm_sub_epi16(vovr, _mm_cmpeq_epi16(_mm_max_epu16(v, thr), v));
+            __m128i lo = _mm_unpacklo_epi16(v, zero), hi = _mm_unpackhi_epi16(v, zero);
+            vsum = _mm_add_epi32(vsum, _mm_add_epi32(lo, hi));
+            vsq = _mm_add_epi64(vsq, _mm_mul_epu32(lo, lo));
+            vsq = _mm_add_epi64(vsq, _mm_mul_epu32(hi, hi));
+            lo = _mm_srli_epi64(lo, 32); hi = _mm_srli_epi64(hi, 32);
+            vsq = _mm_add_epi64(vsq, _mm_mul_epu32(lo, lo));
+            vsq = _mm_add_epi64(vsq, _mm_mul_epu32(hi, hi));
+        }
+        uint32_t s[4]; int32_t o[4];
+        _mm_storeu_si128((__m128i*)s, vsum);
+        _mm_storeu_si128((__m128i*)o, _mm_madd_epi16(vovr, ones));
+        for(int i = 0; i < 4; ++i){ sum += s[i]; novr += o[i]; }
+    }
+    uint64_t q[2]; uint16_t mx[8], mn[8];
+    _mm_storeu_si128((__m128i*)q, vsq);
+    _mm_storeu_si128((__m128i*)mx, vmax);
+    _mm_storeu_si128((__m128i*)mn, vmin);
+    a->sum += sum; a->Noverld += novr;
+    a->sum2 += q[0] + q[1];
+    for(int i = 0; i < 8; ++i){
+        if(a->max < mx[i]) a->max = mx[i];
+        if(a->min > mn[i]) a->min = mn[i];
+    }
+    stat_scalar(p, n % 8, a);
+}
+#endif // X86_KERNELS
+
+static void hist_kernel(const uint16_t *p, size_t n, uint32_t *hist){
+    size_t i;
+    for(i = 0; i + 4 <= n; i += 4){
+        ++hist[p[i]]; ++hist[p[i+1]]; ++hist[p[i+2]]; ++hist[p[i+3]];
+    }
+    for(; i < n; ++i) ++hist[p[i]];
+}
+
+// calculate all accumulators by histogram
+static void hist2acc(const uint32_t *hist, imstat_acc *a){
+    uint64_t sum = 0, sum2 = 0, novr = 0;
+    int min = -1, max = 0;
+    for(uint32_t v = 0; v < IMSTAT_NBINS; ++v){
+        uint64_t h = hist[v];
+        if(!h) continue;
+        if(min < 0) min = v;
+        max = v;
+        sum += h * v;
+        sum2 += h * v * v;
+        if(v >= IMSTAT_OVERLOAD) novr += h;
+    }
+    a->sum = sum; a->sum2 = sum2; a->Noverld = novr;
+    a->max = max; a->min = (min < 0) ? 65535 : min;
+}
+
+typedef void (*stat_kernel)(const uint16_t *p, size_t n, imstat_acc *a);
+static stat_kernel kernel = NULL;
+static const char *kernelname = NULL;
+
+static void select_kernel(){
+    kernel = stat_scalar; kernelname = "scalar";
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel = stat_avx2; kernelname = "AVX2";
+    }else if(__builtin_cpu_supports("sse4.1")){
+        kernel = stat_sse41; kernelname = "SSE4.1";
+    }
+#endif
+}
+
+// don't split images less than this (pixels) between threads
+#define MINPARALLEL     (1<<18)
+
+// part of image for one thread
+typedef struct{
+    const uint16_t *img;
+    size_t size;
+    uint32_t *hist;         // histogram or NULL
+    uint32_t *privhist;     // own histogram of worker
+    imstat_acc acc;
+} __attribute__((aligned(64))) stripe;
+
+static int nthreads = 1;            // amount of threads (including caller)
+static pthread_t *workers = NULL;   // nthreads-1 workers
+static stripe *stripes = NULL;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startcond = PTHREAD_COND_INITIALIZER, donecond = PTHREAD_COND_INITIALIZER;
+static unsigned long generation = 0; // incremented on each new task
+static unsigned long startgen = 0;  // generation at the moment of workers start
+static int ndone = 0;               // amount of workers finished current task
+static int stopping = 0;
+static pthread_mutex_t calcmutex = PTHREAD_MUTEX_INITIALIZER; // pool is busy
+
+static void calc_stripe(stripe *s){
+    if(s->hist){
+        memset(s->hist, 0, IMSTAT_NBINS * sizeof(uint32_t));
+        hist_kernel(s->img, s->size, s->hist);
+        return;
+    }
+    s->acc.sum = s->acc.sum2 = s->acc.Noverld = 0;
+    s->acc.max = 0; s->acc.min = 65535;
+    kernel(s->img, s->size, &s->acc);
+}
+
+static void *worker(void *arg){
+    stripe *s = (stripe*)arg;
+    unsigned long gen = startgen;
+    pthread_mutex_lock(&mutex);
+    while(1){
+        while(generation == gen) pthread_cond_wait(&startcond, &mutex);
+        gen = generation;
+        if(stopping) break;
+        pthread_mutex_unlock(&mutex);
+        calc_stripe(s);
+        pthread_mutex_lock(&mutex);
+        if(++ndone == nthreads - 1) pthread_cond_signal(&donecond);
+    }
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+static void stop_workers(){
+    if(!workers) return;
+    pthread_mutex_lock(&mutex);
+    stopping = 1;
+    ++generation;
+    pthread_cond_broadcast(&startcond);
+    pthread_mutex_unlock(&mutex);
+    for(int i = 0; i < nthreads - 1; ++i) pthread_join(workers[i], NULL);
+    FREE(workers);
+    for(int i = 0; i < nthreads; ++i) FREE(stripes[i].privhist);
+    free(stripes); stripes = NULL;
+    stopping = 0;
+    nthreads = 1;
+}
+
+/**
+ * Set amount of threads for statistics calculation
+ * @param n - amount of threads (1 - calculate in caller thread only)
+ * @return amount of threads really run
+ */
+int imstat_threads(int n){
+    if(!kernel) select_kernel();
+    stop_workers();
+    if(n < 2) return 1;
+    if(posix_memalign((void**)&stripes, 64, n * sizeof(stripe))){
+        WARN("posix_memalign()");
+        return 1;
+    }
+    memset(stripes, 0, n * sizeof(stripe));
+    for(int i = 1; i < n; ++i) stripes[i].privhist = MALLOC(uint32_t, IMSTAT_NBINS);
+    workers = MALLOC(pthread_t, n - 1);
+    startgen = generation;
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for(nthreads = 1; nthreads < n; ++nthreads){
+        if(pthread_create(&workers[nthreads-1], NULL, worker, &stripes[nthreads])) break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if(nthreads < n) WARNX(_("Only %d threads for statistics started"), nthreads);
+    DBG("%d statistics threads", nthreads);
+    return nthreads;
+}
+
+/**
+ * Calculate statistics of image
+ * @param img  - image data
+ * @param w, h - image width & height
+ * @param acc  (o) - accumulators
+ * @param hist (o) - histogram (IMSTAT_NBINS values) or NULL if not needed
+ */
+void imstat_calc(const uint16_t *img, int w, int h, imstat_acc *acc, uint32_t *hist){
+    size_t size = (size_t)w * h;
+    if(!kernel) select_kernel();
+    if(nthreads < 2 || size < MINPARALLEL || h < nthreads || pthread_mutex_trylock(&calcmutex)){
+        stripe s = {.img = img, .size = size, .hist = hist};
+        calc_stripe(&s);
+        if(hist) hist2acc(hist, acc);
+        else *acc = s.acc;
+        return;
+    }
+    // split by rows
+    int y0 = 0;
+    for(int i = 0; i < nthreads; ++i){
+        int y1 = (int)((long)h * (i + 1) / nthreads);
+        stripes[i].img = img + (size_t)y0 * w;
+        stripes[i].size = (size_t)(y1 - y0) * w;
+        if(hist) stripes[i].hist = i ? stripes[i].privhist : hist;
+        else stripes[i].hist = NULL;
+        y0 = y1;
+    }
+    pthread_mutex_lock(&mutex);
+    ndone = 0;
+    ++generation;
+    pthread_cond_broadcast(&startcond);
+    pthread_mutex_unlock(&mutex);
+    calc_stripe(&stripes[0]);
+    pthread_mutex_lock(&mutex);
+    while(ndone < nthreads - 1) pthread_cond_wait(&donecond, &mutex);
+    pthread_mutex_unlock(&mutex);
+    // reduce in order of stripes
+    if(hist){
+        for(int i = 1; i < nthreads; ++i){
+            uint32_t *h = stripes[i].hist;
+            for(int v = 0; v < IMSTAT_NBINS; ++v) hist[v] += h[v];
+        }
+        pthread_mutex_unlock(&calcmutex);
+        hist2acc(hist, acc);
+        return;
+    }
+    *acc = stripes[0].acc;
+    for(int i = 1; i < nthreads; ++i){
+        imstat_acc *a = &stripes[i].acc;
+        acc->sum += a->sum; acc->sum2 += a->sum2; acc->Noverld += a->Noverld;
+        if(acc->max < a->max) acc->max = a->max;
+        if(acc->min > a->min) acc->min = a->min;
+    }
+    pthread_mutex_unlock(&calcmutex);
+}
+
+// value of pixel with given rank (0 - minimal) by histogram
+static int hist_rank(const uint32_t *hist, uint64_t rank){
+    uint64_t cum = 0;
+    for(int v = 0; v < IMSTAT_NBINS; ++v){
+        cum += hist[v];
+        if(cum > rank) return v;
+    }
+    return IMSTAT_NBINS - 1;
+}
+
+// percentile (linear interpolation between closest ranks)
+static double hist_percentile(const uint32_t *hist, uint64_t N, double p){
+    double r = p * (double)(N - 1);
+    uint64_t k = (uint64_t)r;
+    double frac = r - (double)k, v = hist_rank(hist, k);
+    if(frac > 0. && k + 1 < N) v += frac * (hist_rank(hist, k + 1) - v);
+    return v;
+}
+
+/*
+ * doubled deviation |2v - m2| with given rank (0 - minimal); m2 - doubled median
+ * walks from median to both sides merging sequences of deviations
+ */
+static uint32_t dev_rank(const uint32_t *hist, int m2, uint64_t rank){
+    int up = (m2 + 1) / 2, down = up - 1; // 2*up >= m2, 2*down < m2
+    uint64_t cum = 0;
+    while(up < IMSTAT_NBINS || down >= 0){
+        uint32_t dup = (up < IMSTAT_NBINS) ? (uint32_t)(2*up - m2) : UINT32_MAX;
+        uint32_t ddn = (down >= 0) ? (uint32_t)(m2 - 2*down) : UINT32_MAX;
+        uint32_t d;
+        if(dup <= ddn){
+            d = dup; cum += hist[up++];
+        }else{
+            d = ddn; cum += hist[down--];
+        }
+        if(cum > rank) return d;
+    }
+    return 0;
+}
+
+/**
+ * Calculate robust statistics by histogram
+ * @param hist - histogram (IMSTAT_NBINS values)
+ * @param N    - total amount of pixels
+ * @param r (o) - median, 1st & 99th percentiles, median absolute deviation
+ */
+void imstat_robust(const uint32_t *hist, uint64_t N, imstat_robustval *r){
+    if(N == 0){
+        r->median = r->p01 = r->p99 = r->mad = 0.;
+        return;
+    }
+    uint64_t k1 = (N - 1) / 2, k2 = N / 2; // middle ranks
+    int m2 = hist_rank(hist, k1) + hist_rank(hist, k2);
+    r->median = m2 / 2.;
+    r->p01 = hist_percentile(hist, N, 0.01);
+    r->p99 = hist_percentile(hist, N, 0.99);
+    r->mad = (dev_rank(hist, m2, k1) + dev_rank(hist, m2, k2)) / 4.;
+}
+
+// name of statistics kernel used on this CPU
+const char *imstat_kernel(){
+    if(!kernel) select_kernel();
+    return kernelname;
+}
+
+/**
+ * Show speed of statistics calculation for different amount of threads
+ * on synthetic 16 and 50 megapixel frames
+ * @param maxthreads - max amount of threads
+ * @param withhist   - calculate histogram (and robust statistics)
+ */
+void imstat_bench(int maxthreads, int withhist){
+    const int sizes[][2] = {{4896, 3264}, {8176, 6132}};
+    uint32_t *hist = NULL;
+    if(maxthreads < 1) maxthreads = 1;
+    if(withhist){
+        hist = MALLOC(uint32_t, IMSTAT_NBINS);
+        green(_("Statistics with histogram\n"));
+    }else green(_("Statistics kernel: %s\n"), imstat_kernel());
+    for(int s = 0; s < 2; ++s){
+        int w = sizes[s][0], h = sizes[s][1];
+        size_t size = (size_t)w * h;
+        uint16_t *img = MALLOC(uint16_t, size);
+        uint32_t seed = 1;
+        for(size_t i = 0; i < size; ++i){ // bias + noise
+            seed = seed * 1103515245 + 12345;
+            img[i] = 1000 + ((seed >> 16) & 0x3ff);
+        }
+        printf(_("Frame %dx%d (%.1f Mpix):\n"), w, h, size / 1e6);
+        double t1 = 0.;
+        for(int n = 1; n <= maxthreads; ++n){
+            imstat_acc acc;
+            imstat_threads(n);
+            imstat_calc(img, w, h, &acc, hist); // warm up
+            int N = 0;
+            double t0 = dtime(), t;
+            do{
+                imstat_calc(img, w, h, &acc, hist);
+                ++N;
+            }while((t = dtime() - t0) < 0.5);
+            t /= N;
+            if(n == 1) t1 = t;
+            printf(_("\t%d thread(s): %.2fms per frame, speedup %.2f\n"), n, t*1e3, t1/t);
+        }
+        FREE(img);
+    }
+    FREE(hist);
+    imstat_threads(1);
+}
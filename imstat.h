@@ -0,0 +1,81 @@
+/*
+ * imstat.h - image statistics
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __IMSTAT_H__
+#define __IMSTAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// pixels with value not less than this are overloaded
+#define IMSTAT_OVERLOAD     (65530)
+// amount of histogram bins
+#define IMSTAT_NBINS        (65536)
+
+// raw (integer) accumulators of one pass through image
+typedef struct{
+    uint64_t sum;       // sum of pixel values
+    uint64_t sum2;      // sum of their squares
+    uint64_t Noverld;   // amount of overloaded pixels
+    uint16_t max, min;  // max/min values
+} imstat_acc;
+
+// robust statistics by histogram
+typedef struct{
+    double median;      // median value
+    double p01, p99;    // 1st & 99th percentiles
+    double mad;         // median absolute deviation
+} imstat_robustval;
+
+/*
+ * k-th smallest of n values (Wirth's algorithm); array is reordered so that
+ * all values before k-th are not greater than it. Inline: it is called per
+ * bin of software binning & per pixel of median stacking.
+ */
+#define IMSTAT_SELECT(name, type) \
+static inline type name(type *v, long n, long k){ \
+    long l = 0, r = n - 1; \
+    while(l < r){ \
+        type x = v[k]; \
+        long i = l, j = r; \
+        do{ \
+            while(v[i] < x) ++i; \
+            while(x < v[j]) --j; \
+            if(i <= j){ \
+                type t = v[i]; v[i] = v[j]; v[j] = t; \
+                ++i; --j; \
+            } \
+        }while(i <= j); \
+        if(j < k) l = i; \
+        if(k < i) r = j; \
+    } \
+    return v[k]; \
+}
+IMSTAT_SELECT(imstat_select, uint16_t)
+IMSTAT_SELECT(imstat_selectf, float)
+
+int imstat_threads(int n);
+void imstat_calc(const uint16_t *img, int w, int h, imstat_acc *acc, uint32_t *hist);
+void imstat_robust(const uint32_t *hist, uint64_t N, imstat_robustval *r);
+const char *imstat_kernel();
+void imstat_bench(int maxthreads, int withhist);
+
+#endif // __IMSTAT_H__
@@ -0,0 +1,143 @@
+/*
+ * liveview.c - live view of frames in POSIX shared memory
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Each camera publishes its frames into own shared memory segment with ring
+ * of LIVEVIEW_NSLOTS slots (see liveview.h for layout). Slot is protected by
+ * seqlock: writer makes its counter odd, copies header & image and makes
+ * counter even, then publishes number of frame; viewers check counter before
+ * and after reading, so writer never blocks and never knows about them.
+ * Segment is prefaulted when opened and isn't unlinked when series ends
+ * (viewers could keep it mapped), next series reuses it and only grows it.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "liveview.h"
+#include "usefull_macros.h"
+
+struct _liveview{
+    liveview_header *hdr;   // mapped segment
+    size_t size;            // its size
+    uint64_t frameno;       // number of last published frame
+};
+
+static size_t roundup(size_t sz, size_t blk){
+    return (sz + blk - 1) / blk * blk;
+}
+
+/**
+ * Create (or reuse) shared memory segment for frames not larger than w x h
+ * @param name - name of segment ("/name")
+ * @param w, h - max image size
+ * @return live view handle or NULL if failed
+ */
+liveview *liveview_open(const char *name, int w, int h){
+    if(!name || w < 1 || h < 1) return NULL;
+    size_t pagesz = (size_t)sysconf(_SC_PAGESIZE);
+    size_t hdrsz = roundup(sizeof(liveview_header), pagesz);
+    size_t slotsz = roundup((size_t)w * h * sizeof(uint16_t), pagesz);
+    size_t size = hdrsz + LIVEVIEW_NSLOTS * slotsz;
+    struct stat st;
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+        WARN("shm_open(%s)", name);
+        return NULL;
+    }
+    // never shrink: viewers mapped it whole would get SIGBUS
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size > size) size = (size_t)st.st_size;
+    else if(ftruncate(fd, size)){
+        WARN("ftruncate(%s)", name);
+        close(fd);
+        return NULL;
+    }
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED){
+        WARN("mmap(%s)", name);
+        return NULL;
+    }
+    liveview_header *hd = (liveview_header*)ptr;
+    // frames of previous series are invalid now
+    __atomic_store_n(&hd->last, 0, __ATOMIC_RELEASE);
+    for(int i = 0; i < LIVEVIEW_NSLOTS; ++i){
+        uint32_t seq = hd->slots[i].seq & ~1U;
+        __atomic_store_n(&hd->slots[i].seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    // prefault all pages: no page faults while frames are published
+    for(size_t i = hdrsz; i < size; i += pagesz) ((volatile char*)ptr)[i] = 0;
+    hd->version = LIVEVIEW_VERSION;
+    hd->segsize = size;
+    hd->nslots = LIVEVIEW_NSLOTS;
+    hd->dataoffset = hdrsz;
+    hd->slotsize = slotsz;
+    hd->streaming = 1;
+    __atomic_store_n(&hd->magic, LIVEVIEW_MAGIC, __ATOMIC_RELEASE);
+    liveview *l = MALLOC(liveview, 1);
+    l->hdr = hd;
+    l->size = size;
+    l->frameno = 0;
+    DBG("live view %s: %zd bytes, slots of %zd bytes", name, size, slotsz);
+    return l;
+}
+
+/**
+ * Mark stream as stopped & unmap segment (it stays for viewers)
+ * @param l - live view handle
+ */
+void liveview_close(liveview *l){
+    if(!l) return;
+    __atomic_store_n(&l->hdr->streaming, 0, __ATOMIC_RELEASE);
+    munmap(l->hdr, l->size);
+    FREE(l);
+}
+
+/**
+ * Publish frame (never blocks)
+ * @param l    - live view handle
+ * @param data - image
+ * @param hdr  - its parameters (seq & frameno are ignored)
+ * @return 0 if all OK
+ */
+int liveview_put(liveview *l, const uint16_t *data, const liveview_slot *hdr){
+    if(!l || !data || !hdr) return 1;
+    liveview_header *hd = l->hdr;
+    size_t sz = (size_t)hdr->width * hdr->height * sizeof(uint16_t);
+    if(sz > hd->slotsize) return 1;
+    uint64_t n = l->frameno + 1;
+    int idx = (int)((n - 1) % LIVEVIEW_NSLOTS);
+    liveview_slot *s = &hd->slots[idx];
+    uint32_t seq = s->seq; // only writer changes it
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd counter is seen before new data
+    s->width = hdr->width; s->height = hdr->height;
+    s->bitpix = hdr->bitpix; s->maxval = hdr->maxval;
+    s->x0 = hdr->x0; s->y0 = hdr->y0;
+    s->hbin = hdr->hbin; s->vbin = hdr->vbin;
+    s->frameno = n;
+    s->timestamp = hdr->timestamp; s->exptime = hdr->exptime;
+    memcpy((char*)hd + hd->dataoffset + idx * hd->slotsize, data, sz);
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&hd->last, n, __ATOMIC_RELEASE);
+    l->frameno = n;
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * liveview.h - live view of frames in POSIX shared memory
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __LIVEVIEW_H__
+#define __LIVEVIEW_H__
+
+#include <stdint.h>
+
+/*
+ * Layout of shared memory segment (viewers map it read-only):
+ *   liveview_header, then `nslots` slots of `slotsize` bytes each beginning
+ *   at `dataoffset` (page-aligned); slot i contains image of slots[i].
+ * Reading of the last frame:
+ *   1. n = last (acquire); n == 0 - nothing published yet;
+ *   2. s = &slots[(n - 1) % nslots]; seq0 = s->seq (acquire), odd - retry;
+ *   3. use header of slot & its image (copy it or show directly);
+ *   4. acquire fence, if s->seq != seq0 - slot was overwritten, retry.
+ * Writer never waits for viewers: each new frame goes into the next slot, so
+ * viewer has (nslots - 1) frames of time to process the last one. When
+ * `segsize` grows (larger frames in next series) viewer should remap segment.
+ */
+
+#define LIVEVIEW_MAGIC      (0x4556494CU)   // "LIVE"
+#define LIVEVIEW_VERSION    (1)
+#define LIVEVIEW_NSLOTS     (3)
+
+// header of frame in slot
+typedef struct{
+    uint32_t seq;           // seqlock: odd while slot is written
+    uint32_t width, height; // image size
+    int32_t bitpix;         // FITS-like: 16 - uint16 pixels
+    uint32_t maxval;        // max pixel value (255 in 8-bit mode)
+    int32_t x0, y0;         // upper left corner on sensor
+    uint32_t hbin, vbin;    // binning
+    uint64_t frameno;       // number of frame since stream start (from 1)
+    double timestamp;       // UNIX time of exposure start
+    double exptime;         // exposure time (s)
+} liveview_slot;
+
+// header of segment
+typedef struct{
+    uint32_t magic;         // LIVEVIEW_MAGIC
+    uint32_t version;       // LIVEVIEW_VERSION
+    uint64_t segsize;       // size of segment
+    uint32_t nslots;        // amount of slots
+    uint32_t streaming;     // 1 while capture is going
+    uint64_t dataoffset;    // offset of first slot image
+    uint64_t slotsize;      // size of each slot image
+    uint64_t last;          // number of last published frame (0 - none)
+    liveview_slot slots[LIVEVIEW_NSLOTS];
+} liveview_header;
+
+typedef struct _liveview liveview;
+
+liveview *liveview_open(const char *name, int w, int h);
+void liveview_close(liveview *l);
+int liveview_put(liveview *l, const uint16_t *data, const liveview_slot *hdr);
+
+#endif // __LIVEVIEW_H__
@@ -36,63 +36,186 @@
 #include <fitsio.h>
 #include <math.h>
 #include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <setjmp.h>
 #ifdef USE_BTA
 #include "bta_print.h"
 #endif
 #include "main.h"
 #include "atikcore.h"
+#include "framepool.h"
+#include "imstat.h"
+#include "writer.h"
+#include "fitsseries.h"
+#include "fitsdirect.h"
+#include "seqname.h"
+#include "expwait.h"
+#include "timing.h"
+#include "camdaemon.h"
+#include "calib.h"
+#include "defects.h"
 
 #ifdef USEPNG
-int writepng(char *filename, int width, int height, void *data);
+int writepng(char *filename, frame *f);
 #endif /* USEPNG */
+static int writefits_calib(char *filename, frame *f);
+static int writefits_master(char *filename, frame *f, uint64_t nrej);
+static int writefits_coadd(char *filename, frame *f, double *img);
+static void save_coadd(camera *c, long snap);
+static int fits_image_header(fitsfile *fp, char *filename, frame *f, int naxis, long *naxes, int bitpix);
+static int writefits_rgb(char *filename, frame *f);
 
 #define BUFF_SIZ 4096
 
+// min size of tracking ROI
+#define ROI_MIN         (16)
+// ROI is re-centred when target moves from its centre more than 1/ROI_DEADBAND of size
+#define ROI_DEADBAND    (8.)
+
 #define TMBUFSIZ 40
-char tm_buf[TMBUFSIZ];  // buffer for string with time value
 
 glob_pars *G = NULL; // default parameters see in cmdlnopts.c
 
-uint16_t max = 0, min = 65535; // max/min values for given image
-double avr, std; // stat values
-double pixX, pixY; // pixel size in um
+void print_stat(frame *f);
 
-void print_stat(u_int16_t *img, long size);
+// value of float image clamped to 16-bit range
+static inline uint16_t float2u16(float v){
+    return (v <= 0.f) ? 0 : (v >= 65535.f) ? 65535 : (uint16_t)(v + 0.5f);
+}
 
 size_t curtime(char *s_time){ // current date/time
     time_t tm = time(NULL);
     return strftime(s_time, TMBUFSIZ, "%d/%m/%Y,%H:%M:%S", localtime(&tm));
 }
 
-double t_int=1e6;    // CCD temperature @exposition end
-struct timeval expStartsAt;     // exposition start time
+static camera cameras[MAX_CAMERA]; // opened cameras
+static int ncameras = 0;
+
+static swbin swbins[SWBIN_MAX]; // software binnings of each frame
+static int nswbin = 0;
+
+static int calint16 = 0;    // calibrated images are saved as scaled int16
+
+static int stacking = 0;    // series is stacked into master frame
+static stack_mode stackmode = STACK_MEAN;
 
-int check_filename(char *buff, char *outfile, char *ext){
-    struct stat filestat;
-    int num;
-    for(num = 1; num < 10000; num++){
-        if(snprintf(buff, BUFF_SIZ, "%s_%04d.%s", outfile, num, ext) < 1)
-            return 0;
-        if(stat(buff, &filestat)) // no such file or can't stat()
-            return 1;
+static int coadding = 0;    // series is co-added
+static int coaddmean = 0;   // co-add is mean (not sum) of frames
+
+static int roitracking = 0; // readout window follows target
+static int roiw, roih;      // its size (sensor pixels)
+static double roitx, roity; // target (sensor pixels, <0 - the brightest star)
+
+static int demosaicing = 0; // colour frames are demosaiced
+static demosaic_mode dmode = DEMOSAIC_BILINEAR;
+
+static int fitscomp = 0;    // FITS tile compression type (0 - uncompressed)
+static int complevel = -1;  // compression level (or HCOMPRESS scale)
+
+/**
+ * Parse compression parameters: "type[:level]"
+ * @param str - string from cmdline
+ * @return 1 if all OK
+ */
+static int parse_compress(char *str){
+    const struct{ char *name; int type; } ctypes[] = {
+        {"rice", RICE_1}, {"hcompress", HCOMPRESS_1}, {"gzip", GZIP_1}, {NULL, 0}
+    };
+    char *lvl = strchr(str, ':');
+    if(lvl) *lvl++ = 0;
+    for(int i = 0; ctypes[i].name; ++i){
+        if(strcasecmp(str, ctypes[i].name)) continue;
+        fitscomp = ctypes[i].type;
+        if(!lvl) return 1;
+        char *eptr;
+        complevel = (int)strtol(lvl, &eptr, 10);
+        if(eptr == lvl || *eptr || complevel < 0) return 0;
+        return 1;
     }
     return 0;
 }
 
+static sigjmp_buf reqjmp;           // return point for errors in daemon request
+static volatile int inrequest = 0;  // daemon is processing request
+static pthread_t mainthread;
+static volatile sig_atomic_t sigcaught = 0; // termination signal caught by handler
+static sem_t capdone;               // posted by each capture thread at its end
+static volatile int capfailed = 0;  // some capture thread failed during daemon request
+static __thread int capthread = 0;  // this thread captures frames of one of cameras
+static __thread frame *capframe = NULL; // frame held by capture thread
+
+static void abort_exposures(){
+    for(int i = 0; i < ncameras; ++i){
+        atik_camera_abortExposure(cameras[i].cam);
+        atik_camera_setGuideRelays(cameras[i].cam, 0); // stop guiding pulse
+    }
+}
+
+static void free_stacks(){
+    for(int i = 0; i < ncameras; ++i){
+        stack_free(&cameras[i].stk);
+        coadd_free(&cameras[i].cad);
+        swbin_freebuf(&cameras[i].binbuf);
+    }
+}
+
+static void close_live(){
+    for(int i = 0; i < ncameras; ++i){
+        liveview_close(cameras[i].live);
+        cameras[i].live = NULL;
+    }
+}
+
+static void close_cameras(){
+    for(int i = 0; i < ncameras; ++i){
+        atik_camera_close(cameras[i].cam);
+        FREE(cameras[i].prefix);
+    }
+    ncameras = 0;
+}
+
 void signals(int signo){
+    // ERR/ERRX while daemon processes request: abort only this request
+    if(signo == 9 && inrequest && pthread_equal(pthread_self(), mainthread)){
+        abort_exposures();
+        siglongjmp(reqjmp, 1);
+    }
+    if(signo == 9 && inrequest && capthread){ // main thread will abort request
+        if(capframe) frame_unref(capframe);
+        capfailed = 1;
+        sem_post(&capdone);
+        pthread_exit(NULL);
+    }
     if(signo){
         ///     %d
         WARNX(_("Abort with code %d"), signo);
         signal(signo, SIG_DFL);
     }
     DBG("abort exp");
-    atik_camera_abortExposure();
+    abort_exposures();
+    writer_stop(); // save all already captured frames
+    series_close();
+    #ifdef TIMING
+    timing_finish();
+    #endif
     DBG("close");
-    atik_camera_close();
+    close_cameras();
     DBG("exit");
     exit(signo);
 }
 
+// signal handler only remembers signal: it is processed by check_signals()
+static void sighandler(int signo){
+    if(!sigcaught) sigcaught = signo;
+}
+
+// process caught signal (in normal context of capture or main thread)
+static void check_signals(){
+    int signo = sigcaught;
+    if(signo) signals(signo);
+}
+
 extern const char *__progname;
 void info(const char *fmt, ...){
     va_list ar;
@@ -104,56 +227,332 @@ void info(const char *fmt, ...){
     printf("\n");
 }
 
-int main(int argc, char **argv){
-    int num;
-    char *msg = NULL;
-    initial_setup();
-    signal(SIGTERM, signals); // kill (-15) - quit
-    signal(SIGHUP, signals);  // hup - quit
-    signal(SIGINT, signals);  // ctrl+C - quit
-    signal(SIGQUIT, signals); // ctrl+\ - quit
-    signal(SIGTSTP, SIG_IGN); // ignore ctrl+Z
+// name of camera before its messages (when there's several cameras)
+static void camlabel(camera *c){
+    if(ncameras > 1) printf("%s: ", c->name);
+}
 
-    G = parse_args(argc, argv);
-    /*
-     * Find CCDs and work with each of them
-     */
-    num = atik_list_create();
-    if(!num) ERRX(_("No CCD found"));
-    DBG("List: %s", atik_list_get());
-    if(G->camname){
-        if(atik_list_item_select(G->camname) == 0)
-            ERRX(_("Camera \"%s\" not found"), G->camname);
-    }
-    if(num > 1 && !G->camname){
-        ERRX(_("Found %d cameras, give a specific name with \"--camname\" option"));
-    }
-    uint16_t *img = NULL;
-    DBG("Try to open %s", atik_camera_name());
-    if(atik_camera_open() == 0)
-        ERRX(_("Can't open camera device"));
-    DBG("reset preview, 8bit and dark");
-    if(atik_camera_setPreviewMode(0) == 0) WARNX("failed");
-    atik_camera_setDarkFrameMode(0);
-    atik_camera_set8BitMode(0);
-    info("Binlist: %s", atik_camera_getBinList());
-    COOLING_STATE state = COOLING_ON;
-    float targetTemp, power;
-    AtikCapabilities *cap = atik_camera_getCapabilities();
+// telemetry during long exposition
+static void exp_telemetry(double remain, void *arg){
+    camera *c = (camera *)arg;
+    char tbuf[TMBUFSIZ];
+    float temp;
+    if(atik_camera_getTemperatureSensorStatus(c->cam, 1, &temp)) c->t_int = temp;
+    if(curtime(tbuf)){
+        /// /
+        info("%s: %s\tTint=%.2f\n", _("date/time"), tbuf, c->t_int);
+    }
+    else WARNX("curtime() error");
+    camlabel(c);
+    /// %.3f    \n
+    printf(_("%.3f seconds till exposition ends\n"), remain);
+}
+
+// flush written file to disk
+static int syncfile(char *name, _U_ int num){
+    TIMESTART(tf);
+    int fd = open(name, O_RDONLY), r = 0;
+    if(fd < 0 || fsync(fd)) r = 1;
+    if(fd > -1) close(fd);
+    TIMEEND(tf, num, PH_FSYNC);
+    return r;
+}
+
+/**
+ * Make file name (or prefix) in buffer of PATH_MAX bytes
+ * @param buf - (o) buffer
+ * @param fmt - format of snprintf()
+ * @return 0 if all OK, 1 if name is too long
+ */
+static int __attribute__((format(printf, 2, 3))) mkname(char *buf, const char *fmt, ...){
+    va_list ar;
+    va_start(ar, fmt);
+    int l = vsnprintf(buf, PATH_MAX, fmt, ar);
+    va_end(ar);
+    if(l > -1 && l < PATH_MAX) return 0;
+    /// "   : %.64s..."
+    WARNX(_("File name is too long: %.64s..."), buf);
+    return 1;
+}
+
+/**
+ * Save captured frame (runs in writer thread)
+ * @param f - frame to save
+ */
+static void save_frame(frame *f){
+    char binprefix[PATH_MAX], *prefix = f->cam->prefix;
+    camera *c = f->cam;
+    if(c->stk || c->cad){
+        if(f->num == 0){
+            c->stkstart = f->expStartsAt;
+            c->stktemp0 = f->temp0;
+        }
+        if(c->stk){
+            TIMESTART(tk);
+            if(stack_add(c->stk, f->data, f->w, f->h))
+                /// "    %d  "
+                WARNX(_("Can't add frame %d to stack"), f->num);
+            TIMEEND(tk, f->num, PH_STACK);
+        }else{
+            // threshold of star pixels for centroid
+            double thres = f->robust ? f->med + 5. * 1.4826 * f->mad : f->avr + 3. * f->std;
+            TIMESTART(ta);
+            long n = coadd_add(c->cad, f->data, f->w, f->h, thres);
+            TIMEEND(ta, f->num, PH_COADD);
+            if(n < 0)
+                /// "    %d  "
+                WARNX(_("Can't add frame %d to co-add"), f->num);
+            else if(G->snapshot > 0 && n % G->snapshot == 0 && n < G->nframes) save_coadd(c, n);
+        }
+        if(!G->keepraw) return;
+    }
+    if(G->liveonly) return;
+    if(f->bin && nswbin > 1){ // each product has its own names
+        if(mkname(binprefix, "%s_b%dx%d", prefix, f->bin->nx, f->bin->ny)) return;
+        prefix = binprefix;
+    }
+    inline void WRITEIMG(int (*writefn)(char*,frame*), char *ext){
+        char buff[PATH_MAX], nameok = 0, *fname = buff;
+        if(rewrite_ifexists){
+            char *p = "";
+            if(strcmp(ext, "fits") == 0) p = "!";
+            if(G->nframes > 1 && !(G->series && writefn == series_write)){
+                nameok = !mkname(buff, "%s%s_%0*d.%s", p, prefix, G->padding, f->num, ext);
+            }else{
+                nameok = !mkname(buff, "%s%s.%s", p, prefix, ext);
+            }
+        }else{
+            // file is created here, so other writing threads won't get the same name
+            int fd = seqname_open(prefix, ext, buff + 1, PATH_MAX - 1);
+            if(fd < 0){
+                ///    
+                WARNX(_("Can't save file"));
+            }else{
+                close(fd);
+                nameok = 1;
+            }
+            fname = buff + 1;
+            if(strcmp(ext, "fits") == 0){ // file exists now
+                *buff = '!';
+                fname = buff;
+            }
+        }
+        if(nameok){
+            if(writefn(fname, f)){
+                ///    %s 
+                WARNX(_("Can't write %s file"), ext);
+            }else{
+                if(*fname == '!') ++fname;
+                /// "    %s  "
+                if(G->fsync && syncfile(fname, f->num)) WARN(_("Can't sync file %s"), fname);
+                ///    '%s'\n
+                printf(_("File saved as '%s'\n"), fname);
+            }
+        }
+    }
+    if(demosaicing && c->bayer != BAYER_NONE){
+        char rgbprefix[PATH_MAX], *rawprefix = prefix;
+        f->rgb = MALLOC(uint16_t, 3 * (size_t)f->w * f->h);
+        TIMESTART(tm);
+        if(bayer_demosaic(f->data, f->w, f->h, c->bayer, dmode, f->rgb, G->statthreads > 1 ? G->statthreads : 0))
+            FREE(f->rgb);
+        TIMEEND(tm, f->num, PH_DEMOSAIC);
+        if(f->rgb && !mkname(rgbprefix, "%s_rgb", prefix)){
+            prefix = rgbprefix;
+            WRITEIMG(writefits_rgb, "fits");
+            prefix = rawprefix;
+        }
+    }
+    if(f->calibrated){
+        char calprefix[PATH_MAX], *rawprefix = prefix;
+        int nameok = 1;
+        if(G->keepraw){
+            nameok = !mkname(calprefix, "%s_cal", prefix);
+            prefix = calprefix;
+        }
+        if(nameok) WRITEIMG(writefits_calib, "fits");
+        if(!G->keepraw){
+            FREE(f->rgb);
+            return;
+        }
+        prefix = rawprefix;
+    }
+    #ifdef USERAW
+    WRITEIMG(writeraw, "raw");
+    #endif // USERAW
+    if(!G->series) WRITEIMG(G->directfits ? writefits_direct : writefits, "fits");
+    else if(!series_isopen()) WRITEIMG(series_write, "fits");
+    else if(series_write(NULL, f)){
+        /// "    %d  "
+        WARNX(_("Can't add frame %d to series"), f->num);
+    }
+    #ifdef USEPNG
+    WRITEIMG(writepng, "png");
+    #endif // USEPNG
+    FREE(f->rgb);
+}
+
+// reset preview, 8bit and dark modes
+static void reset_modes(camera *c){
+    DBG("reset preview, 8bit and dark of %s", c->name);
+    if(atik_camera_setPreviewMode(c->cam, 0) == 0) WARNX("failed");
+    atik_camera_setDarkFrameMode(c->cam, 0);
+    atik_camera_set8BitMode(c->cam, 0);
+}
+
+/**
+ * Check options of output files (for each new set of parameters)
+ */
+static void setup_output(){
+    fitscomp = 0; complevel = -1;
+    if(G->compress){
+        if(!parse_compress(G->compress))
+            /// "  : %s"
+            ERRX(_("Wrong compression type: %s"), G->compress);
+        if(fitscomp == HCOMPRESS_1 && complevel > 0)
+            /// " HCOMPRESS       "
+            WARNX(_("HCOMPRESS with scale > 0 is lossy"));
+        if(fitscomp == RICE_1 && complevel > -1)
+            /// "   RICE "
+            WARNX(_("RICE compression level is ignored"));
+    }
+    nswbin = 0;
+    if(G->swbin && (nswbin = swbin_parse(G->swbin, swbins, SWBIN_MAX)) < 1)
+        /// "   : %s"
+        ERRX(_("Wrong software binning: %s"), G->swbin);
+    if(nswbin > 1){
+        if(G->series){
+            /// "        "
+            WARNX(_("Series in one file isn't possible with several binnings"));
+            G->series = NULL;
+        }
+    }
+    calint16 = 0;
+    if(G->calfmt){
+        if(strcasecmp(G->calfmt, "int16") == 0) calint16 = 1;
+        else if(strcasecmp(G->calfmt, "float"))
+            /// "   : %s"
+            ERRX(_("Wrong format of calibrated frames: %s"), G->calfmt);
+    }
+    if(calib_init(G->bias, G->mdark, G->flat))
+        /// "    "
+        ERRX(_("Can't load master frames"));
+    defects_free();
+    if((G->hotpix || G->cosmic) && defects_init(G->hotpix, G->hotsigma))
+        /// "     "
+        ERRX(_("Can't load map of hot pixels"));
+    if(calib_active() && G->series){
+        /// "     "
+        WARNX(_("Calibrated frames are saved into separate files"));
+        G->series = NULL;
+    }
+    stacking = 0;
+    if(G->stack){
+        if(stack_parse(G->stack, &stackmode))
+            /// "   : %s"
+            ERRX(_("Wrong stacking mode: %s"), G->stack);
+        if(G->nframes > STACK_MAXFRAMES)
+            /// "    %d "
+            ERRX(_("Can't stack more than %d frames"), STACK_MAXFRAMES);
+        stacking = 1;
+    }
+    roitracking = 0;
+    if(G->roi){
+        char *eptr;
+        roiw = (int)strtol(G->roi, &eptr, 10);
+        roih = 0;
+        if(eptr != G->roi && (*eptr == 'x' || *eptr == 'X')) roih = (int)strtol(eptr + 1, &eptr, 10);
+        if(roiw < ROI_MIN || roih < ROI_MIN || *eptr)
+            /// "  ROI: %s (  WxH,   %d)"
+            ERRX(_("Wrong ROI size: %s (should be WxH, not less than %d)"), G->roi, ROI_MIN);
+        roitx = roity = -1.;
+        if(G->roitarget && (sscanf(G->roitarget, "%lf,%lf", &roitx, &roity) != 2 || roitx < 0. || roity < 0.))
+            /// "   ROI: %s"
+            ERRX(_("Wrong coordinates of ROI target: %s"), G->roitarget);
+        roitracking = 1;
+    }
+    demosaicing = 0;
+    if(G->demosaic){
+        if(demosaic_parse(G->demosaic, &dmode))
+            /// "   : %s"
+            ERRX(_("Wrong demosaicing mode: %s"), G->demosaic);
+        demosaicing = 1;
+    }
+    coadding = 0;
+    if(G->coadd){
+        if(strcasecmp(G->coadd, "mean") == 0) coaddmean = 1;
+        else if(strcasecmp(G->coadd, "sum") == 0) coaddmean = 0;
+        /// "  : %s"
+        else ERRX(_("Wrong co-adding mode: %s"), G->coadd);
+        if(stacking)
+            /// "    "
+            ERRX(_("Stacking and co-adding are mutually exclusive"));
+        coadding = 1;
+    }
+    if(G->series && (G->cameras || ncameras > 1)){
+        /// "        "
+        WARNX(_("Series in one file isn't possible with several cameras"));
+        G->series = NULL;
+    }
+    if(G->series && fitscomp && strcasecmp(G->series, "cube") == 0){
+        /// "      ,   (mef)"
+        WARNX(_("Compressed cube can't be cut when series is incomplete, write extensions (mef)"));
+        G->series = "mef";
+    }
+    if(G->directfits && (fitscomp || G->series)){
+        /// "  FITS      "
+        WARNX(_("Direct FITS writing is possible only for uncompressed single files"));
+        G->directfits = 0;
+    }
+    if(series_init(G->series, G->nframes))
+        /// "   : %s"
+        ERRX(_("Wrong series mode: %s"), G->series);
+    if(G->series && G->nwriters > 1){
+        /// "    ,     "
+        WARNX(_("Series is written into one file, use only one writing thread"));
+        G->nwriters = 1;
+    }
+    if(G->nwriters > 1 && !fits_is_reentrant()){
+        /// " cfitsio    ,     "
+        WARNX(_("cfitsio isn't reentrant, use only one writing thread"));
+        G->nwriters = 1;
+    }
+    if(G->liveonly && !G->live)
+        /// " --live-only  --live"
+        ERRX(_("Option --live-only needs --live"));
+    seqname_padding(G->padding);
+    seqname_reset();
+}
+
+/**
+ * Open CCD & show its capabilities
+ * @param camname - camera name (NULL - first camera which isn't opened yet)
+ * @return 1 if all OK
+ */
+static int open_camera(const char *camname){
+    char *msg = NULL;
+    if(ncameras == MAX_CAMERA) return 0;
+    DBG("Try to open %s", camname ? camname : "next camera");
+    atikcam *cam = atik_camera_open(camname);
+    if(!cam) return 0;
+    camera *c = &cameras[ncameras++];
+    memset(c, 0, sizeof(camera));
+    c->cam = cam;
+    c->name = atik_camera_name(cam);
+    c->t_int = 1e6;
+    info("Camera: %s", c->name);
+    reset_modes(c);
+    info("Binlist: %s", atik_camera_getBinList(cam));
+    AtikCapabilities *cap = atik_camera_getCapabilities(cam);
     info("Sensor size: %dx%d pix", cap->pixelCountX, cap->pixelCountY);
-    if(G->X1 > (int)cap->pixelCountX || G->X1 < 1) G->X1 = cap->pixelCountX;
-    if(G->Y1 > (int)cap->pixelCountY || G->Y1 < 1) G->Y1 = cap->pixelCountY;
-    pixX = cap->pixelSizeX, pixY = cap->pixelSizeY;
-    info("Pixel size: %gx%g mkm", pixX, pixY);
+    c->pixX = cap->pixelSizeX, c->pixY = cap->pixelSizeY;
+    info("Pixel size: %gx%g mkm", c->pixX, c->pixY);
     info("Max binning: %dx%d", cap->maxBinX, cap->maxBinY);
-    if(G->hbin > (int)cap->maxBinX || G->hbin < 1 ||
-        G->vbin > (int)cap->maxBinY || G->vbin < 1){
-            ///      1  %d(H)  %d(V)
-            ERRX(_("Binning should have values from 1 to %d(H) and %d(V)"), cap->maxBinX, cap->maxBinY);
-        }
     info("Short expositions: min=%gs, max=%gs", cap->minShortExposure, cap->maxShortExposure);
     if(cap->colour != COLOUR_NONE) WARNX(_("Colour camera!"));
-    CAMERA_TYPE camtype = atik_camera_getType();
+    c->cfa = bayer_fromid(atik_camera_getColorId(cam));
+    if(c->cfa != BAYER_NONE) info("Bayer pattern: %s", bayer_name(c->cfa));
+    CAMERA_TYPE camtype = atik_camera_getType(cam);
     switch (camtype){
         case ORIGINAL_HSC:
             msg = "ORIGINAL_HSC";
@@ -175,21 +574,85 @@ int main(int argc, char **argv){
     }
     info("Camera type: %s", msg);
     /*{int g, o;
-    if(atik_camera_getGain(&g, &o)){
+    if(atik_camera_getGain(cam, &g, &o)){
         info("Camera gain: %d, gain offset: %d", g, o);
     }}*/
+    return 1;
+}
+
+/**
+ * Find CCDs & open camera given by "--camname" or several cameras given by "--cameras"
+ */
+static void open_cameras(){
+    int num = atik_list_create();
+    if(!num) ERRX(_("No CCD found"));
+    DBG("List: %s", atik_list_get());
+    if(G->cameras){
+        if(strcmp(G->cameras, "all") == 0){
+            while(open_camera(NULL));
+        }else{
+            char *names = strdup(G->cameras), *saveptr = NULL;
+            for(char *n = strtok_r(names, ",", &saveptr); n; n = strtok_r(NULL, ",", &saveptr)){
+                if(!open_camera(n))
+                    /// "    \"%s\""
+                    ERRX(_("Can't open camera \"%s\""), n);
+            }
+            FREE(names);
+        }
+        if(!ncameras) ERRX(_("Can't open camera device"));
+    }else{
+        if(num > 1 && !G->camname){
+            ERRX(_("Found %d cameras, give a specific name with \"--camname\" option"), num);
+        }
+        if(!open_camera(G->camname)){
+            if(G->camname) ERRX(_("Camera \"%s\" not found"), G->camname);
+            ERRX(_("Can't open camera device"));
+        }
+    }
+    DBG("statistics kernel: %s", imstat_kernel());
+    DBG("FITS conversion kernel: %s", fitsdirect_kernel());
+    DBG("software binning kernel: %s", swbin_kernel());
+    DBG("calibration kernel: %s", calib_kernel());
+    DBG("co-adding kernel: %s", coadd_kernel());
+    DBG("demosaicing kernel: %s", bayer_kernel());
+}
 
-    if((G->X1 > -1 && G->X1 < G->X0) || (G->Y1 > -1 && G->Y1 < G->Y0)){
+/**
+ * Set up camera for capturing with current parameters
+ * @param c - camera
+ * @return 1 if there's nothing to capture (no exposure time given)
+ */
+static int setup_camera(camera *c){
+    COOLING_STATE state = COOLING_ON;
+    float targetTemp, power;
+    char *msg = NULL;
+    AtikCapabilities *cap = atik_camera_getCapabilities(c->cam);
+    FREE(c->prefix);
+    if(ncameras > 1){ // output files of each camera have own prefix
+        size_t l = strlen(G->outfile) + 16;
+        c->prefix = MALLOC(char, l);
+        snprintf(c->prefix, l, "%s_cam%d", G->outfile, (int)(c - cameras) + 1);
+    }else c->prefix = strdup(G->outfile);
+    c->X0 = G->X0; c->Y0 = G->Y0; c->X1 = G->X1; c->Y1 = G->Y1;
+    if(c->X1 > (int)cap->pixelCountX || c->X1 < 1) c->X1 = cap->pixelCountX;
+    if(c->Y1 > (int)cap->pixelCountY || c->Y1 < 1) c->Y1 = cap->pixelCountY;
+    if(G->hbin > (int)cap->maxBinX || G->hbin < 1 ||
+        G->vbin > (int)cap->maxBinY || G->vbin < 1){
+            ///      1  %d(H)  %d(V)
+            ERRX(_("Binning should have values from 1 to %d(H) and %d(V)"), cap->maxBinX, cap->maxBinY);
+        }
+    if((c->X1 > -1 && c->X1 < c->X0) || (c->Y1 > -1 && c->Y1 < c->Y0)){
         /// X1  Y1    X0  Y0
         ERRX(_("X1 and Y1 should be greater than X0 and Y0"));
     }
-    if(G->X0 < 0) G->X0 = 0;
-    if(G->Y0 < 0) G->Y0 = 0;
+    if(c->X0 < 0) c->X0 = 0;
+    if(c->Y0 < 0) c->Y0 = 0;
 
     if(G->temperature < 25.){
         // "  : %g  \n"
+        camlabel(c);
         green(_("Set CCD temperature to %g degr.C\n"), G->temperature);
-        if(!atik_camera_setCooling(G->temperature)){
+        if(!atik_camera_setCooling(c->cam, G->temperature)){
             /// "      %g"
             WARNX(_("Error when trying to set cooling temperature %g"), G->temperature);
         }
@@ -199,7 +662,7 @@ int main(int argc, char **argv){
     int j;
     info("%d sensors found", cap->tempSensorCount);
     for(j = 0; j < (int)cap->tempSensorCount; ++j){
-        if(atik_camera_getTemperatureSensorStatus(j+1, &targetTemp))
+        if(atik_camera_getTemperatureSensorStatus(c->cam, j+1, &targetTemp))
             info("Sensor %d temperature: %.1f", j, targetTemp);
     }
 */
@@ -219,14 +682,15 @@ int main(int argc, char **argv){
                 default:
                     ERRX(_("Unknown shutter command"));
             }
+            camlabel(c);
             green(_("%s CCD shutter\n"), str);
-            if(!atik_camera_setShutter((G->shtr_cmd == SHUTTER_CLOSE) ? 0 : 1)){
+            if(!atik_camera_setShutter(c->cam, (G->shtr_cmd == SHUTTER_CLOSE) ? 0 : 1)){
                 /// "   "
                 WARNX(("Error changing shutter state"));
             }
         }
     }
-    if(atik_camera_getCoolingStatus(&state, &targetTemp, &power)){
+    if(atik_camera_getCoolingStatus(c->cam, &state, &targetTemp, &power)){
         switch (state){
             case COOLING_INACTIVE:
                 msg = "inactive";
@@ -245,15 +709,21 @@ int main(int argc, char **argv){
         }
         info("Cooling status: %s; targetTemp=%.1f, power=%.1f", msg, targetTemp, power);
     }
-    if(atik_camera_getTemperatureSensorStatus(1, &targetTemp)){
+    if(atik_camera_getTemperatureSensorStatus(c->cam, 1, &targetTemp)){
         info("CCD temperature: %.1f", targetTemp);
     }
-    if(G->exptime < 0.) signals(0); // turn off all
-    if(G->exptime < cap->minShortExposure) G->exptime = cap->minShortExposure;
-    if(G->exptime > cap->maxShortExposure && !cap->supportsLongExposure)
+    if(G->exptime < 0.) return 1; // nothing to capture
+    c->exptime = G->exptime;
+    if(c->exptime < cap->minShortExposure) c->exptime = cap->minShortExposure;
+    if(c->exptime > cap->maxShortExposure && !cap->supportsLongExposure)
         ERRX(_("This camera doesn't support exposures with length more than %gs"), cap->maxShortExposure);
-    info("Exposure time = %gs", G->exptime);
-    if(G->dark && !atik_camera_setDarkFrameMode(1)){
+    info("Exposure time = %gs", c->exptime);
+    if(G->autoexp > 0.){
+        double tmax = G->autoexpmax > 0. ? G->autoexpmax : AUTOEXP_MAXEXP;
+        if(!cap->supportsLongExposure && tmax > cap->maxShortExposure) tmax = cap->maxShortExposure;
+        autoexp_init(&c->aexp, G->autoexp, -1., cap->minShortExposure, tmax);
+    }
+    if(G->dark && !atik_camera_setDarkFrameMode(c->cam, 1)){
         /// ":     "
         ERRX(_("Error: can't set dark mode"));
     }
@@ -261,135 +731,702 @@ int main(int argc, char **argv){
         if(!cap->has8BitMode){
             /// "    8- "
             WARNX(_("This camera has no 8-bit mode"));
-        }else if(!atik_camera_set8BitMode(1)){
+        }else if(!atik_camera_set8BitMode(c->cam, 1)){
         /// "  8- "
             ERRX(_("Can't set 8-bit mode"));
         }
     }
-    if(G->preview && !atik_camera_setPreviewMode(1)){
+    if(G->preview && !atik_camera_setPreviewMode(c->cam, 1)){
         /// "    "
         ERRX(_("Can't set preview mode"));
     }
+    // colours of binned pixels are mixed
+    c->bayer = bayer_shift(c->cfa, c->X0, c->Y0);
+    if(c->bayer != BAYER_NONE && (G->hbin > 1 || G->vbin > 1 || nswbin)){
+        c->bayer = BAYER_NONE;
+        /// "  ,    "
+        if(demosaicing) WARNX(_("Binning mixes colours, frames won't be demosaiced"));
+    }
+    c->w = atik_camera_imageWidth(c->cam, c->X1 - c->X0, G->hbin);
+    c->h = atik_camera_imageHeight(c->cam, c->Y1 - c->Y0, G->vbin);
+    c->AX0 = c->X0; c->AY0 = c->Y0; c->AX1 = c->X1; c->AY1 = c->Y1;
+    DBG("%s: X0=%d, X1=%d, Y0=%d, Y1=%d, w=%ld, h=%ld", c->name, c->X0, c->X1, c->Y0, c->Y1, c->w, c->h);
+    return 0;
+}
+/**
+ * Position of frame on full frame of camera (maps of defects & masters)
+ * @param f      - frame
+ * @param x0, y0 - (o) position in pixels of frame (binned if it is binned)
+ */
+static void frame_offset(const frame *f, int *x0, int *y0){
+    camera *c = f->cam;
+    *x0 = (f->X0 - c->AX0) / G->hbin;
+    *y0 = (f->Y0 - c->AY0) / G->vbin;
+    if(f->bin){ *x0 /= f->bin->nx; *y0 /= f->bin->ny; }
+}
+
+/**
+ * Put captured frame into writing queue, binned if needed
+ * @param f - frame from camera
+ */
+static void put_frame(frame *f){
+    if(defects_active()){
+        defects_stat ds;
+        double crsigma = G->cosmic ? (G->crsigma > 0. ? G->crsigma : DEFECTS_CRSIGMA) : 0.;
+        int x0, y0;
+        frame_offset(f, &x0, &y0);
+        TIMESTART(td);
+        if(defects_fix(f->data, x0, y0, f->w, f->h, crsigma, G->statthreads > 1 ? G->statthreads : 0, &ds) == 0){
+            f->defects = 1;
+            f->nhot = ds.nhot; f->ncosmic = ds.ncosmic;
+        }
+        TIMEEND(td, f->num, PH_DEFECTS);
+    }
+    if(!nswbin){
+        writer_putframe(f);
+        return;
+    }
+    TIMESTART(tb);
+    if(nswbin == 1){ // bin in place
+        const swbin *b = &swbins[0];
+        f->binsat = swbin_apply(b, f->data, f->w, f->h, f->data, f->cam->binbuf);
+        f->bin = b;
+        f->w /= b->nx; f->h /= b->ny;
+        TIMEEND(tb, f->num, PH_SWBIN);
+        writer_putframe(f);
+        return;
+    }
+    frame *products[SWBIN_MAX];
+    frame_getn(products, nswbin); // all at once: pool is shared by cameras
+    for(int i = 0; i < nswbin; ++i){ // several products of one frame
+        const swbin *b = &swbins[i];
+        frame *o = products[i];
+        uint16_t *data = o->data;
+        float *cal = o->cal;
+        int refcnt = o->refcnt;
+        *o = *f; // all parameters except buffers
+        o->data = data; o->cal = cal; o->refcnt = refcnt;
+        o->binsat = swbin_apply(b, f->data, f->w, f->h, o->data, f->cam->binbuf);
+        o->bin = b;
+        o->w = f->w / b->nx; o->h = f->h / b->ny;
+        writer_putframe(o);
+    }
+    TIMEEND(tb, f->num, PH_SWBIN);
+    frame_unref(f);
+}
+
+/**
+ * Expose & read out part of sensor given by c->X0..c->Y1
+ * @param c   - camera
+ * @param num - frame number (for timing)
+ */
+static void expose(camera *c, _U_ int num){
+    AtikCapabilities *cap = atik_camera_getCapabilities(c->cam);
+    // start exposition & wait
+    if(c->exptime < cap->maxShortExposure){ // Short exposure
+        TIMESTART(tr);
+        if(!atik_camera_readCCD_delay(c->cam, c->X0, c->Y0, c->X1 - c->X0,
+            c->Y1 - c->Y0, G->hbin, G->vbin, c->exptime))
+                ERRX(_("Can't start short exposition!"));
+        TIMEEND(tr, num, PH_READCCD);
+    }else{ // Long exposure
+        double time2wait = ((double)atik_camera_delay(c->cam, c->exptime))/1e6, overshoot = 0.;
+        struct timespec tstart; // time of exposition start
+        clock_gettime(CLOCK_MONOTONIC, &tstart);
+        TIMESTART(te);
+        if(!atik_camera_startExposure(c->cam, 0))
+            ERRX(_("Can't start long exposition!"));
+        int r = expwait(&tstart, time2wait, 10., exp_telemetry, c, &overshoot, &sigcaught);
+        if(r > 0) signals(r);
+        /// "   "
+        if(r < 0) ERRX(_("Error waiting for exposition end"));
+        /// " ,  %.0f "
+        info(_("Exposition ended, overshoot %.0f us"), overshoot);
+        TIMEEND(te, num, PH_EXPOSURE);
+        TIMESTART(tr);
+        if(!atik_camera_readCCD(c->cam, c->X0, c->Y0, c->X1 - c->X0,
+            c->Y1 - c->Y0, G->hbin, G->vbin))
+                ERRX(_("Can't read exposed frame!"));
+        TIMEEND(tr, num, PH_READCCD);
+    }
+}
+
+/**
+ * Place tracking ROI (of size c->w x c->h) around given point of area
+ * @param c    - camera
+ * @param x, y - point (binned pixels from corner of area)
+ */
+static void roi_place(camera *c, double x, double y){
+    // step of 2 pixels keeps phase of Bayer array, step multiple of software
+    // binning keeps its grid (binned frame is a window of binned masters)
+    int sx = 2, sy = 2, w = c->w * G->hbin, h = c->h * G->vbin;
+    if(nswbin == 1){
+        sx = (swbins[0].nx & 1) ? 2 * swbins[0].nx : swbins[0].nx;
+        sy = (swbins[0].ny & 1) ? 2 * swbins[0].ny : swbins[0].ny;
+    }
+    sx *= G->hbin; sy *= G->vbin;
+    int kx = (int)floor((x * G->hbin - w / 2.) / sx + 0.5), ky = (int)floor((y * G->vbin - h / 2.) / sy + 0.5);
+    int mx = (c->AX1 - c->AX0 - w) / sx, my = (c->AY1 - c->AY0 - h) / sy;
+    if(kx < 0) kx = 0;
+    if(ky < 0) ky = 0;
+    if(kx > mx) kx = mx;
+    if(ky > my) ky = my;
+    c->X0 = c->AX0 + kx * sx; c->X1 = c->X0 + w;
+    c->Y0 = c->AY0 + ky * sy; c->Y1 = c->Y0 + h;
+}
+
+/**
+ * Find target of ROI on full frame & place ROI around it
+ * @param c - camera with c->w, c->h of ROI
+ */
+static void roi_acquire(camera *c){
+    long rw = c->w, rh = c->h;
+    long aw = atik_camera_imageWidth(c->cam, c->AX1 - c->AX0, G->hbin);
+    long ah = atik_camera_imageHeight(c->cam, c->AY1 - c->AY0, G->vbin);
+    double x = -1., y = -1.;
+    stars_stat st;
+    star *list = NULL;
+    c->X0 = c->AX0; c->Y0 = c->AY0; c->X1 = c->AX1; c->Y1 = c->AY1;
+    frame *f = capframe = frame_get();
+    camlabel(c);
+    /// "     \n"
+    printf(_("Capture full frame to find target\n"));
+    expose(c, -1);
+    if(!atik_camera_getImage(c->cam, f->data, aw * ah))
+        ERRX(_("getImage() failed"));
+    if(!stars_find(f->data, aw, ah, G->starsigma, G->statthreads > 1 ? G->statthreads : 0, &st, &list)){
+        if(roitx > -1.){ // the nearest star to given point, or point itself
+            double tx = (roitx - c->AX0) / G->hbin, ty = (roity - c->AY0) / G->vbin, dmin = rw * rw + rh * rh;
+            x = tx; y = ty;
+            for(int i = 0; i < st.nstars; ++i){
+                double dx = list[i].x - tx, dy = list[i].y - ty, d = 4. * (dx * dx + dy * dy);
+                if(d < dmin){ dmin = d; x = list[i].x; y = list[i].y; }
+            }
+        }else for(int i = 0; i < st.nstars; ++i){ // sorted by flux
+            if(list[i].saturated) continue;
+            x = list[i].x; y = list[i].y;
+            break;
+        }
+        FREE(list);
+    }
+    capframe = NULL;
+    frame_unref(f);
+    if(x < 0.)
+        /// "    ROI"
+        ERRX(_("No target for ROI found"));
+    c->w = rw; c->h = rh;
+    roi_place(c, x, y);
+    camlabel(c);
+    /// " (%.1f, %.1f), ROI %dx%d  (%d, %d)\n"
+    printf(_("Target (%.1f, %.1f), ROI %dx%d from (%d, %d)\n"), c->AX0 + x * G->hbin, c->AY0 + y * G->vbin,
+           c->X1 - c->X0, c->Y1 - c->Y0, c->X0, c->Y0);
+}
+
+/**
+ * Re-centre tracking ROI when target moves from its centre
+ * @param c - camera
+ * @param f - frame just read
+ */
+static void roi_track(camera *c, frame *f){
+    double x, y;
+    if(stars_centroid(f->data, f->w, f->h, &x, &y, NULL)){
+        /// " ROI "
+        WARNX(_("ROI target lost"));
+        return;
+    }
+    if(fabs(x - f->w / 2.) < f->w / ROI_DEADBAND && fabs(y - f->h / 2.) < f->h / ROI_DEADBAND) return;
+    int x0 = c->X0, y0 = c->Y0;
+    roi_place(c, (f->X0 - c->AX0) / G->hbin + x, (f->Y0 - c->AY0) / G->vbin + y);
+    if(c->X0 != x0 || c->Y0 != y0) DBG("ROI moved to (%d, %d)", c->X0, c->Y0);
+}
+
+/**
+ * Predict exposure time of next frame by median level of this one
+ * @param c - camera
+ * @param f - frame just read
+ */
+static void auto_exposure(camera *c, frame *f){
+    double tmid = f->expStartsAt.tv_sec + f->expStartsAt.tv_usec / 1e6 + f->exptime / 2.;
+    f->aexplevel = autoexp_level(f->data, f->w, f->h);
+    c->exptime = autoexp_next(&c->aexp, f->exptime, tmid, f->aexplevel, dtime() + G->pause_len);
+    camlabel(c);
+    /// ":  %.0f ( %.0f),   %g,   %.0f\n"
+    printf(_("Auto exposure: level %.0f (predicted %.0f), next exposure %gs, predicted level %.0f\n"),
+           f->aexplevel, f->aexppred, c->exptime, c->aexp.predicted);
+}
 
-    long img_rows, row_width, imgSize;
-    row_width = atik_camera_imageWidth(G->X1 - G->X0, G->hbin);
-    img_rows = atik_camera_imageHeight(G->Y1 - G->Y0, G->vbin);
-    imgSize = img_rows * row_width;
-    img = MALLOC(uint16_t, imgSize);
-    DBG("allocated 2x%ld bytes; X0=%d, X1=%d, Y0=%d, Y1=%d, w=%ld, h=%ld",
-        imgSize, G->X0, G->X1, G->Y0, G->Y1, row_width, img_rows);
+/**
+ * Publish raw frame for live viewers (right after readout)
+ * @param c - camera
+ * @param f - its frame
+ */
+static void live_publish(camera *c, frame *f){
+    AtikCapabilities *cap = atik_camera_getCapabilities(c->cam);
+    liveview_slot s = {
+        .width = f->w, .height = f->h, .bitpix = 16,
+        .maxval = (G->fast && cap->has8BitMode) ? 255 : 65535,
+        .x0 = f->X0, .y0 = f->Y0, .hbin = G->hbin, .vbin = G->vbin,
+        .timestamp = f->expStartsAt.tv_sec + f->expStartsAt.tv_usec / 1e6,
+        .exptime = f->exptime
+    };
+    TIMESTART(tl);
+    if(liveview_put(c->live, f->data, &s))
+        /// "    %d"
+        WARNX(_("Can't publish frame %d"), f->num);
+    TIMEEND(tl, f->num, PH_LIVE);
+}
+
+/**
+ * Capture series of frames by one camera (runs in main thread or thread of camera)
+ * @param c - camera prepared by setup_camera()
+ */
+static void capture(camera *c){
+    long imgSize;
+    char tbuf[TMBUFSIZ];
+    float targetTemp;
     int j;
 
-    for (j = 0; j < G->nframes; ++j){
-        atik_camera_getTemperatureSensorStatus(1, &targetTemp);
-        G->temperature = targetTemp; // temperature @ exp. start
+    if(roitracking) roi_acquire(c);
+    imgSize = c->w * c->h;
+    for(j = 0; j < G->nframes; ++j){
+        check_signals();
+        if(capfailed) break; // another camera failed
+        frame *f = capframe = frame_get(); // wait for free buffer
+        f->num = j;
+        f->cam = c;
+        f->w = c->w; f->h = c->h;
+        f->bin = NULL;
+        f->calibrated = 0;
+        f->defects = 0;
+        f->rgb = NULL;
+        f->stars = 0;
+        f->X0 = c->X0; f->Y0 = c->Y0;
+        f->exptime = c->exptime;
+        f->autoexp = (G->autoexp > 0.);
+        f->aexppred = c->aexp.predicted;
+        atik_camera_getTemperatureSensorStatus(c->cam, 1, &targetTemp);
+        f->temp0 = targetTemp; // temperature @ exp. start
         printf("\n\n");
+        camlabel(c);
         ///   %d\n
         printf(_("Capture frame %d\n"), j);
-        gettimeofday(&expStartsAt, NULL);
-        // start exposition & wait
-        if(G->exptime < cap->maxShortExposure){ // Short exposure
-            if(!atik_camera_readCCD_delay(G->X0, G->Y0, G->X1 - G->X0,
-                G->Y1 - G->Y0, G->hbin, G->vbin, G->exptime))
-                    ERRX(_("Can't start short exposition!"));
-        }else{ // Long exposure
-            double time2wait = ((double)atik_camera_delay(G->exptime))/1e6;
-            double dtstart = dtime(); // time of exposition start
-            if(!atik_camera_startExposure(0))
-                ERRX(_("Can't start long exposition!"));
-            do{
-                atik_camera_getTemperatureSensorStatus(1, &targetTemp);
-                t_int = targetTemp;
-                if(curtime(tm_buf)){
-                    /// /
-                    info("%s: %s\tTint=%.2f\n", _("date/time"), tm_buf, t_int);
-                }
-                else WARNX("curtime() error");
-                double t = time2wait - (dtime() - dtstart);
-                /// %.3f    \n
-                printf(_("%.3f seconds till exposition ends\n"), t);
-                if(t > 10.) sleep(10);
-                else usleep(t*1e6);
-            }while(dtime() - dtstart < time2wait);
-            if(!atik_camera_readCCD(G->X0, G->Y0, G->X1 - G->X0,
-                G->Y1 - G->Y0, G->hbin, G->vbin))
-                    ERRX(_("Can't read exposed frame!"));
-        }
+        gettimeofday(&f->expStartsAt, NULL);
+        expose(c, j);
         info(_("Read image"));
-        if(!atik_camera_getImage(img, imgSize))
+        TIMESTART(tg);
+        if(!atik_camera_getImage(c->cam, f->data, imgSize))
             ERRX(_("getImage() failed"));
-        curtime(tm_buf);
-        print_stat(img, row_width * img_rows);
-        inline void WRITEIMG(int (*writefn)(char*,int,int,void*), char *ext){
-            char buff[BUFF_SIZ], nameok = 0;
-            if(rewrite_ifexists){
-                char *p = "";
-                if(strcmp(ext, "fits") == 0) p = "!";
-                if(G->nframes > 1){
-                    snprintf(buff, BUFF_SIZ, "%s%s_%04d.%s", p, G->outfile, j, ext);
-                }else{
-                    snprintf(buff, BUFF_SIZ, "%s%s.%s", p, G->outfile, ext);
-                }
-                nameok = 1;
-            }else{
-                if(!check_filename(buff, G->outfile, ext)){
-                    ///    
-                    WARNX(_("Can't save file"));
-                }else{
-                    nameok = 1;
-                }
-            }
-            if(nameok){
-                if(writefn(buff, row_width, img_rows, img)){
-                    ///    %s 
-                    WARNX(_("Can't write %s file"), ext);
-                }else{
-                    ///    '%s'\n
-                    printf(_("File saved as '%s'\n"), buff);
-                }
-            }
-        }
-            #ifdef USERAW
-            WRITEIMG(writeraw, "raw");
-            #endif // USERAW
-            WRITEIMG(writefits, "fits");
-            #ifdef USEPNG
-            WRITEIMG(writepng, "png");
-            #endif // USEPNG
+        TIMEEND(tg, j, PH_GETIMAGE);
+        f->temp1 = c->t_int;
+        if(roitracking) roi_track(c, f);
+        if(f->autoexp) auto_exposure(c, f);
+        if(c->live) live_publish(c, f);
+        capframe = NULL;
+        put_frame(f); // stat & save it in background
         if(G->pause_len){
+            TIMESTART(tp);
             double delta, time1 = dtime() + G->pause_len;
             while((delta = time1 - dtime()) > 0.){
-                atik_camera_getTemperatureSensorStatus(1, &targetTemp);
-                t_int = targetTemp;
+                atik_camera_getTemperatureSensorStatus(c->cam, 1, &targetTemp);
+                c->t_int = targetTemp;
+                camlabel(c);
                 /// %d    \n
                 printf(_("%d seconds till pause ends\n"), (int)delta);
-                if(curtime(tm_buf)){
+                if(curtime(tbuf)){
                     /// /
-                    info("%s: %s\tTint=%.2f\n", _("date/time"), tm_buf, t_int);
+                    info("%s: %s\tTint=%.2f\n", _("date/time"), tbuf, c->t_int);
                 }
                 else info("curtime() error");
                 if(delta > 10) sleep(10);
                 else sleep((int)delta);
+                check_signals();
             }
+            TIMEEND(tp, j, PH_PAUSE);
         }
     }
-    if(G->warmup) atik_camera_initiateWarmUp();
-    atik_camera_close();
+    if(G->warmup) atik_camera_initiateWarmUp(c->cam);
+}
+
+static void *capture_thread(void *arg){
+    capthread = 1;
+    capture((camera *)arg);
+    sem_post(&capdone);
+    return NULL;
+}
+
+/**
+ * Name of file with product of series (master frame, co-add)
+ * @param prefix - prefix of file name
+ * @param num    - number of snapshot (0 - final product)
+ * @param buff   - (o) file name with '!' (file could be rewritten), PATH_MAX bytes
+ * @return 0 if all OK
+ */
+static int product_name(const char *prefix, long num, char *buff){
+    if(rewrite_ifexists){
+        if(num) return mkname(buff, "!%s_%0*ld.fits", prefix, G->padding, num);
+        return mkname(buff, "!%s.fits", prefix);
+    }
+    int fd = seqname_open(prefix, "fits", buff + 1, PATH_MAX - 1);
+    if(fd < 0){
+        ///    
+        WARNX(_("Can't save file"));
+        return 1;
+    }
+    close(fd);
+    *buff = '!'; // file exists now
+    return 0;
+}
+
+// report result of product writing
+static void product_saved(int err, char *fname, int num){
+    if(err){
+        ///    %s 
+        WARNX(_("Can't write %s file"), "fits");
+        return;
+    }
+    if(*fname == '!') ++fname;
+    /// "    %s  "
+    if(G->fsync && syncfile(fname, num)) WARN(_("Can't sync file %s"), fname);
+    ///    '%s'\n
+    printf(_("File saved as '%s'\n"), fname);
+}
+
+// frame describing product of series of camera
+static void product_frame(camera *c, frame *m, int num){
+    memset(m, 0, sizeof(frame));
+    m->cam = c;
+    m->w = c->w; m->h = c->h;
+    m->X0 = c->X0; m->Y0 = c->Y0; // of last frame when ROI is tracking
+    m->exptime = c->exptime;
+    if(nswbin){ m->w /= swbins[0].nx; m->h /= swbins[0].ny; }
+    m->num = num;
+    m->expStartsAt = c->stkstart;
+    m->temp0 = c->stktemp0; m->temp1 = c->t_int;
+    m->calibrated = 1; // statistics is in cmin/cmax
+}
+
+/**
+ * Combine stack of camera into master frame & save it as "<prefix>_<mode>.fits"
+ * @param c - camera
+ */
+static void save_master(camera *c){
+    char prefix[PATH_MAX], buff[PATH_MAX];
+    int n = stack_count(c->stk);
+    uint64_t nrej = 0;
+    frame m;
+    if(!n) return;
+    product_frame(c, &m, n);
+    long size = (long)m.w * m.h;
+    m.cal = MALLOC(float, size);
+    TIMESTART(tc);
+    if(stack_combine(c->stk, m.cal, G->kappa, G->statthreads > 1 ? G->statthreads : 0, &nrej)){
+        /// "   "
+        WARNX(_("Can't combine frames"));
+        FREE(m.cal);
+        return;
+    }
+    TIMEEND(tc, n, PH_COMBINE);
+    double sum = 0., sum2 = 0.;
+    m.cmin = m.cmax = m.cal[0];
+    for(long i = 0; i < size; ++i){
+        float v = m.cal[i];
+        sum += v; sum2 += (double)v * v;
+        if(m.cmin > v) m.cmin = v;
+        if(m.cmax < v) m.cmax = v;
+    }
+    m.min = float2u16(m.cmin); m.max = float2u16(m.cmax);
+    m.avr = sum / size;
+    m.std = sqrt(fabs(sum2 / size - m.avr*m.avr));
+    camlabel(c);
+    /// " %d  (%s),  %lu \n"
+    printf(_("Stacked %d frames (%s), %lu values rejected\n"), n, stack_modename(stackmode), (unsigned long)nrej);
+    printf("avr = %.1f, std = %.1f, max = %.1f, min = %.1f\n", m.avr, m.std, m.cmax, m.cmin);
+    if(!mkname(prefix, "%s_%s", c->prefix, stack_modename(stackmode)) && !product_name(prefix, 0, buff)) product_saved(writefits_master(buff, &m, nrej), buff, n);
+    FREE(m.cal);
+}
+
+/**
+ * Save current co-add of camera as "<prefix>_coadd.fits"
+ * @param c    - camera
+ * @param snap - number of frames in snapshot (0 - final co-add)
+ */
+static void save_coadd(camera *c, long snap){
+    char prefix[PATH_MAX], buff[PATH_MAX];
+    long n = coadd_count(c->cad);
+    frame m;
+    if(!n) return;
+    product_frame(c, &m, (int)n);
+    long size = (long)m.w * m.h;
+    double *img = MALLOC(double, size);
+    if(coadd_get(c->cad, coaddmean, img)){
+        FREE(img);
+        return;
+    }
+    double sum = 0., sum2 = 0., min = img[0], max = img[0];
+    for(long i = 0; i < size; ++i){
+        double v = img[i];
+        sum += v; sum2 += v * v;
+        if(min > v) min = v;
+        if(max < v) max = v;
+    }
+    m.cmin = (float)min; m.cmax = (float)max;
+    m.min = float2u16(m.cmin); m.max = float2u16(m.cmax);
+    m.avr = sum / size;
+    m.std = sqrt(fabs(sum2 / size - m.avr*m.avr));
+    camlabel(c);
+    /// " %ld \n"
+    printf(_("Co-added %ld frames\n"), n);
+    printf("avr = %.1f, std = %.1f, max = %.1f, min = %.1f\n", m.avr, m.std, max, min);
+    if(!mkname(prefix, "%s_coadd", c->prefix) && !product_name(prefix, snap, buff)) product_saved(writefits_coadd(buff, &m, img), buff, (int)n);
     FREE(img);
+}
+
+/**
+ * Capture series of frames with current parameters by all opened cameras
+ * @return 1 if there's nothing to capture (no exposure time given)
+ */
+// autoguiding by first camera
+static int run_guide(){
+    camera *c = &cameras[0];
+    if(ncameras > 1)
+        /// "   %s"
+        WARNX(_("Guiding by camera %s only"), c->name);
+    if(setup_camera(c)) return 1;
+    guide_pars p = {.X0 = c->X0, .Y0 = c->Y0, .X1 = c->X1, .Y1 = c->Y1,
+        .hbin = G->hbin, .vbin = G->vbin, .exptime = c->exptime,
+        .box = G->guidebox > 0 ? G->guidebox : GUIDE_BOX,
+        .kp = G->guidekp > -1. ? G->guidekp : GUIDE_KP,
+        .ki = G->guideki > -1. ? G->guideki : GUIDE_KI,
+        .calpulse = G->guidecal > 0. ? G->guidecal : GUIDE_CALPULSE,
+        .maxpulse = G->guidemax > 0. ? G->guidemax : GUIDE_MAXPULSE,
+        .sigma = G->starsigma, .ncycles = G->guide,
+        .nthreads = G->statthreads > 1 ? G->statthreads : 0, .stop = &sigcaught};
+    if(G->guidelog){
+        if(!(p.log = fopen(G->guidelog, "w")))
+            /// "     %s"
+            WARN(_("Can't open guiding log %s"), G->guidelog);
+        else setvbuf(p.log, NULL, _IOLBF, 0);
+    }
+    int r = guide_run(c->cam, &p);
+    if(p.log) fclose(p.log);
+    check_signals();
+    return r;
+}
+
+static int run_series(){
+    long maxw = 0, maxh = 0;
+    int i, nothing = 0;
+    if(G->guide > -1) return run_guide();
+    for(i = 0; i < ncameras; ++i){
+        camera *c = &cameras[i];
+        nothing |= setup_camera(c);
+        if(c->w > maxw) maxw = c->w;
+        if(c->h > maxh) maxh = c->h;
+    }
+    if(nothing) return 1;
+    // maps of defects & masters are full frames (ROI is their window)
+    int dw, dh;
+    if(defects_size(&dw, &dh)){
+        for(i = 0; i < ncameras; ++i)
+            if(cameras[i].w != dw || cameras[i].h != dh)
+                /// "  %ldx%ld        %dx%d"
+                ERRX(_("Size of frames %ldx%ld differs from size of hot pixels map %dx%d"),
+                    cameras[i].w, cameras[i].h, dw, dh);
+    }
+    if(calib_active()){
+        int cw, ch;
+        calib_size(&cw, &ch);
+        if(nswbin > 1)
+            /// "     "
+            ERRX(_("Calibration isn't possible with several binnings"));
+        for(i = 0; i < ncameras; ++i){
+            long w = cameras[i].w, h = cameras[i].h;
+            if(nswbin){ w /= swbins[0].nx; h /= swbins[0].ny; }
+            if(w != cw || h != ch)
+                /// "  %ldx%ld      %dx%d"
+                ERRX(_("Size of frames %ldx%ld differs from size of master frames %dx%d"), w, h, cw, ch);
+        }
+    }
+    // buffers should fit first full frame, further frames have size of ROI
+    if(roitracking) for(i = 0; i < ncameras; ++i){
+        camera *c = &cameras[i];
+        int w = (roiw < c->AX1 - c->AX0) ? roiw : c->AX1 - c->AX0;
+        int h = (roih < c->AY1 - c->AY0) ? roih : c->AY1 - c->AY0;
+        c->w = atik_camera_imageWidth(c->cam, w, G->hbin);
+        c->h = atik_camera_imageHeight(c->cam, h, G->vbin);
+    }
+    if(stacking || coadding){
+        size_t mem = (size_t)(G->stackmem > -1 ? G->stackmem : STACK_MEMLIMIT) << 20;
+        if(nswbin > 1)
+            /// "      "
+            ERRX(_("Stacking isn't possible with several binnings"));
+        free_stacks();
+        for(i = 0; i < ncameras; ++i){
+            camera *c = &cameras[i];
+            long w = c->w, h = c->h;
+            if(nswbin){ w /= swbins[0].nx; h /= swbins[0].ny; }
+            if(stacking && !(c->stk = stack_new(stackmode, w, h, G->nframes, mem)))
+                /// "      "
+                ERRX(_("Can't allocate stack of frames"));
+            if(coadding && !(c->cad = coadd_new(w, h, G->nframes, G->coaddalign)))
+                /// "      "
+                ERRX(_("Can't allocate co-add of frames"));
+        }
+    }
+    if(nswbin) for(i = 0; i < ncameras; ++i){ // binning runs in capture thread of camera
+        swbin_freebuf(&cameras[i].binbuf);
+        cameras[i].binbuf = swbin_newbuf(swbins, nswbin, maxw);
+    }
+    // each camera holds its original frame while buffers for all products are reserved
+    if(nswbin > 1 && G->qlen < ncameras + nswbin + 1) G->qlen = ncameras + nswbin + 1;
+    // buffers of pool are common for all cameras, so they should fit the largest frame
+    if(framepool_init(G->qlen, maxw, maxh,
+            (G->hugepages ? POOL_HUGEPAGES : 0) | (G->mlock ? POOL_MLOCK : 0) |
+            (calib_active() ? POOL_FLOAT : 0)))
+        /// "     "
+        ERRX(_("Can't allocate frame buffers"));
+    DBG("allocated %dx2x%ld bytes", G->qlen, maxw * maxh);
+    if(G->live) for(i = 0; i < ncameras; ++i){
+        char name[BUFF_SIZ+1];
+        const char *slash = (*G->live == '/') ? "" : "/";
+        if(ncameras > 1) snprintf(name, BUFF_SIZ, "%s%s_cam%d", slash, G->live, i + 1);
+        else snprintf(name, BUFF_SIZ, "%s%s", slash, G->live);
+        if(!(cameras[i].live = liveview_open(name, maxw, maxh)))
+            /// "     %s   "
+            ERRX(_("Can't open shared memory %s for live view"), name);
+        /// "     %s"
+        info(_("Frames are published into shared memory %s"), name);
+    }
+    imstat_threads(G->statthreads);
+    #ifdef TIMING
+    if(timing_init(G->timinglog))
+        /// "     "
+        WARNX(_("Can't open timing log"));
+    #endif
+    if(writer_init(G->qlen, print_stat, save_frame, G->nwriters))
+        /// "    "
+        ERRX(_("Can't run writer thread"));
+    if(ncameras == 1) capture(&cameras[0]);
+    else{ // each camera exposes & reads out in its own thread
+        // signals should be processed only by main thread
+        sigset_t all, old;
+        sigfillset(&all);
+        sem_init(&capdone, 0, 0);
+        capfailed = 0;
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        for(i = 0; i < ncameras; ++i)
+            if(pthread_create(&cameras[i].thread, NULL, capture_thread, &cameras[i])){
+                pthread_sigmask(SIG_SETMASK, &old, NULL);
+                /// "    "
+                ERR(_("Can't run capture thread"));
+            }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        // sem_wait() (unlike pthread_join()) is interrupted by signals
+        for(i = 0; i < ncameras;){
+            if(sem_wait(&capdone) == 0) ++i;
+            else check_signals();
+        }
+        for(i = 0; i < ncameras; ++i) pthread_join(cameras[i].thread, NULL);
+        sem_destroy(&capdone);
+        if(capfailed){
+            capfailed = 0;
+            /// "  ,  "
+            ERRX(_("Capture failed, request aborted"));
+        }
+    }
+    writer_stop();
+    series_close();
+    for(i = 0; i < ncameras; ++i){
+        if(cameras[i].stk) save_master(&cameras[i]);
+        if(cameras[i].cad) save_coadd(&cameras[i], 0);
+    }
+    free_stacks();
+    close_live();
+    #ifdef TIMING
+    timing_finish();
+    #endif
+    framepool_free();
+    return 0;
+}
+
+/**
+ * Process request of client (in daemon mode)
+ * @param argc, argv - command line of client
+ * @return exit code for client
+ */
+static int daemon_request(int argc, char **argv){
+    if(sigsetjmp(reqjmp, 1)){ // error: free all resources of this request
+        inrequest = 0;
+        writer_stop();
+        series_close();
+        #ifdef TIMING
+        timing_finish();
+        #endif
+        framepool_free();
+        free_stacks();
+        close_live();
+        for(int i = 0; i < ncameras; ++i) reset_modes(&cameras[i]);
+        return 1;
+    }
+    G = parse_args(argc, argv);
+    inrequest = 1;
+    setup_output();
+    for(int i = 0; i < ncameras; ++i) reset_modes(&cameras[i]);
+    run_series();
+    inrequest = 0;
+    return 0;
+}
+
+int main(int argc, char **argv){
+    initial_setup();
+    // without SA_RESTART: blocking calls are interrupted to check signal
+    struct sigaction sa = {.sa_handler = sighandler};
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL); // kill (-15) - quit
+    sigaction(SIGHUP, &sa, NULL);  // hup - quit
+    sigaction(SIGINT, &sa, NULL);  // ctrl+C - quit
+    sigaction(SIGQUIT, &sa, NULL); // ctrl+\ - quit
+    signal(SIGTSTP, SIG_IGN); // ignore ctrl+Z
+
+    G = parse_args(argc, argv);
+    if(G->client) return client_run(G->client, argc, argv);
+    setup_output();
+    if(G->statbench){
+        imstat_bench(G->statthreads > 1 ? G->statthreads : (int)sysconf(_SC_NPROCESSORS_ONLN), !G->faststat);
+        return 0;
+    }
+    open_cameras();
+    if(G->daemon){
+        char *path = strdup(G->daemon);
+        mainthread = pthread_self();
+        if(G->temperature < 25.){ // keep CCD cooled
+            /// "  : %g  \n"
+            green(_("Set CCD temperature to %g degr.C\n"), G->temperature);
+            for(int i = 0; i < ncameras; ++i)
+                if(!atik_camera_setCooling(cameras[i].cam, G->temperature))
+                    WARNX(_("Error when trying to set cooling temperature %g"), G->temperature);
+        }
+        daemon_run(path, daemon_request, &sigcaught);
+        FREE(path);
+        check_signals();
+    }else if(run_series()) signals(0); // turn off all
+    close_cameras();
     atik_list_destroy();
+    calib_free();
+    defects_free();
     return 0;
 }
 
 #ifdef USERAW
-int writeraw(char *filename, int width, int height, void *data){
+int writeraw(char *filename, frame *f){
     int fd, size, err;
     if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC,
         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH )) == -1){
         WARN("open(%s) failed", filename);
         return -errno;
     }
-    size = width * height * sizeof(u_int16_t);
-    if ((err = write(fd, data, size)) != size){
+    size = f->w * f->h * sizeof(u_int16_t);
+    if ((err = write(fd, f->data, size)) != size){
         WARN("write() failed");
         err = -errno;
     }
@@ -400,15 +1437,51 @@ int writeraw(char *filename, int width, int height, void *data){
 #endif // USERAW
 
 
-int writefits(char *filename, int width, int height, void *data){
-    long naxes[2] = {width, height}, startTime;
-    double tmp = 0.0;
-    struct tm *tm_starttime;
+/**
+ * Set compression for next image HDU (if needed)
+ * @param fp - opened FITS file
+ * @return 0 if all OK
+ */
+int fits_setcompression(fitsfile *fp){
+    if(!fitscomp) return 0;
+    // tile-compressed image HDU (cfitsio default tiles)
+    TRYFITS(fits_set_compression_type, fp, fitscomp);
+    if(complevel > -1){
+        if(fitscomp == HCOMPRESS_1){
+            TRYFITS(fits_set_hcomp_scale, fp, (float)complevel);
+        }else if(fitscomp == GZIP_1){
+            TRYFITS(fits_set_compression_level, fp, complevel);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Set compression for next floating-point image HDU (if needed): cfitsio
+ * quantizes float tiles by default, so without quantization they are
+ * compressed losslessly by GZIP (with byte shuffling) whatever type is given
+ * @param fp - opened FITS file
+ * @return 0 if all OK
+ */
+int fits_setcompression_float(fitsfile *fp){
+    if(!fitscomp) return 0;
+    TRYFITS(fits_set_compression_type, fp, GZIP_2);
+    TRYFITS(fits_set_quantize_level, fp, 0.f);
+    if(complevel > -1 && fitscomp == GZIP_1)
+        TRYFITS(fits_set_compression_level, fp, complevel);
+    return 0;
+}
+
+/**
+ * Write keys common for all frames of series: detector, instrument etc
+ * @param fp       - opened FITS file
+ * @param filename - its name
+ * @param f        - frame (keys of camera captured it)
+ */
+void fits_common_keys(fitsfile *fp, char *filename, frame *f){
+    camera *c = f->cam;
     char buf[80];
-    time_t savetime = time(NULL);
-    fitsfile *fp;
-    TRYFITS(fits_create_file, &fp, filename);
-    TRYFITS(fits_create_img, fp, USHORT_IMG, 2, naxes);
+    if(*filename == '!') ++filename;
     // FILE / Input file original name
     WRITEKEY(fp, TSTRING, "FILE", filename, "Input file original name");
     // ORIGIN / organization responsible for the data
@@ -416,21 +1489,18 @@ int writefits(char *filename, int width, int height, void *data){
     // OBSERVAT / Observatory name
     WRITEKEY(fp, TSTRING, "OBSERVAT", "Special Astrophysical Observatory, Russia", "Observatory name");
     // DETECTOR / detector
-    WRITEKEY(fp, TSTRING, "DETECTOR", (char*)atik_camera_name(), "Detector model");
+    WRITEKEY(fp, TSTRING, "DETECTOR", (char*)c->name, "Detector model");
     // INSTRUME / Instrument
     if(G->instrument){
         WRITEKEY(fp, TSTRING, "INSTRUME", G->instrument, "Instrument");
     }else
         WRITEKEY(fp, TSTRING, "INSTRUME", "direct imaging", "Instrument");
-    snprintf(buf, 80, "%.g x %.g", pixX, pixY);
+    snprintf(buf, 80, "%.g x %.g", c->pixX, c->pixY);
     // PXSIZE / pixel size
     WRITEKEY(fp, TSTRING, "PXSIZE", buf, "Approx. pixel size (um)");
-    WRITEKEY(fp, TDOUBLE, "XPIXSZ", &pixX, "Pixel Size X (um)");
-    WRITEKEY(fp, TDOUBLE, "YPIXSZ", &pixY, "Pixel Size Y (um)");
-    // CRVAL1, CRVAL2 / Offset in X, Y
-    if(G->X0) WRITEKEY(fp, TINT, "X0", &G->X0, "Subframe left border");
-    if(G->Y0) WRITEKEY(fp, TINT, "Y0", &G->Y0, "Subframe upper border");
-    if(G->exptime < 2.*DBL_EPSILON) sprintf(buf, "bias");
+    WRITEKEY(fp, TDOUBLE, "XPIXSZ", &c->pixX, "Pixel Size X (um)");
+    WRITEKEY(fp, TDOUBLE, "YPIXSZ", &c->pixY, "Pixel Size Y (um)");
+    if(f->exptime < 2.*DBL_EPSILON) sprintf(buf, "bias");
     else if(G->dark) sprintf(buf, "dark");
     else if(G->objtype) strncpy(buf, G->objtype, 80);
     else sprintf(buf, "object");
@@ -442,27 +1512,74 @@ int writefits(char *filename, int width, int height, void *data){
     //itmp = G->fast ? 255 : 65535;
     itmp = 65535;
     WRITEKEY(fp, TINT, "DATAMAX", &itmp, "Max pixel value");
-    WRITEKEY(fp, TUSHORT, "STATMAX", &max, "Max data value");
-    WRITEKEY(fp, TUSHORT, "STATMIN", &min, "Min data value");
-    WRITEKEY(fp, TDOUBLE, "STATAVR", &avr, "Average data value");
-    WRITEKEY(fp, TDOUBLE, "STATSTD", &std, "Std. of data value");
-    WRITEKEY(fp, TDOUBLE, "TEMP0", &G->temperature, "Camera temperature at exp. start (degr C)");
-    if(t_int < 100.){
-        WRITEKEY(fp, TDOUBLE, "TEMP1", &t_int, "Camera temperature at exp. end (degr C)");
-        tmp = (G->temperature + t_int) / 2. + 273.15;
-    }else tmp = G->temperature + 273.15;
+}
+
+/**
+ * Write keys individual for each frame: statistics, temperature, time
+ * @param fp - opened FITS file
+ * @param f  - frame
+ */
+void fits_frame_keys(fitsfile *fp, frame *f){
+    long startTime;
+    double tmp = 0.0;
+    struct tm *tm_starttime;
+    char buf[80];
+    time_t savetime = time(NULL);
+    if(f->calibrated){ // real values of float image
+        WRITEKEY(fp, TFLOAT, "STATMAX", &f->cmax, "Max data value");
+        WRITEKEY(fp, TFLOAT, "STATMIN", &f->cmin, "Min data value");
+    }else{
+        WRITEKEY(fp, TUSHORT, "STATMAX", &f->max, "Max data value");
+        WRITEKEY(fp, TUSHORT, "STATMIN", &f->min, "Min data value");
+    }
+    WRITEKEY(fp, TDOUBLE, "STATAVR", &f->avr, "Average data value");
+    WRITEKEY(fp, TDOUBLE, "STATSTD", &f->std, "Std. of data value");
+    if(f->robust){
+        WRITEKEY(fp, TDOUBLE, "STATMED", &f->med, "Median data value");
+        WRITEKEY(fp, TDOUBLE, "STATP01", &f->p01, "1st percentile of data values");
+        WRITEKEY(fp, TDOUBLE, "STATP99", &f->p99, "99th percentile of data values");
+        WRITEKEY(fp, TDOUBLE, "STATMAD", &f->mad, "Median absolute deviation of data");
+    }
+    if(f->defects){
+        WRITEKEY(fp, TUINT, "NHOTPIX", &f->nhot, "Amount of hot pixels replaced");
+        if(G->cosmic) WRITEKEY(fp, TUINT, "NCOSMIC", &f->ncosmic, "Amount of cosmic ray pixels replaced");
+    }
+    if(f->autoexp){
+        WRITEKEY(fp, TDOUBLE, "AEXPTGT", &G->autoexp, "Target median level of auto exposure");
+        if(f->aexppred > -1.) WRITEKEY(fp, TDOUBLE, "AEXPPRED", &f->aexppred, "Predicted median level");
+        WRITEKEY(fp, TDOUBLE, "AEXPLVL", &f->aexplevel, "Achieved median level (by sample)");
+    }
+    if(f->stars){
+        WRITEKEY(fp, TINT, "NSTARS", &f->nstars, "Amount of stars found");
+        WRITEKEY(fp, TFLOAT, "FWHM", &f->fwhm, "Median FWHM of stars (pix)");
+        WRITEKEY(fp, TFLOAT, "HFD", &f->hfd, "Median half flux diameter of stars (pix)");
+    }
+    if(f->bin){
+        snprintf(buf, 80, "%d x %d", f->bin->nx, f->bin->ny);
+        WRITEKEY(fp, TSTRING, "SWBIN", buf, "Software binning (hbin x vbin)");
+        WRITEKEY(fp, TSTRING, "SWBINMOD", (char*)swbin_policyname(f->bin->policy), "Software binning mode");
+        WRITEKEY(fp, TUINT, "SWBINSAT", &f->binsat, "Amount of pixels saturated by binning");
+    }
+    // CRVAL1, CRVAL2 / Offset in X, Y (tracking ROI moves from frame to frame)
+    if(f->X0 || roitracking) WRITEKEY(fp, TINT, "X0", &f->X0, "Subframe left border");
+    if(f->Y0 || roitracking) WRITEKEY(fp, TINT, "Y0", &f->Y0, "Subframe upper border");
+    WRITEKEY(fp, TDOUBLE, "TEMP0", &f->temp0, "Camera temperature at exp. start (degr C)");
+    if(f->temp1 < 100.){
+        WRITEKEY(fp, TDOUBLE, "TEMP1", &f->temp1, "Camera temperature at exp. end (degr C)");
+        tmp = (f->temp0 + f->temp1) / 2. + 273.15;
+    }else tmp = f->temp0 + 273.15;
     // CAMTEMP / Camera temperature (K)
     WRITEKEY(fp, TDOUBLE, "CAMTEMP", &tmp, "Average camera temperature (K)");
-    tmp = (double)G->exptime;
+    tmp = f->exptime;
     // EXPTIME / actual exposition time (sec)
     WRITEKEY(fp, TDOUBLE, "EXPTIME", &tmp, "Actual exposition time (sec)");
     // DATE / Creation date (YYYY-MM-DDThh:mm:ss, UTC)
     strftime(buf, 80, "%Y-%m-%dT%H:%M:%S", gmtime(&savetime));
     WRITEKEY(fp, TSTRING, "DATE", buf, "Creation date (YYYY-MM-DDThh:mm:ss, UTC)");
-    startTime = (long)expStartsAt.tv_sec;
-    tm_starttime = localtime(&expStartsAt.tv_sec);
+    startTime = (long)f->expStartsAt.tv_sec;
+    tm_starttime = localtime(&f->expStartsAt.tv_sec);
     strftime(buf, 80, "exposition starts at %d/%m/%Y, %H:%M:%S (local)", tm_starttime);
-    tmp = startTime + (double)expStartsAt.tv_usec/1e6;
+    tmp = startTime + (double)f->expStartsAt.tv_usec/1e6;
     WRITEKEY(fp, TDOUBLE, "UNIXTIME", &tmp, buf);
     strftime(buf, 80, "%Y/%m/%d", tm_starttime);
     // DATE-OBS / DATE (YYYY/MM/DD) OF OBS.
@@ -470,6 +1587,14 @@ int writefits(char *filename, int width, int height, void *data){
     strftime(buf, 80, "%H:%M:%S", tm_starttime);
     // START / Measurement start time (local) (hh:mm:ss)
     WRITEKEY(fp, TSTRING, "START", buf, "Measurement start time (hh:mm:ss, local)");
+}
+
+/**
+ * Write keys with information about observation: object, observers etc
+ * @param fp - opened FITS file
+ */
+void fits_obs_keys(fitsfile *fp){
+    char buf[80];
     // OBJECT  / Object name
     if(G->objname){
         WRITEKEY(fp, TSTRING, "OBJECT", G->objname, "Object name");
@@ -491,17 +1616,176 @@ int writefits(char *filename, int width, int height, void *data){
     if(G->author){
         WRITEKEY(fp, TSTRING, "AUTHOR", G->author, "Author of the program");
     }
+}
+
+/**
+ * Create image HDU with all keys of single frame
+ * @param fp       - opened FITS file
+ * @param filename - its name
+ * @param f        - frame
+ * @param naxes    - image size (NAXIS1, NAXIS2)
+ * @return 0 if all OK
+ */
+int fits_write_header(fitsfile *fp, char *filename, frame *f, long *naxes){
+    return fits_image_header(fp, filename, f, 2, naxes, USHORT_IMG);
+}
+
+/**
+ * Create image HDU of given type with all keys of frame
+ * @param fp       - opened FITS file
+ * @param filename - its name
+ * @param f        - frame
+ * @param naxis    - amount of axes (2 for image of colour filter array)
+ * @param naxes    - image size (NAXIS1, NAXIS2[, NAXIS3])
+ * @param bitpix   - type of image
+ * @return 0 if all OK
+ */
+static int fits_image_header(fitsfile *fp, char *filename, frame *f, int naxis, long *naxes, int bitpix){
+    TRYFITS(fits_create_img, fp, bitpix, naxis, naxes);
+    fits_common_keys(fp, filename, f);
+    if(naxis == 2 && f->cam->bayer != BAYER_NONE){ // pattern is given for first pixel of frame
+        int zero = 0;
+        WRITEKEY(fp, TSTRING, "BAYERPAT", (char*)bayer_name(f->cam->bayer), "Bayer colour filter array");
+        WRITEKEY(fp, TINT, "XBAYROFF", &zero, "X offset of Bayer array");
+        WRITEKEY(fp, TINT, "YBAYROFF", &zero, "Y offset of Bayer array");
+    }
+    fits_frame_keys(fp, f);
+    fits_obs_keys(fp);
     #ifdef USE_BTA
     write_bta_data(fp);
     #endif
-    TRYFITS(fits_write_img, fp, TUSHORT, 1, width * height, data);
+    return 0;
+}
+
+int writefits(char *filename, frame *f){
+    long naxes[2] = {f->w, f->h};
+    fitsfile *fp;
+    TIMESTART(th);
+    TRYFITS(fits_create_file, &fp, filename);
+    if(fits_setcompression(fp)) return -1;
+    if(fits_write_header(fp, filename, f, naxes)) return -1;
+    TIMEEND(th, f->num, PH_HEADER);
+    TIMESTART(tw);
+    TRYFITS(fits_write_img, fp, TUSHORT, 1, f->w * f->h, f->data);
+    TRYFITS(fits_close_file, fp);
+    TIMEEND(tw, f->num, PH_WRITE);
+    return 0;
+}
+
+/**
+ * Write calibrated frame: float or scaled 16-bit integer
+ * @param filename - file name
+ * @param f        - frame
+ * @return 0 if all OK
+ */
+static int writefits_calib(char *filename, frame *f){
+    long naxes[2] = {f->w, f->h};
+    fitsfile *fp;
+    TIMESTART(th);
+    TRYFITS(fits_create_file, &fp, filename);
+    if(calint16 ? fits_setcompression(fp) : fits_setcompression_float(fp)) return -1;
+    if(fits_image_header(fp, filename, f, 2, naxes, calint16 ? SHORT_IMG : FLOAT_IMG)) return -1;
+    if(G->bias) WRITEKEY(fp, TSTRING, "BIASFILE", G->bias, "Master bias");
+    if(G->mdark) WRITEKEY(fp, TSTRING, "DARKFILE", G->mdark, "Master dark");
+    if(G->flat) WRITEKEY(fp, TSTRING, "FLATFILE", G->flat, "Master flat");
+    if(calint16){ // full range of values is mapped to 16 bits
+        double bzero = ((double)f->cmax + f->cmin) / 2., bscale = ((double)f->cmax - f->cmin) / 65534.;
+        if(bscale <= 0.) bscale = 1.;
+        WRITEKEY(fp, TDOUBLE, "BZERO", &bzero, "Physical value = BZERO + BSCALE * array_value");
+        WRITEKEY(fp, TDOUBLE, "BSCALE", &bscale, "Physical value = BZERO + BSCALE * array_value");
+        TRYFITS(fits_set_bscale, fp, bscale, bzero);
+    }
+    TIMEEND(th, f->num, PH_HEADER);
+    TIMESTART(tw);
+    TRYFITS(fits_write_img, fp, TFLOAT, 1, f->w * f->h, f->cal);
+    TRYFITS(fits_close_file, fp);
+    TIMEEND(tw, f->num, PH_WRITE);
+    return 0;
+}
+
+/**
+ * Write master frame (float)
+ * @param filename - file name
+ * @param f        - frame (f->num is amount of stacked frames)
+ * @param nrej     - amount of values rejected by sigma-clipping
+ * @return 0 if all OK
+ */
+static int writefits_master(char *filename, frame *f, uint64_t nrej){
+    long naxes[2] = {f->w, f->h};
+    fitsfile *fp;
+    TIMESTART(th);
+    TRYFITS(fits_create_file, &fp, filename);
+    if(fits_setcompression_float(fp)) return -1;
+    if(fits_image_header(fp, filename, f, 2, naxes, FLOAT_IMG)) return -1;
+    WRITEKEY(fp, TINT, "NCOMBINE", &f->num, "Number of frames combined");
+    WRITEKEY(fp, TSTRING, "COMBMODE", (char*)stack_modename(stackmode), "Mode of frames combination");
+    if(stackmode == STACK_SIGCLIP){
+        double kappa = G->kappa > 0. ? G->kappa : STACK_KAPPA;
+        long rej = (long)nrej;
+        WRITEKEY(fp, TDOUBLE, "CLIPSIG", &kappa, "Sigma-clipping threshold (sigmas)");
+        WRITEKEY(fp, TLONG, "NREJECT", &rej, "Number of values rejected by sigma-clipping");
+    }
+    TIMEEND(th, f->num, PH_HEADER);
+    TIMESTART(tw);
+    TRYFITS(fits_write_img, fp, TFLOAT, 1, f->w * f->h, f->cal);
+    TRYFITS(fits_close_file, fp);
+    TIMEEND(tw, f->num, PH_WRITE);
+    return 0;
+}
+
+/**
+ * Write co-add: sum (double, exact for integers) or mean (float)
+ * @param filename - file name
+ * @param f        - frame (f->num is amount of co-added frames)
+ * @param img      - image
+ * @return 0 if all OK
+ */
+static int writefits_coadd(char *filename, frame *f, double *img){
+    long naxes[2] = {f->w, f->h};
+    fitsfile *fp;
+    int align = G->coaddalign ? 1 : 0;
+    TIMESTART(th);
+    TRYFITS(fits_create_file, &fp, filename);
+    if(fits_setcompression_float(fp)) return -1;
+    if(fits_image_header(fp, filename, f, 2, naxes, coaddmean ? FLOAT_IMG : DOUBLE_IMG)) return -1;
+    WRITEKEY(fp, TINT, "NCOMBINE", &f->num, "Number of frames combined");
+    WRITEKEY(fp, TSTRING, "COMBMODE", coaddmean ? "mean" : "sum", "Mode of frames combination");
+    WRITEKEY(fp, TLOGICAL, "COADDALN", &align, "Frames are aligned by centroid");
+    TIMEEND(th, f->num, PH_HEADER);
+    TIMESTART(tw);
+    TRYFITS(fits_write_img, fp, TDOUBLE, 1, f->w * f->h, img);
+    TRYFITS(fits_close_file, fp);
+    TIMEEND(tw, f->num, PH_WRITE);
+    return 0;
+}
+
+/**
+ * Write demosaiced colour frame as cube of planes R, G, B
+ * @param filename - file name
+ * @param f        - frame with f->rgb
+ * @return 0 if all OK
+ */
+static int writefits_rgb(char *filename, frame *f){
+    long naxes[3] = {f->w, f->h, 3};
+    fitsfile *fp;
+    TIMESTART(th);
+    TRYFITS(fits_create_file, &fp, filename);
+    if(fits_setcompression(fp)) return -1;
+    if(fits_image_header(fp, filename, f, 3, naxes, USHORT_IMG)) return -1;
+    WRITEKEY(fp, TSTRING, "CTYPE3", "RGB", "Colour planes: red, green, blue");
+    WRITEKEY(fp, TSTRING, "BAYERSRC", (char*)bayer_name(f->cam->bayer), "Bayer colour filter array of raw frame");
+    WRITEKEY(fp, TSTRING, "DEMOSAIC", (char*)demosaic_name(dmode), "Demosaicing method");
+    TIMEEND(th, f->num, PH_HEADER);
+    TIMESTART(tw);
+    TRYFITS(fits_write_img, fp, TUSHORT, 1, 3 * f->w * f->h, f->rgb);
     TRYFITS(fits_close_file, fp);
+    TIMEEND(tw, f->num, PH_WRITE);
     return 0;
 }
 
 #ifdef USEPNG
-int writepng(char *filename, int width, int height, void *data){
-    int err;
+int writepng(char *filename, frame *f){
+    int err, width = f->w, height = f->h;
     FILE *fp = NULL;
     png_structp pngptr = NULL;
     png_infop infoptr = NULL;
@@ -521,12 +1805,34 @@ int writepng(char *filename, int width, int height, void *data){
     }
     png_init_io(pngptr, fp);
     png_set_compression_level(pngptr, 6);
+    if(f->rgb){ // 8-bit preview of colour frame stretched by levels of raw one
+        double lo = f->robust ? f->p01 : f->min, hi = f->robust ? f->p99 : f->max;
+        double scale = (hi > lo) ? 255. / (hi - lo) : 1.;
+        size_t npix = (size_t)width * height;
+        uint8_t *rgbrow = MALLOC(uint8_t, 3 * width);
+        png_set_IHDR(pngptr, infoptr, width, height, 8, PNG_COLOR_TYPE_RGB,
+                    PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                    PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(pngptr, infoptr);
+        for(int y = 0; y < height; ++y){
+            const uint16_t *planes = f->rgb + (size_t)y * width;
+            for(int x = 0; x < width; ++x) for(int c = 0; c < 3; ++c){
+                double v = (planes[c * npix + x] - lo) * scale;
+                rgbrow[3 * x + c] = (v <= 0.) ? 0 : (v >= 255.) ? 255 : (uint8_t)(v + 0.5);
+            }
+            png_write_row(pngptr, rgbrow);
+        }
+        FREE(rgbrow);
+        png_write_end(pngptr, infoptr);
+        err = 0;
+        goto done;
+    }
     png_set_IHDR(pngptr, infoptr, width, height, 16, PNG_COLOR_TYPE_GRAY,
                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
                 PNG_FILTER_TYPE_DEFAULT);
     png_write_info(pngptr, infoptr);
     png_set_swap(pngptr);
-    for(row = data; height > 0; row += width * sizeof(u_int16_t), height--)
+    for(row = f->data; height > 0; row += width * sizeof(u_int16_t), height--)
         png_write_row(pngptr, row);
     png_write_end(pngptr, infoptr);
     err = 0;
@@ -537,24 +1843,64 @@ int writepng(char *filename, int width, int height, void *data){
 }
 #endif /* USEPNG */
 
-void print_stat(u_int16_t *img, long size){
-    long i, Noverld = 0L;
-    double pv, sum=0., sum2=0., sz = (double)size;
-    u_int16_t *ptr = img, val;
-    max = 0; min = 65535;
-    for(i = 0; i < size; i++, ptr++){
-        val = *ptr;
-        pv = (double) val;
-        sum += pv;
-        sum2 += (pv * pv);
-        if(max < val) max = val;
-        if(min > val) min = val;
-        if(val >= 65530) Noverld++;
+void print_stat(frame *f){
+    TIMESTART(ts);
+    static uint32_t *hist = NULL;
+    long size = f->w * f->h;
+    double sz = (double)size;
+    imstat_acc st;
+    calib_acc ca;
+    uint64_t novr;
+    int x0, y0;
+    if(!G->faststat && !hist) hist = MALLOC(uint32_t, IMSTAT_NBINS);
+    frame_offset(f, &x0, &y0);
+    // calibration gives statistics of calibrated image by the same pass
+    f->calibrated = (f->cal && calib_active() &&
+        !calib_apply(f->data, x0, y0, f->w, f->h, f->exptime, f->cal, &ca, G->faststat ? NULL : hist));
+    if(f->calibrated){
+        f->cmin = ca.min; f->cmax = ca.max;
+        f->min = float2u16(ca.min);
+        f->max = float2u16(ca.max);
+        f->avr = ca.sum/sz;
+        f->std = sqrt(fabs(ca.sum2/sz - f->avr*f->avr));
+        novr = ca.Noverld;
+    }else{
+        imstat_calc(f->data, f->w, f->h, &st, G->faststat ? NULL : hist);
+        f->max = st.max; f->min = st.min;
+        f->avr = (double)st.sum/sz;
+        f->std = sqrt(fabs((double)st.sum2/sz - f->avr*f->avr));
+        novr = st.Noverld;
     }
+    camlabel(f->cam);
     //   :\n
     printf(_("Image stat:\n"));
-    avr = sum/sz;
-    printf("avr = %.1f, std = %.1f, Noverload = %ld\n", avr,
-        std = sqrt(fabs(sum2/sz - avr*avr)), Noverld);
-    printf("max = %u, min = %u, size = %ld\n", max, min, size);
+    printf("avr = %.1f, std = %.1f, Noverload = %ld\n", f->avr, f->std, (long)novr);
+    printf("max = %u, min = %u, size = %ld\n", f->max, f->min, size);
+    /// " : %u,  : %u\n"
+    if(f->defects) printf(_("hot pixels: %u, cosmic rays: %u\n"), f->nhot, f->ncosmic);
+    f->robust = !G->faststat;
+    if(f->robust){
+        imstat_robustval r;
+        imstat_robust(hist, size, &r);
+        if(f->calibrated){ // bins of calibrated image histogram -> values
+            r.median = ca.hzero + r.median * ca.hscale;
+            r.p01 = ca.hzero + r.p01 * ca.hscale;
+            r.p99 = ca.hzero + r.p99 * ca.hscale;
+            r.mad *= ca.hscale;
+        }
+        f->med = r.median; f->p01 = r.p01; f->p99 = r.p99; f->mad = r.mad;
+        printf("median = %.1f, p01 = %.1f, p99 = %.1f, MAD = %.1f\n", f->med, f->p01, f->p99, f->mad);
+    }
+    TIMEEND(ts, f->num, PH_STAT);
+    if(G->stars){
+        stars_stat ss;
+        TIMESTART(tf);
+        f->stars = !stars_find(f->data, f->w, f->h, G->starsigma, G->statthreads > 1 ? G->statthreads : 0, &ss, NULL);
+        TIMEEND(tf, f->num, PH_STARS);
+        if(f->stars){
+            f->nstars = ss.nstars; f->fwhm = ss.fwhm; f->hfd = ss.hfd;
+            printf("stars = %d, FWHM = %.2f, HFD = %.2f, measured = %d\n", f->nstars, f->fwhm, f->hfd, ss.nmeasured);
+        }
+    }
+    fflush(stdout); // for scripts reading output through pipe
 }
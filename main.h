@@ -24,15 +24,80 @@
 #ifndef __MAIN_H__
 #define __MAIN_H__
 
+#include <fitsio.h>
+#include <pthread.h>
 #include "usefull_macros.h"
 #include "cmdlnopts.h"
+#include "atikcore.h"
+#include "swbin.h"
+#include "stack.h"
+#include "coadd.h"
+#include "bayer.h"
+#include "stars.h"
+#include "guide.h"
+#include "autoexp.h"
+#include "liveview.h"
 
 #ifdef USEPNG
 #include <png.h>
 #endif // USEPNG
 
+// opened camera and geometry of its frames
+typedef struct{
+    atikcam *cam;               // camera handle
+    const char *name;           // camera name
+    double pixX, pixY;          // pixel size in um
+    char *prefix;               // prefix of output files
+    int X0, Y0, X1, Y1;         // part of sensor to read
+    long w, h;                  // image size
+    double exptime;             // exposition time (s)
+    double t_int;               // CCD temperature @exposition end
+    int AX0, AY0, AX1, AY1;     // area where tracking ROI moves
+    autoexp aexp;               // controller of auto exposure
+    liveview *live;             // live view of frames (NULL if there's no)
+    swbin_buf *binbuf;          // buffers of software binning (NULL if there's no)
+    bayer_pattern cfa;          // colour filter array of sensor
+    bayer_pattern bayer;        // colour filter array of frames (BAYER_NONE - monochrome)
+    stack *stk;                 // stack of frames (NULL if series isn't stacked)
+    coadd *cad;                 // co-add of frames (NULL if series isn't co-added)
+    struct timeval stkstart;    // exposition start of first stacked (co-added) frame
+    double stktemp0;            // CCD temperature @ its start
+    pthread_t thread;           // capture thread (when several cameras work simultaneously)
+} camera;
+
+// captured frame with all its own data (filled in capture thread, saved in writer thread)
+typedef struct{
+    uint16_t *data;             // image data
+    int refcnt;                 // amount of users (buffer is free when zero)
+    int w, h;                   // image width & height
+    int num;                    // frame number in series
+    camera *cam;                // camera captured this frame
+    const swbin *bin;           // software binning applied (NULL - original frame)
+    uint32_t binsat;            // amount of pixels saturated by binning
+    int defects;                // hot pixels & cosmic rays are corrected
+    uint32_t nhot, ncosmic;     // amount of corrected hot pixels & cosmic rays
+    float *cal;                 // buffer for calibrated image (NULL if there's no)
+    int calibrated;             // `cal` contains calibrated image
+    float cmin, cmax;           // min/max values of calibrated image
+    uint16_t *rgb;              // demosaiced planes R, G, B (while frame is saved) or NULL
+    int X0, Y0;                 // upper left corner of frame on sensor
+    double exptime;             // exposure time (s)
+    int autoexp;                // exposure time is set automatically
+    double aexppred, aexplevel; // predicted (<0 - unknown) & achieved median level
+    int stars;                  // stars are measured
+    int nstars;                 // amount of stars found
+    float fwhm, hfd;            // median FWHM & HFD of unsaturated ones (pix)
+    struct timeval expStartsAt; // exposition start time
+    double temp0;               // CCD temperature @ exposition start
+    double temp1;               // CCD temperature @ exposition end (>100 if unknown)
+    uint16_t max, min;          // max/min values for given image
+    double avr, std;            // stat values
+    int robust;                 // robust statistics calculated
+    double med, p01, p99, mad;  // median, 1st & 99th percentiles, median absolute deviation
+} frame;
+
 #ifdef USERAW
-int writeraw(char *filename, int width, int height, void *data);
+int writeraw(char *filename, frame *f);
 #endif // USERAW
 
 #define TRYFITS(f, ...)                     \
@@ -47,7 +112,13 @@ do{ int status = 0;                             \
     fits_write_key(__VA_ARGS__, &status);       \
     if(status) fits_report_error(stderr, status);\
 }while(0)
-int writefits(char *filename, int width, int height, void *data);
+int fits_setcompression(fitsfile *fp);
+int fits_setcompression_float(fitsfile *fp);
+void fits_common_keys(fitsfile *fp, char *filename, frame *f);
+void fits_frame_keys(fitsfile *fp, frame *f);
+void fits_obs_keys(fitsfile *fp);
+int fits_write_header(fitsfile *fp, char *filename, frame *f, long *naxes);
+int writefits(char *filename, frame *f);
 
 
 #endif // __MAIN_H__
@@ -269,6 +269,9 @@ void parseargs(int *argc, char ***argv, myoption *options){
             prevshrt = shortlist[i];
         }
     }
+    for(i = 0; i < optsize; ++i) free(longlist[i]);
+    FREE(longlist);
+    FREE(shortlist);
 #endif
     // now we have both long_options & short_options and can parse `getopt_long`
     while(1){
@@ -326,6 +329,8 @@ void parseargs(int *argc, char ***argv, myoption *options){
             showhelp(optind, options);
         }
     }
+    free(short_options);
+    free(long_options);
     *argc -= optind;
     *argv += optind;
 }
@@ -0,0 +1,150 @@
+/*
+ * seqname.c - allocation of sequential file names
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Names "prefix_NNNN.ext": directory is scanned only once for each extension
+ * to find the greatest existing number, next names are given incrementally
+ * and created with O_EXCL, so concurrent writers (threads or other processes)
+ * never get the same name. Amount of digits is the minimal width of number,
+ * larger numbers simply become longer. Table of counters grows as needed and
+ * is cleared before each series (directory could be changed between them).
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <limits.h>
+#include "seqname.h"
+#include "usefull_macros.h"
+
+// initial size of counters table
+#define NCOUNTERS   (8)
+
+typedef struct{
+    char *prefix;   // prefix of file names
+    char *ext;      // extension
+    long next;      // next number to try
+} seqcounter;
+
+static seqcounter *counters = NULL;
+static int ncounters = 0, szcounters = 0;
+static int padding = 4;
+static pthread_mutex_t seqmutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Set minimal amount of digits in file number
+ * @param width - zero padding width (1..18)
+ */
+void seqname_padding(int width){
+    if(width < 1) width = 1;
+    if(width > 18) width = 18;
+    padding = width;
+}
+
+/**
+ * Forget all counters (directories will be scanned again)
+ */
+void seqname_reset(){
+    pthread_mutex_lock(&seqmutex);
+    for(int i = 0; i < ncounters; ++i){
+        FREE(counters[i].prefix);
+        FREE(counters[i].ext);
+    }
+    ncounters = 0;
+    pthread_mutex_unlock(&seqmutex);
+}
+
+// find greatest number of existing files "prefix_NNN.ext"
+static long scan_dir(const char *prefix, const char *ext){
+    char dir[PATH_MAX];
+    const char *base = strrchr(prefix, '/');
+    if(base){
+        size_t l = base - prefix;
+        if(l == 0) l = 1; // root directory
+        if(l >= PATH_MAX) return 0;
+        memcpy(dir, prefix, l);
+        dir[l] = 0;
+        ++base;
+    }else{
+        strcpy(dir, ".");
+        base = prefix;
+    }
+    DIR *d = opendir(dir);
+    if(!d) return 0;
+    size_t blen = strlen(base);
+    long max = 0;
+    struct dirent *de;
+    while((de = readdir(d))){
+        const char *n = de->d_name;
+        if(strncmp(n, base, blen) || n[blen] != '_') continue;
+        n += blen + 1;
+        if(*n < '0' || *n > '9') continue;
+        char *eptr;
+        long num = strtol(n, &eptr, 10);
+        if(*eptr != '.' || strcmp(eptr + 1, ext)) continue;
+        if(num > max) max = num;
+    }
+    closedir(d);
+    DBG("max number of %s_*.%s is %ld", prefix, ext, max);
+    return max;
+}
+
+static seqcounter *get_counter(const char *prefix, const char *ext){
+    for(int i = 0; i < ncounters; ++i)
+        if(!strcmp(counters[i].ext, ext) && !strcmp(counters[i].prefix, prefix))
+            return &counters[i];
+    if(ncounters == szcounters){
+        szcounters = szcounters ? szcounters * 2 : NCOUNTERS;
+        counters = realloc(counters, szcounters * sizeof(seqcounter));
+        if(!counters) ERR("realloc()");
+    }
+    seqcounter *c = &counters[ncounters++];
+    c->prefix = strdup(prefix);
+    c->ext = strdup(ext);
+    c->next = scan_dir(prefix, ext) + 1;
+    return c;
+}
+
+/**
+ * Create new file "prefix_NNNN.ext" with next free number
+ * @param prefix - prefix of file name (could contain path)
+ * @param ext    - file extension
+ * @param buf    - (o) buffer for file name
+ * @param len    - its length
+ * @return file descriptor (opened for writing) or -1 if failed
+ */
+int seqname_open(const char *prefix, const char *ext, char *buf, size_t len){
+    int fd = -1;
+    pthread_mutex_lock(&seqmutex);
+    seqcounter *c = get_counter(prefix, ext);
+    while(c){
+        int l = snprintf(buf, len, "%s_%0*ld.%s", prefix, padding, c->next, ext);
+        if(l < 1 || (size_t)l >= len) break;
+        fd = open(buf, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if(fd > -1){
+            ++c->next;
+            break;
+        }
+        if(errno != EEXIST) break;
+        ++c->next; // created by someone else after scanning
+    }
+    pthread_mutex_unlock(&seqmutex);
+    return fd;
+}
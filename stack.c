@@ -0,0 +1,320 @@
+/*
+ * stack.c - stacking of frame series into master frame
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Frames of series are accumulated as they are captured. For mean only sums of
+ * pixels are kept (32 bits are enough for STACK_MAXFRAMES), median and
+ * sigma-clipping need all values, so frames are copied into planes of one
+ * mapping: anonymous memory for stacks up to given limit, else temporary file
+ * (unlinked at once), so resident memory is bounded by page cache. Combination
+ * goes by tiles: values of each pixel of tile are gathered together (tile of
+ * all planes fits L2 cache), then each pixel is processed in its contiguous
+ * array. Tiles are shared between threads by atomic counter.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/mman.h>
+#include "stack.h"
+#include "imstat.h"
+#include "usefull_macros.h"
+
+// bytes of tile of all planes (gathered values)
+#define TILE_BYTES      (262144)
+// min amount of pixels in tile (to read planes by large enough pieces)
+#define TILE_MINPIX     (512)
+// max amount of sigma-clipping iterations
+#define SIGCLIP_MAXITER (10)
+
+struct stack{
+    stack_mode mode;
+    int w, h, nmax;
+    size_t npix;            // pixels in frame
+    int n;                  // amount of frames added
+    uint16_t *planes;       // frames (median & sigclip)
+    size_t mapsz;           // size of `planes` mapping
+    uint32_t *sum;          // sums of pixels (mean)
+    pthread_mutex_t mutex;
+};
+
+static const char *modenames[] = {
+    [STACK_MEAN] = "mean", [STACK_MEDIAN] = "median", [STACK_SIGCLIP] = "sigclip"
+};
+
+const char *stack_modename(stack_mode mode){
+    if(mode < STACK_MEAN || mode > STACK_SIGCLIP) return "unknown";
+    return modenames[mode];
+}
+
+/**
+ * Parse stacking mode
+ * @param str  - "mean", "median" or "sigclip"
+ * @param mode - (o) mode
+ * @return 0 if all OK
+ */
+int stack_parse(const char *str, stack_mode *mode){
+    if(!str) return 1;
+    for(int i = STACK_MEAN; i <= STACK_SIGCLIP; ++i)
+        if(strcasecmp(str, modenames[i]) == 0){
+            *mode = (stack_mode)i;
+            return 0;
+        }
+    return 1;
+}
+
+// map storage of planes: in RAM or in temporary file
+static uint16_t *map_planes(size_t sz, size_t memlimit){
+    void *ptr;
+    if(sz <= memlimit){
+        ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(ptr == MAP_FAILED){
+            WARN("mmap()");
+            return NULL;
+        }
+        return (uint16_t*)ptr;
+    }
+    char name[PATH_MAX];
+    const char *dir = getenv("TMPDIR");
+    if(!dir || !*dir) dir = "/tmp";
+    snprintf(name, PATH_MAX, "%s/atikstackXXXXXX", dir);
+    int fd = mkstemp(name);
+    if(fd < 0){
+        WARN("mkstemp(%s)", name);
+        return NULL;
+    }
+    unlink(name); // file will be removed after munmap()
+    DBG("stack of %zd bytes spilled to %s", sz, name);
+    if(ftruncate(fd, (off_t)sz)){
+        WARN("ftruncate()");
+        close(fd);
+        return NULL;
+    }
+    ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED){
+        WARN("mmap()");
+        return NULL;
+    }
+    return (uint16_t*)ptr;
+}
+
+/**
+ * Create new stack
+ * @param mode     - stacking mode
+ * @param w, h     - size of frames
+ * @param nmax     - max amount of frames
+ * @param memlimit - max size of frames stored in RAM (bytes)
+ * @return stack or NULL if failed
+ */
+stack *stack_new(stack_mode mode, int w, int h, int nmax, size_t memlimit){
+    if(w < 1 || h < 1 || nmax < 1 || nmax > STACK_MAXFRAMES) return NULL;
+    if(mode < STACK_MEAN || mode > STACK_SIGCLIP) return NULL;
+    stack *s = MALLOC(stack, 1);
+    s->mode = mode;
+    s->w = w; s->h = h; s->nmax = nmax;
+    s->npix = (size_t)w * h;
+    if(mode == STACK_MEAN) s->sum = MALLOC(uint32_t, s->npix);
+    else{
+        s->mapsz = s->npix * nmax * sizeof(uint16_t);
+        if(!(s->planes = map_planes(s->mapsz, memlimit))){
+            FREE(s);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&s->mutex, NULL);
+    return s;
+}
+
+void stack_free(stack **s){
+    if(!s || !*s) return;
+    stack *st = *s;
+    if(st->planes) munmap(st->planes, st->mapsz);
+    FREE(st->sum);
+    pthread_mutex_destroy(&st->mutex);
+    FREE(*s);
+}
+
+/**
+ * Add frame to stack (could be called from several threads)
+ * @param s    - stack
+ * @param data - image
+ * @param w, h - its size
+ * @return 0 if all OK
+ */
+int stack_add(stack *s, const uint16_t *data, int w, int h){
+    if(!s || w != s->w || h != s->h) return 1;
+    pthread_mutex_lock(&s->mutex);
+    if(s->n == s->nmax){
+        pthread_mutex_unlock(&s->mutex);
+        return 1;
+    }
+    int idx = s->n++;
+    if(s->sum){
+        uint32_t *sum = s->sum;
+        for(size_t i = 0; i < s->npix; ++i) sum[i] += data[i];
+    }
+    pthread_mutex_unlock(&s->mutex);
+    // each frame has its own plane, so copying needs no lock
+    if(s->planes) memcpy(s->planes + (size_t)idx * s->npix, data, s->npix * sizeof(uint16_t));
+    return 0;
+}
+
+int stack_count(stack *s){
+    if(!s) return 0;
+    return s->n;
+}
+
+static float median(uint16_t *v, int n){
+    int k = n / 2;
+    float med = imstat_select(v, n, k);
+    if(!(n & 1)){ // other central value is max of lower part
+        uint16_t lo = v[0];
+        for(int i = 1; i < k; ++i) if(lo < v[i]) lo = v[i];
+        med = (med + lo) / 2.f;
+    }
+    return med;
+}
+
+static void shellsort(uint16_t *v, int n){
+    static const int gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+    for(int g = 0; g < (int)(sizeof(gaps)/sizeof(int)); ++g){
+        int gap = gaps[g];
+        for(int i = gap; i < n; ++i){
+            uint16_t x = v[i];
+            int j = i;
+            for(; j >= gap && v[j - gap] > x; j -= gap) v[j] = v[j - gap];
+            v[j] = x;
+        }
+    }
+}
+
+/**
+ * Sigma-clipped mean: values out of median +- kappa*std are rejected until
+ * nothing changes; sorted array allows to reject by moving its borders
+ * @param v     - values (will be sorted)
+ * @param n     - their amount
+ * @param kappa - threshold
+ * @param nrej  - (io) counter of rejected values
+ * @return mean of values left
+ */
+static float sigclip(uint16_t *v, int n, double kappa, uint64_t *nrej){
+    int lo = 0, hi = n; // values left: [lo, hi)
+    shellsort(v, n);
+    for(int iter = 0; iter < SIGCLIP_MAXITER && hi - lo > 2; ++iter){
+        int m = hi - lo, c = lo + m / 2;
+        double med = (m & 1) ? v[c] : (v[c - 1] + v[c]) / 2.;
+        double s = 0., s2 = 0.;
+        for(int i = lo; i < hi; ++i){
+            s += v[i];
+            s2 += (double)v[i] * v[i];
+        }
+        double var = (s2 - s * s / m) / (m - 1);
+        if(var <= 0.) break;
+        double d = kappa * sqrt(var);
+        int l = lo, h = hi;
+        while(l < h && v[l] < med - d) ++l;
+        while(h > l && v[h - 1] > med + d) --h;
+        if(l == lo && h == hi) break;
+        lo = l; hi = h;
+    }
+    *nrej += n - (hi - lo);
+    double s = 0.;
+    for(int i = lo; i < hi; ++i) s += v[i];
+    return (float)(s / (hi - lo));
+}
+
+typedef struct{
+    stack *s;
+    float *out;
+    double kappa;
+    size_t tile, ntiles;    // pixels in tile & amount of tiles
+    size_t next;            // next tile to process
+    uint64_t nrej;          // amount of rejected values
+} combjob;
+
+static void *combine_worker(void *arg){
+    combjob *job = (combjob*)arg;
+    stack *s = job->s;
+    int N = s->n;
+    uint16_t *buf = MALLOC(uint16_t, job->tile * N);
+    uint64_t nrej = 0;
+    size_t t;
+    while((t = __sync_fetch_and_add(&job->next, 1)) < job->ntiles){
+        size_t p0 = t * job->tile, np = s->npix - p0;
+        if(np > job->tile) np = job->tile;
+        // gather: values of each pixel become contiguous
+        for(int k = 0; k < N; ++k){
+            const uint16_t *src = s->planes + (size_t)k * s->npix + p0;
+            uint16_t *dst = buf + k;
+            for(size_t p = 0; p < np; ++p, dst += N) *dst = src[p];
+        }
+        float *out = job->out + p0;
+        uint16_t *v = buf;
+        if(s->mode == STACK_MEDIAN)
+            for(size_t p = 0; p < np; ++p, v += N) out[p] = median(v, N);
+        else
+            for(size_t p = 0; p < np; ++p, v += N) out[p] = sigclip(v, N, job->kappa, &nrej);
+    }
+    __sync_fetch_and_add(&job->nrej, nrej);
+    FREE(buf);
+    return NULL;
+}
+
+/**
+ * Combine stacked frames
+ * @param s        - stack
+ * @param out      - (o) master frame (w*h values)
+ * @param kappa    - sigma-clipping threshold
+ * @param nthreads - amount of threads (<1 - all CPUs)
+ * @param nrej     - (o, could be NULL) amount of values rejected by sigma-clipping
+ * @return 0 if all OK
+ */
+int stack_combine(stack *s, float *out, double kappa, int nthreads, uint64_t *nrej){
+    if(!s || !s->n || !out) return 1;
+    if(nrej) *nrej = 0;
+    if(s->sum){
+        double n = s->n;
+        for(size_t i = 0; i < s->npix; ++i) out[i] = (float)(s->sum[i] / n);
+        return 0;
+    }
+    combjob job = {.s = s, .out = out, .kappa = kappa > 0. ? kappa : STACK_KAPPA};
+    job.tile = TILE_BYTES / (s->n * sizeof(uint16_t));
+    if(job.tile < TILE_MINPIX) job.tile = TILE_MINPIX;
+    job.ntiles = (s->npix + job.tile - 1) / job.tile;
+    if(nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if((size_t)nthreads > job.ntiles) nthreads = (int)job.ntiles;
+    pthread_t *workers = MALLOC(pthread_t, nthreads);
+    sigset_t all, old;
+    sigfillset(&all); // signals are processed by main thread only
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int nw = 0;
+    for(; nw < nthreads - 1; ++nw)
+        if(pthread_create(&workers[nw], NULL, combine_worker, &job)) break;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    DBG("combine %d frames by %d threads, %zd tiles of %zd pixels", s->n, nw + 1, job.ntiles, job.tile);
+    combine_worker(&job);
+    for(int i = 0; i < nw; ++i) pthread_join(workers[i], NULL);
+    FREE(workers);
+    if(nrej) *nrej = job.nrej;
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * stack.h - stacking of frame series into master frame
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __STACK_H__
+#define __STACK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// max amount of stacked frames
+#define STACK_MAXFRAMES     (65536)
+// default sigma-clipping threshold
+#define STACK_KAPPA         (3.)
+// default size of stack in RAM (MB), larger stacks are spilled to temporary file
+#define STACK_MEMLIMIT      (1024)
+
+typedef enum{
+    STACK_MEAN,     // mean value (frames aren't stored)
+    STACK_MEDIAN,   // median value
+    STACK_SIGCLIP   // mean of values left after iterative sigma-clipping around median
+} stack_mode;
+
+typedef struct stack stack;
+
+int stack_parse(const char *str, stack_mode *mode);
+const char *stack_modename(stack_mode mode);
+stack *stack_new(stack_mode mode, int w, int h, int nmax, size_t memlimit);
+int stack_add(stack *s, const uint16_t *data, int w, int h);
+int stack_count(stack *s);
+int stack_combine(stack *s, float *out, double kappa, int nthreads, uint64_t *nrej);
+void stack_free(stack **s);
+
+#endif // __STACK_H__
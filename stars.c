@@ -0,0 +1,448 @@
+/*
+ * stars.c - detection of stars & measurement of FWHM/HFD
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Background is estimated on mesh of MESH x MESH cells: median & MAD (scaled to
+ * std) of sparse sample of each cell after clipping of bright pixels, then mesh is smoothed by
+ * 3x3 median filter (so cells covered by bright stars don't make holes) and
+ * interpolated bilinearly between centres of cells.
+ * Pixels above background + sigma*noise are joined into 8-connected components.
+ * Frame is processed by bands of rows in several threads; each band labels its
+ * rows with margin of MAXSIZE rows around and keeps components which peak lays
+ * inside band, so each star is found exactly once and bands needn't be merged.
+ * Components larger than MAXSIZE, touching edges of frame or having less than
+ * MINPIX pixels are dropped. Each star is measured in circular aperture around
+ * its peak: centroid, flux, half flux diameter HFD = 2*sum(I*r)/sum(I) (mean
+ * distance of flux from centroid doubled) and FWHM of gaussian with the same
+ * flux & peak. Saturated stars are found but don't go to median FWHM & HFD.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include "stars.h"
+#include "imstat.h"
+#include "usefull_macros.h"
+
+// size of background mesh cell
+#define MESH            (64)
+// rows in band processed by one thread at once
+#define BAND_ROWS       (128)
+// max size of star (pix), also margin of bands
+#define MAXSIZE         (32)
+// min amount of pixels above threshold
+#define MINPIX          (3)
+// min radius of aperture
+#define MINRAD          (6)
+// step of pixels' sample in mesh cell (by both axes)
+#define CELLSTEP        (2)
+
+typedef struct{
+    const uint16_t *data;
+    int w, h;
+    int mw, mh;             // size of mesh
+    float *mbkg, *mnoise;   // background & noise of cells
+    float sigma;            // detection threshold
+    int *colidx;            // cell before each column
+    float *colf;            // and fraction of distance to next cell
+    int njobs, next;        // amount of cells (or bands) & next one to process
+    pthread_mutex_t mutex;
+    star *found;            // stars of all bands
+    int nfound, szfound;
+} starjob;
+
+// median & MAD of n values (buffer is reordered, dev is buffer for deviations)
+static void med_mad(uint16_t *v, long n, uint16_t *dev, float *med, float *mad){
+    uint16_t m = imstat_select(v, n, n / 2);
+    for(long i = 0; i < n; ++i) dev[i] = (v[i] > m) ? v[i] - m : m - v[i];
+    *med = m;
+    *mad = imstat_select(dev, n, n / 2);
+}
+
+// cell i of mesh with n cells along axis of given size: [*start, *end)
+static void cell_range(int i, int n, int size, int *start, int *end){
+    *start = i * MESH;
+    *end = (i == n - 1) ? size : *start + MESH; // last cell takes remainder
+}
+
+static void *mesh_worker(void *arg){
+    starjob *job = (starjob*)arg;
+    int c;
+    uint16_t *buf = MALLOC(uint16_t, 4 * MESH * MESH), *dev = MALLOC(uint16_t, 4 * MESH * MESH);
+    while((c = __sync_fetch_and_add(&job->next, 1)) < job->njobs){
+        int x0, x1, y0, y1;
+        cell_range(c % job->mw, job->mw, job->w, &x0, &x1);
+        cell_range(c / job->mw, job->mh, job->h, &y0, &y1);
+        long n = 0;
+        for(int y = y0; y < y1; y += CELLSTEP){
+            const uint16_t *r = job->data + (size_t)y * job->w;
+            for(int x = x0; x < x1; x += CELLSTEP) buf[n++] = r[x];
+        }
+        float med, mad;
+        med_mad(buf, n, dev, &med, &mad);
+        // once more without stars
+        float thres = med + 3.f * 1.4826f * (mad > 1.f ? mad : 1.f);
+        long nc = 0;
+        for(long i = 0; i < n; ++i) if(buf[i] <= thres) buf[nc++] = buf[i];
+        if(nc > n / 2) med_mad(buf, nc, dev, &med, &mad);
+        job->mbkg[c] = med;
+        mad *= 1.4826f;
+        job->mnoise[c] = (mad < 1.f) ? 1.f : mad;
+    }
+    FREE(buf); FREE(dev);
+    return NULL;
+}
+
+static int fltcmp(const void *a, const void *b){
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// median of n floats (array is sorted)
+static float median(float *v, int n){
+    if(!n) return 0.f;
+    qsort(v, n, sizeof(float), fltcmp);
+    return (n & 1) ? v[n/2] : (v[n/2-1] + v[n/2]) / 2.f;
+}
+
+// 3x3 median filter of mesh
+static void mesh_filter(float *m, int mw, int mh){
+    float *out = MALLOC(float, mw * mh), v[9];
+    for(int y = 0; y < mh; ++y) for(int x = 0; x < mw; ++x){
+        int n = 0;
+        for(int j = y - 1; j <= y + 1; ++j) for(int i = x - 1; i <= x + 1; ++i)
+            if(i > -1 && i < mw && j > -1 && j < mh) v[n++] = m[j * mw + i];
+        out[y * mw + x] = median(v, n);
+    }
+    memcpy(m, out, mw * mh * sizeof(float));
+    FREE(out);
+}
+
+// index of mesh cell before coordinate p & fraction of distance to next one
+static void mesh_pos(float p, int n, int size, int *i, float *f){
+    int s0, e0, s1, e1;
+    *i = 0; *f = 0.f;
+    if(n < 2) return;
+    int k = (int)floorf((p - (MESH - 1) / 2.f) / MESH);
+    if(k < 0) k = 0;
+    if(k > n - 2) k = n - 2;
+    cell_range(k, n, size, &s0, &e0);
+    cell_range(k + 1, n, size, &s1, &e1);
+    float c0 = (s0 + e0 - 1) / 2.f, c1 = (s1 + e1 - 1) / 2.f, t = (p - c0) / (c1 - c0);
+    *i = k;
+    *f = (t < 0.f) ? 0.f : (t > 1.f) ? 1.f : t;
+}
+
+// interpolate mesh m in point (x, y)
+static float mesh_at(const starjob *job, const float *m, float x, float y){
+    int ix, iy;
+    float fx, fy;
+    mesh_pos(x, job->mw, job->w, &ix, &fx);
+    mesh_pos(y, job->mh, job->h, &iy, &fy);
+    const float *r0 = m + iy * job->mw, *r1 = (job->mh > 1) ? r0 + job->mw : r0;
+    int ix1 = (job->mw > 1) ? ix + 1 : ix;
+    float top = r0[ix] + fx * (r0[ix1] - r0[ix]), bot = r1[ix] + fx * (r1[ix1] - r1[ix]);
+    return top + fy * (bot - top);
+}
+
+// thresholds of row y (mrow - buffer for row of mesh)
+static void row_thres(const starjob *job, int y, float *mrow, float *thres){
+    int iy, mw = job->mw;
+    float fy;
+    mesh_pos(y, job->mh, job->h, &iy, &fy);
+    const float *b0 = job->mbkg + iy * mw, *n0 = job->mnoise + iy * mw;
+    const float *b1 = (job->mh > 1) ? b0 + mw : b0, *n1 = (job->mh > 1) ? n0 + mw : n0;
+    for(int i = 0; i < mw; ++i)
+        mrow[i] = b0[i] + fy * (b1[i] - b0[i]) + job->sigma * (n0[i] + fy * (n1[i] - n0[i]));
+    for(int x = 0; x < job->w; ++x){
+        int i = job->colidx[x], i1 = (mw > 1) ? i + 1 : i;
+        thres[x] = mrow[i] + job->colf[x] * (mrow[i1] - mrow[i]);
+    }
+}
+
+/**
+ * Measure star in aperture of radius R around its peak
+ * @return 0 if all OK
+ */
+static int measure(const starjob *job, int px, int py, int R, star *s){
+    const uint16_t *data = job->data;
+    int w = job->w, h = job->h, sat = 0;
+    float bkg = mesh_at(job, job->mbkg, px, py);
+    int x0 = px - R, x1 = px + R, y0 = py - R, y1 = py + R;
+    if(x0 < 0) x0 = 0;
+    if(y0 < 0) y0 = 0;
+    if(x1 > w - 1) x1 = w - 1;
+    if(y1 > h - 1) y1 = h - 1;
+    double F = 0., Sx = 0., Sy = 0., P = 0.;
+    for(int y = y0; y <= y1; ++y){
+        const uint16_t *r = data + (size_t)y * w;
+        for(int x = x0; x <= x1; ++x){
+            if((x - px) * (x - px) + (y - py) * (y - py) > R * R) continue;
+            if(r[x] >= IMSTAT_OVERLOAD) sat = 1;
+            double I = r[x] - bkg;
+            F += I; Sx += I * x; Sy += I * y;
+            if(I > P) P = I;
+        }
+    }
+    if(F <= 0. || P <= 0.) return 1;
+    double xc = Sx / F, yc = Sy / F, Sr = 0.;
+    if(fabs(xc - px) > R || fabs(yc - py) > R) return 1;
+    for(int y = y0; y <= y1; ++y){
+        const uint16_t *r = data + (size_t)y * w;
+        for(int x = x0; x <= x1; ++x){
+            if((x - px) * (x - px) + (y - py) * (y - py) > R * R) continue;
+            Sr += (r[x] - bkg) * sqrt((x - xc) * (x - xc) + (y - yc) * (y - yc));
+        }
+    }
+    if(Sr <= 0.) return 1;
+    s->x = (float)xc; s->y = (float)yc;
+    s->flux = (float)F; s->peak = (float)P;
+    s->hfd = (float)(2. * Sr / F);
+    s->fwhm = (float)(2.3548 * sqrt(F / (2. * M_PI * P)));
+    s->saturated = sat;
+    return 0;
+}
+
+static void *band_worker(void *arg){
+    starjob *job = (starjob*)arg;
+    const uint16_t *data = job->data;
+    int w = job->w, h = job->h, b;
+    size_t regsz = (size_t)w * (BAND_ROWS + 2 * MAXSIZE);
+    uint8_t *mask = MALLOC(uint8_t, regsz); // 0 - background, 1 - star, 2 - labelled
+    uint32_t *stk = MALLOC(uint32_t, regsz); // stack of flood fill
+    float *thres = MALLOC(float, w), *mrow = MALLOC(float, job->mw);
+    star *loc = MALLOC(star, 64);
+    int nloc = 0, szloc = 64;
+    while((b = __sync_fetch_and_add(&job->next, 1)) < job->njobs){
+        int y0 = b * BAND_ROWS, y1 = y0 + BAND_ROWS;
+        if(y1 > h) y1 = h;
+        int ya = (y0 > MAXSIZE) ? y0 - MAXSIZE : 0, yb = (y1 + MAXSIZE < h) ? y1 + MAXSIZE : h;
+        for(int y = ya; y < yb; ++y){
+            const uint16_t *r = data + (size_t)y * w;
+            uint8_t *m = mask + (size_t)(y - ya) * w;
+            row_thres(job, y, mrow, thres);
+            for(int x = 0; x < w; ++x) m[x] = (r[x] > thres[x]);
+        }
+        // components with peak in band have pixels in it, so seeds are there
+        for(int y = y0; y < y1; ++y) for(int x = 0; x < w; ++x){
+            size_t idx = (size_t)(y - ya) * w + x;
+            if(mask[idx] != 1) continue;
+            size_t sp = 0;
+            uint32_t npix = 0;
+            int xmin = x, xmax = x, ymin = y, ymax = y, px = x, py = y, bad = 0;
+            uint16_t peak = 0;
+            mask[idx] = 2;
+            stk[sp++] = (uint32_t)idx;
+            while(sp){
+                idx = stk[--sp];
+                int cx = (int)(idx % w), cy = (int)(idx / w) + ya;
+                uint16_t v = data[(size_t)cy * w + cx];
+                ++npix;
+                if(v > peak){ peak = v; px = cx; py = cy; }
+                if(cx < xmin) xmin = cx;
+                if(cx > xmax) xmax = cx;
+                if(cy < ymin) ymin = cy;
+                if(cy > ymax) ymax = cy;
+                // truncated by region or touches edges of frame
+                if(cy == ya || cy == yb - 1 || cx == 0 || cx == w - 1) bad = 1;
+                for(int j = cy - 1; j <= cy + 1; ++j){
+                    if(j < ya || j >= yb) continue;
+                    for(int i = cx - 1; i <= cx + 1; ++i){
+                        if(i < 0 || i >= w) continue;
+                        size_t n = (size_t)(j - ya) * w + i;
+                        if(mask[n] != 1) continue;
+                        mask[n] = 2;
+                        stk[sp++] = (uint32_t)n;
+                    }
+                }
+            }
+            int sx = xmax - xmin + 1, sy = ymax - ymin + 1;
+            if(bad || npix < MINPIX || sx > MAXSIZE || sy > MAXSIZE || py < y0 || py >= y1) continue;
+            int R = (sx > sy) ? sx : sy;
+            if(R < MINRAD) R = MINRAD;
+            star s;
+            if(measure(job, px, py, R, &s)) continue;
+            s.npix = npix;
+            if(nloc == szloc){
+                szloc *= 2;
+                loc = realloc(loc, szloc * sizeof(star));
+                if(!loc) ERR("realloc()");
+            }
+            loc[nloc++] = s;
+        }
+    }
+    if(nloc){
+        pthread_mutex_lock(&job->mutex);
+        if(job->nfound + nloc > job->szfound){
+            job->szfound = job->nfound + nloc;
+            job->found = realloc(job->found, job->szfound * sizeof(star));
+            if(!job->found) ERR("realloc()");
+        }
+        memcpy(job->found + job->nfound, loc, nloc * sizeof(star));
+        job->nfound += nloc;
+        pthread_mutex_unlock(&job->mutex);
+    }
+    FREE(loc); FREE(thres); FREE(mrow); FREE(stk); FREE(mask);
+    return NULL;
+}
+
+/**
+ * Centroid of the brightest star in small image (e.g. subframe around it):
+ * background & noise by border of image, peak by max of 3x3 sums (single hot
+ * pixels don't win), then flux-weighted centroid of pixels above 3 sigma in
+ * window moved to centroid until it converges
+ * @param img  - image
+ * @param w, h - its size (not less than 3x3)
+ * @param x, y - (o) centroid (pix, from 0)
+ * @param snr  - (o) SNR of 3x3 pixels around peak
+ * @return 0 if star found (its SNR isn't less than CENTROID_SNR)
+ */
+int stars_centroid(const uint16_t *img, int w, int h, double *x, double *y, double *snr){
+    if(!img || w < 3 || h < 3) return 1;
+    int n = 0;
+    float *border = MALLOC(float, 2 * (w + h));
+    for(int i = 0; i < w; ++i){
+        border[n++] = img[i];
+        border[n++] = img[(size_t)(h - 1) * w + i];
+    }
+    for(int j = 1; j < h - 1; ++j){
+        border[n++] = img[(size_t)j * w];
+        border[n++] = img[(size_t)j * w + w - 1];
+    }
+    float bkg = median(border, n);
+    for(int i = 0; i < n; ++i) border[i] = fabsf(border[i] - bkg);
+    double noise = 1.4826 * median(border, n);
+    FREE(border);
+    if(noise < 1.) noise = 1.;
+    int px = 0, py = 0;
+    uint32_t best = 0;
+    for(int j = 1; j < h - 1; ++j) for(int i = 1; i < w - 1; ++i){
+        const uint16_t *p = img + (size_t)(j - 1) * w + i - 1;
+        uint32_t s = p[0] + p[1] + p[2] + p[w] + p[w+1] + p[w+2] + p[2*w] + p[2*w+1] + p[2*w+2];
+        if(s > best){ best = s; px = i; py = j; }
+    }
+    double S2N = (best - 9. * bkg) / (3. * noise);
+    if(snr) *snr = S2N;
+    if(S2N < CENTROID_SNR) return 1;
+    double cx = px, cy = py, R = (w < h ? w : h) / 4.;
+    if(R < 4.) R = 4.;
+    for(int iter = 0; iter < 10; ++iter){
+        double S = 0., Sx = 0., Sy = 0., thres = 3. * noise;
+        int x0 = (int)(cx - R), x1 = (int)(cx + R) + 1, y0 = (int)(cy - R), y1 = (int)(cy + R) + 1;
+        if(x0 < 0) x0 = 0;
+        if(y0 < 0) y0 = 0;
+        if(x1 > w - 1) x1 = w - 1;
+        if(y1 > h - 1) y1 = h - 1;
+        for(int j = y0; j <= y1; ++j){
+            const uint16_t *r = img + (size_t)j * w;
+            for(int i = x0; i <= x1; ++i){
+                if((i - cx) * (i - cx) + (j - cy) * (j - cy) > R * R) continue;
+                double I = r[i] - bkg;
+                if(I < thres) continue;
+                S += I; Sx += I * i; Sy += I * j;
+            }
+        }
+        if(S <= 0.) return 1;
+        double nx = Sx / S, ny = Sy / S, d = fabs(nx - cx) + fabs(ny - cy);
+        cx = nx; cy = ny;
+        if(d < 0.01) break;
+    }
+    *x = cx; *y = cy;
+    return 0;
+}
+
+// run worker in nthreads threads (including current one)
+static void run_workers(void *(*worker)(void*), starjob *job, int nthreads){
+    job->next = 0;
+    if(nthreads > job->njobs) nthreads = job->njobs;
+    pthread_t *workers = MALLOC(pthread_t, nthreads);
+    sigset_t all, old;
+    sigfillset(&all); // signals are processed by main thread only
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int nw = 0;
+    for(; nw < nthreads - 1; ++nw)
+        if(pthread_create(&workers[nw], NULL, worker, job)) break;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    worker(job);
+    for(int i = 0; i < nw; ++i) pthread_join(workers[i], NULL);
+    FREE(workers);
+}
+
+// brighter stars first
+static int fluxcmp(const void *a, const void *b){
+    float x = ((const star*)a)->flux, y = ((const star*)b)->flux;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Find stars on frame and measure them
+ * @param data     - image
+ * @param w, h     - its size
+ * @param sigma    - detection threshold in sigmas of noise (<=0 - STARS_SIGMA)
+ * @param nthreads - amount of threads (<1 - all CPUs)
+ * @param st       - (o) medians of stars' parameters
+ * @param list     - (o, could be NULL) stars sorted by flux (should be FREE'd)
+ * @return 0 if all OK
+ */
+int stars_find(const uint16_t *data, int w, int h, double sigma, int nthreads,
+               stars_stat *st, star **list){
+    if(!data || !st || w < 3 || h < 3) return -1;
+    if(sigma <= 0.) sigma = STARS_SIGMA;
+    if(nthreads < 1) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    starjob job = {.data = data, .w = w, .h = h, .sigma = (float)sigma};
+    job.mw = (w > MESH) ? w / MESH : 1;
+    job.mh = (h > MESH) ? h / MESH : 1;
+    int ncells = job.mw * job.mh;
+    job.mbkg = MALLOC(float, ncells);
+    job.mnoise = MALLOC(float, ncells);
+    job.njobs = ncells;
+    run_workers(mesh_worker, &job, nthreads);
+    if(ncells > 1){
+        mesh_filter(job.mbkg, job.mw, job.mh);
+        mesh_filter(job.mnoise, job.mw, job.mh);
+    }
+    job.colidx = MALLOC(int, w);
+    job.colf = MALLOC(float, w);
+    for(int x = 0; x < w; ++x) mesh_pos(x, job.mw, w, &job.colidx[x], &job.colf[x]);
+    pthread_mutex_init(&job.mutex, NULL);
+    job.njobs = (h + BAND_ROWS - 1) / BAND_ROWS;
+    run_workers(band_worker, &job, nthreads);
+    pthread_mutex_destroy(&job.mutex);
+    // order of bands depends on threads, so sort
+    if(job.nfound) qsort(job.found, job.nfound, sizeof(star), fluxcmp);
+    st->nstars = job.nfound;
+    float *v = MALLOC(float, (job.nfound > ncells) ? job.nfound : ncells);
+    int n = 0;
+    for(int i = 0; i < job.nfound; ++i) if(!job.found[i].saturated) v[n++] = job.found[i].fwhm;
+    st->nmeasured = n;
+    st->fwhm = median(v, n);
+    n = 0;
+    for(int i = 0; i < job.nfound; ++i) if(!job.found[i].saturated) v[n++] = job.found[i].hfd;
+    st->hfd = median(v, n);
+    memcpy(v, job.mbkg, ncells * sizeof(float));
+    st->bkg = median(v, ncells);
+    memcpy(v, job.mnoise, ncells * sizeof(float));
+    st->noise = median(v, ncells);
+    FREE(v); FREE(job.mbkg); FREE(job.mnoise); FREE(job.colidx); FREE(job.colf);
+    if(list) *list = job.found;
+    else FREE(job.found);
+    return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * stars.h - detection of stars & measurement of FWHM/HFD
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __STARS_H__
+#define __STARS_H__
+
+#include <stdint.h>
+
+// default detection threshold (in sigmas of background noise)
+#define STARS_SIGMA     (5.)
+// min SNR of star found by stars_centroid()
+#define CENTROID_SNR    (5.)
+
+// measured star
+typedef struct{
+    float x, y;         // centroid (pix, from 0)
+    float flux;         // flux above background (ADU)
+    float peak;         // peak value above background (ADU)
+    float fwhm;         // FWHM of gaussian with the same flux & peak (pix)
+    float hfd;          // half flux diameter (pix)
+    uint32_t npix;      // amount of pixels above threshold
+    int saturated;      // star has overloaded pixels
+} star;
+
+// result of search
+typedef struct{
+    int nstars;         // amount of stars found
+    int nmeasured;      // amount of unsaturated ones (used for FWHM & HFD)
+    float fwhm, hfd;    // their medians (0 if there's no such stars)
+    float bkg, noise;   // median background level & its noise
+} stars_stat;
+
+int stars_find(const uint16_t *data, int w, int h, double sigma, int nthreads,
+               stars_stat *st, star **list);
+int stars_centroid(const uint16_t *img, int w, int h, double *x, double *y, double *snr);
+
+#endif // __STARS_H__
@@ -0,0 +1,250 @@
+/*
+ * swbin.c - software binning of frames
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Binning NxM (any factors up to SWBIN_MAXFACTOR) of full frame got from camera.
+ * For sum & mean M rows are added to 32-bit accumulators of columns by vector
+ * kernel (AVX2, SSE4.1 or plain C, selected at runtime by CPUID) which also
+ * keeps max of each column, then N adjacent columns are folded. Output pixel is
+ * saturated (65535) when any of its input pixels is overloaded or when sum
+ * doesn't fit 16 bits; amount of such pixels is returned. Median is calculated
+ * by selection among N*M values of each bin.
+ * Output row is formed in own buffer, so binning could be done in place. Work
+ * buffers are allocated once for series (for the widest frame and the largest
+ * bin), each capture thread uses its own set.
+ */
+
+#include <pthread.h>
+#include "swbin.h"
+#include "imstat.h"
+#include "usefull_macros.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+// add row of pixels to accumulators of columns & renew max values of columns
+static void addrow_scalar(const uint16_t *p, size_t n, uint32_t *acc, uint16_t *cmax){
+    for(size_t i = 0; i < n; ++i){
+        acc[i] += p[i];
+        if(cmax[i] < p[i]) cmax[i] = p[i];
+    }
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static void addrow_avx2(const uint16_t *p, size_t n, uint32_t *acc, uint16_t *cmax){
+    size_t nv = n / 16;
+    for(; nv; --nv, p += 16, acc += 16, cmax += 16){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_loadu_si256((const __m256i*)cmax);
+        _mm256_storeu_si256((__m256i*)cmax, _mm256_max_epu16(m, v));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 8));
+        _mm256_storeu_si256((__m256i*)acc, _mm256_add_epi32(a0, lo));
+        _mm256_storeu_si256((__m256i*)(acc + 8), _mm256_add_epi32(a1, hi));
+    }
+    addrow_scalar(p, n % 16, acc, cmax);
+}
+
+__attribute__((target("sse4.1")))
+static void addrow_sse41(const uint16_t *p, size_t n, uint32_t *acc, uint16_t *cmax){
+    size_t nv = n / 8;
+    for(; nv; --nv, p += 8, acc += 8, cmax += 8){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_loadu_si128((const __m128i*)cmax);
+        _mm_storeu_si128((__m128i*)cmax, _mm_max_epu16(m, v));
+        __m128i lo = _mm_cvtepu16_epi32(v), hi = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+        __m128i a0 = _mm_loadu_si128((const __m128i*)acc);
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(acc + 4));
+        _mm_storeu_si128((__m128i*)acc, _mm_add_epi32(a0, lo));
+        _mm_storeu_si128((__m128i*)(acc + 4), _mm_add_epi32(a1, hi));
+    }
+    addrow_scalar(p, n % 8, acc, cmax);
+}
+#endif // X86_KERNELS
+
+typedef void (*addrow_kernel)(const uint16_t *p, size_t n, uint32_t *acc, uint16_t *cmax);
+static addrow_kernel kernel = addrow_scalar;
+static const char *kernelname = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void select_kernel(){
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        kernel = addrow_avx2; kernelname = "AVX2";
+    }else if(__builtin_cpu_supports("sse4.1")){
+        kernel = addrow_sse41; kernelname = "SSE4.1";
+    }
+#endif
+}
+
+// name of binning kernel
+const char *swbin_kernel(){
+    pthread_once(&kernel_once, select_kernel);
+    return kernelname;
+}
+
+static const char *policynames[] = {
+    [SWBIN_SUM] = "sum", [SWBIN_MEAN] = "mean", [SWBIN_MEDIAN] = "median"
+};
+
+const char *swbin_policyname(swbin_policy p){
+    if(p < SWBIN_SUM || p > SWBIN_MEDIAN) return "unknown";
+    return policynames[p];
+}
+
+/**
+ * Parse list of binnings: "NxM[:sum|mean|median][,NxM[:policy]...]"
+ * @param str     - string from cmdline
+ * @param bins    - (o) array of binnings
+ * @param maxbins - its size
+ * @return amount of binnings or -1 if string is wrong
+ */
+int swbin_parse(char *str, swbin *bins, int maxbins){
+    int n = 0;
+    char *saveptr = NULL;
+    for(char *tok = strtok_r(str, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)){
+        if(n == maxbins) return -1;
+        swbin *b = &bins[n];
+        char *pol = strchr(tok, ':'), *eptr;
+        if(pol) *pol++ = 0;
+        b->nx = (int)strtol(tok, &eptr, 10);
+        if(eptr == tok || (*eptr != 'x' && *eptr != 'X')) return -1;
+        tok = eptr + 1;
+        b->ny = (int)strtol(tok, &eptr, 10);
+        if(eptr == tok || *eptr) return -1;
+        if(b->nx < 1 || b->ny < 1 || b->nx > SWBIN_MAXFACTOR || b->ny > SWBIN_MAXFACTOR) return -1;
+        b->policy = SWBIN_SUM;
+        if(pol){
+            int i;
+            for(i = SWBIN_SUM; i <= SWBIN_MEDIAN; ++i)
+                if(strcasecmp(pol, policynames[i]) == 0) break;
+            if(i > SWBIN_MEDIAN) return -1;
+            b->policy = (swbin_policy)i;
+        }
+        ++n;
+    }
+    return n;
+}
+
+// median of one bin
+static uint16_t bin_median(const uint16_t *in, int w, int nx, int ny, uint16_t *buf){
+    int n = nx * ny, k = n / 2;
+    uint16_t *p = buf;
+    for(int y = 0; y < ny; ++y, in += w)
+        for(int x = 0; x < nx; ++x) *p++ = in[x];
+    uint32_t med = imstat_select(buf, n, k);
+    if(!(n & 1)){ // mean of two central values: other one is max of lower part
+        uint16_t lo = buf[0];
+        for(int i = 1; i < k; ++i) if(lo < buf[i]) lo = buf[i];
+        med = (med + lo + 1) / 2;
+    }
+    return (uint16_t)med;
+}
+
+/**
+ * Allocate work buffers for given binnings
+ * @param bins  - binnings
+ * @param nbins - their amount
+ * @param maxw  - max width of frames
+ * @return buffers (free them by swbin_freebuf())
+ */
+swbin_buf *swbin_newbuf(const swbin *bins, int nbins, int maxw){
+    swbin_buf *buf = MALLOC(swbin_buf, 1);
+    buf->maxw = maxw;
+    for(int i = 0; i < nbins; ++i)
+        if(bins[i].policy == SWBIN_MEDIAN && bins[i].nx * bins[i].ny > buf->maxnb)
+            buf->maxnb = bins[i].nx * bins[i].ny;
+    buf->orow = MALLOC(uint16_t, maxw);
+    buf->acc = MALLOC(uint32_t, maxw);
+    buf->cmax = MALLOC(uint16_t, maxw);
+    if(buf->maxnb) buf->mbuf = MALLOC(uint16_t, buf->maxnb);
+    return buf;
+}
+
+void swbin_freebuf(swbin_buf **buf){
+    if(!buf || !*buf) return;
+    swbin_buf *b = *buf;
+    FREE(b->orow); FREE(b->acc); FREE(b->cmax); FREE(b->mbuf);
+    FREE(*buf);
+}
+
+/**
+ * Bin image (remainders of rows & columns not fitting whole bin are dropped)
+ * @param b   - binning parameters
+ * @param in  - input image
+ * @param w,h - its size
+ * @param out - (o) output image of size (w/nx)x(h/ny), could be the same as `in`
+ * @param buf - work buffers made by swbin_newbuf() for `b` & frames not wider than `w`
+ * @return amount of saturated output pixels
+ */
+uint32_t swbin_apply(const swbin *b, const uint16_t *in, int w, int h, uint16_t *out, swbin_buf *buf){
+    int nx = b->nx, ny = b->ny, ow = w / nx, oh = h / ny, nb = nx * ny;
+    size_t cols = (size_t)ow * nx;
+    uint32_t nsat = 0;
+    if(!ow || !oh) return 0;
+    if(w > buf->maxw || (b->policy == SWBIN_MEDIAN && nb > buf->maxnb)){
+        WARNX("swbin_apply(): buffers are too small");
+        return 0;
+    }
+    pthread_once(&kernel_once, select_kernel);
+    uint16_t *orow = buf->orow, *cmax = buf->cmax, *mbuf = NULL;
+    uint32_t *acc = buf->acc;
+    if(b->policy == SWBIN_MEDIAN) mbuf = buf->mbuf;
+    for(int oy = 0; oy < oh; ++oy){
+        const uint16_t *rows = in + (size_t)oy * ny * w;
+        if(mbuf){
+            for(int ox = 0; ox < ow; ++ox){
+                uint16_t v = bin_median(rows + ox * nx, w, nx, ny, mbuf);
+                if(v >= IMSTAT_OVERLOAD) ++nsat;
+                orow[ox] = v;
+            }
+        }else{
+            memset(acc, 0, cols * sizeof(uint32_t));
+            memset(cmax, 0, cols * sizeof(uint16_t));
+            for(int y = 0; y < ny; ++y) kernel(rows + (size_t)y * w, cols, acc, cmax);
+            const uint32_t *a = acc;
+            const uint16_t *m = cmax;
+            for(int ox = 0; ox < ow; ++ox){
+                uint32_t s = 0;
+                uint16_t mx = 0;
+                for(int x = 0; x < nx; ++x, ++a, ++m){
+                    s += *a;
+                    if(mx < *m) mx = *m;
+                }
+                if(b->policy == SWBIN_MEAN) s = (s + nb / 2) / nb;
+                if(mx >= IMSTAT_OVERLOAD || s > 65535){
+                    s = 65535;
+                    ++nsat;
+                }
+                orow[ox] = (uint16_t)s;
+            }
+        }
+        // all input rows of this bin are read, so output row could be written
+        memcpy(out + (size_t)oy * ow, orow, ow * sizeof(uint16_t));
+    }
+    return nsat;
+}
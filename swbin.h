@@ -0,0 +1,60 @@
+/*
+ * swbin.h - software binning of frames
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __SWBIN_H__
+#define __SWBIN_H__
+
+#include <stdint.h>
+
+// max amount of binned products of one frame
+#define SWBIN_MAX       (4)
+// max binning factor on each axis
+#define SWBIN_MAXFACTOR (256)
+
+typedef enum{
+    SWBIN_SUM,      // sum of pixels (saturated at 65535)
+    SWBIN_MEAN,     // mean value
+    SWBIN_MEDIAN    // median value
+} swbin_policy;
+
+// parameters of binning
+typedef struct{
+    int nx, ny;             // binning factors
+    swbin_policy policy;
+} swbin;
+
+// work buffers of binning (one set for each thread binning frames)
+typedef struct{
+    int maxw, maxnb;        // max width of frame & amount of pixels in bin
+    uint16_t *orow;         // output row
+    uint32_t *acc;          // accumulators of columns
+    uint16_t *cmax;         // max values of columns
+    uint16_t *mbuf;         // values of bin for median
+} swbin_buf;
+
+int swbin_parse(char *str, swbin *bins, int maxbins);
+const char *swbin_policyname(swbin_policy p);
+swbin_buf *swbin_newbuf(const swbin *bins, int nbins, int maxw);
+void swbin_freebuf(swbin_buf **buf);
+uint32_t swbin_apply(const swbin *b, const uint16_t *in, int w, int h, uint16_t *out, swbin_buf *buf);
+const char *swbin_kernel();
+
+#endif // __SWBIN_H__
@@ -0,0 +1,137 @@
+/*
+ * timing.c - duration of capture & saving phases
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Durations of phases are added by TIMESTART/TIMEEND macros (usefull_macros.h)
+ * which are empty without -DTIMING (cmake -DUSE_TIMING=yes), so there's no
+ * overhead in normal build. Each measurement could be written into log (CSV
+ * if its name ends with ".csv", JSON lines else), at the end of series
+ * min/mean/99th percentile of each phase are printed (and written into log).
+ */
+
+#ifdef TIMING
+
+#include <pthread.h>
+#include "timing.h"
+#include "usefull_macros.h"
+
+static const char *phasenames[PH_AMOUNT] = {
+    [PH_EXPOSURE] = "exposure", [PH_READCCD] = "readccd", [PH_GETIMAGE] = "getimage", [PH_LIVE] = "live",
+    [PH_DEFECTS] = "defects", [PH_SWBIN] = "swbin", [PH_STAT] = "stat", [PH_STARS] = "stars", [PH_DEMOSAIC] = "demosaic",
+    [PH_STACK] = "stack", [PH_COMBINE] = "combine",
+    [PH_COADD] = "coadd", [PH_HEADER] = "header", [PH_WRITE] = "write",
+    [PH_FSYNC] = "fsync", [PH_PAUSE] = "pause"
+};
+
+typedef struct{
+    double *dur;    // durations
+    size_t n, sz;   // amount & size of array
+} phasestat;
+
+static phasestat stats[PH_AMOUNT];
+static FILE *logf = NULL;
+static int csv = 0;
+static double t0 = -1.;  // time of timing_init()
+static pthread_mutex_t tmutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Start timing of series
+ * @param logfile - name of log file or NULL
+ * @return 0 if all OK
+ */
+int timing_init(const char *logfile){
+    if(logfile){
+        logf = fopen(logfile, "w");
+        if(!logf){
+            WARN("fopen(%s)", logfile);
+            return 1;
+        }
+        size_t l = strlen(logfile);
+        csv = (l > 4 && strcasecmp(logfile + l - 4, ".csv") == 0);
+        if(csv) fprintf(logf, "frame,phase,start,duration\n");
+    }
+    for(int i = 0; i < PH_AMOUNT; ++i) stats[i].n = 0;
+    t0 = dmonotonic();
+    return 0;
+}
+
+/**
+ * Add measurement (called by TIMEEND macro, thread-safe)
+ * @param num   - frame number
+ * @param phase - timing_phase
+ * @param start, end - monotonic time of phase start & end
+ */
+void timing_add(int num, int phase, double start, double end){
+    if(t0 < 0. || phase < 0 || phase >= PH_AMOUNT) return;
+    double d = end - start;
+    pthread_mutex_lock(&tmutex);
+    phasestat *s = &stats[phase];
+    if(s->n == s->sz){
+        s->sz = s->sz ? s->sz * 2 : 256;
+        s->dur = realloc(s->dur, s->sz * sizeof(double));
+        if(!s->dur) ERR("realloc()");
+    }
+    s->dur[s->n++] = d;
+    if(logf){
+        if(csv) fprintf(logf, "%d,%s,%.6f,%.6f\n", num, phasenames[phase], start - t0, d);
+        else fprintf(logf, "{\"frame\":%d,\"phase\":\"%s\",\"start\":%.6f,\"duration\":%.6f}\n",
+                     num, phasenames[phase], start - t0, d);
+    }
+    pthread_mutex_unlock(&tmutex);
+}
+
+static int dblcmp(const void *a, const void *b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Print statistics of all phases & close log
+ * (should be called when all threads are stopped)
+ */
+void timing_finish(){
+    if(t0 < 0.) return;
+    t0 = -1.;
+    /// "Длительность этапов (мс):"
+    green(_("Phases duration (ms):\n"));
+    printf("%-10s %6s %10s %10s %10s\n", "phase", "N", "min", "mean", "p99");
+    for(int i = 0; i < PH_AMOUNT; ++i){
+        phasestat *s = &stats[i];
+        if(!s->n) continue;
+        qsort(s->dur, s->n, sizeof(double), dblcmp);
+        double sum = 0.;
+        for(size_t j = 0; j < s->n; ++j) sum += s->dur[j];
+        size_t i99 = (size_t)(0.99 * s->n + 0.999999);
+        if(i99) --i99;
+        double min = s->dur[0] * 1e3, mean = sum / s->n * 1e3, p99 = s->dur[i99] * 1e3;
+        printf("%-10s %6zd %10.3f %10.3f %10.3f\n", phasenames[i], s->n, min, mean, p99);
+        if(!logf) continue;
+        if(csv) fprintf(logf, "# %s,%zd,%.6f,%.6f,%.6f\n", phasenames[i], s->n, min / 1e3, mean / 1e3, p99 / 1e3);
+        else fprintf(logf, "{\"phase\":\"%s\",\"n\":%zd,\"min\":%.6f,\"mean\":%.6f,\"p99\":%.6f}\n",
+                     phasenames[i], s->n, min / 1e3, mean / 1e3, p99 / 1e3);
+    }
+    if(logf){
+        fclose(logf);
+        logf = NULL;
+    }
+}
+
+#endif // TIMING
@@ -0,0 +1,49 @@
+/*
+ * timing.h - duration of capture & saving phases
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+// measured phases
+typedef enum{
+    PH_EXPOSURE,    // long exposure: from start till its end
+    PH_READCCD,     // readCCD (with exposure for short ones)
+    PH_GETIMAGE,    // image transfer
+    PH_LIVE,        // publishing frame for live view
+    PH_DEFECTS,     // correction of hot pixels & cosmic rays
+    PH_SWBIN,       // software binning
+    PH_STAT,        // statistics
+    PH_STARS,       // search & measurement of stars
+    PH_DEMOSAIC,    // demosaicing of colour frame
+    PH_STACK,       // adding frame to stack
+    PH_COMBINE,     // combination of stack into master frame
+    PH_COADD,       // adding frame to co-add
+    PH_HEADER,      // file creation & header
+    PH_WRITE,       // pixels writing & file closing
+    PH_FSYNC,       // fsync() of file
+    PH_PAUSE,       // pause between exposures
+    PH_AMOUNT
+} timing_phase;
+
+int timing_init(const char *logfile);
+void timing_finish();
+
+#endif // __TIMING_H__
@@ -33,6 +33,16 @@ double dtime(){
     return t;
 }
 
+/**
+ * monotonic time for measurement of intervals (not affected by clock changes)
+ * @return double value: time in seconds
+ */
+double dmonotonic(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ((double)ts.tv_nsec)/1e9;
+}
+
 /******************************************************************************\
  *                          Coloured terminal
 \******************************************************************************/
@@ -49,6 +49,7 @@
 #include <termios.h>
 #include <termio.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
 #include <stdint.h>
 
@@ -95,6 +96,18 @@ extern void signals(int sig);
     #define DBG(...) do{}while(0)
 #endif //EBUG
 
+/*
+ * measurement of program phases duration, -DTIMING (see timing.c)
+ */
+#ifdef TIMING
+    void timing_add(int num, int phase, double start, double end);
+    #define TIMESTART(t)            double t = dmonotonic()
+    #define TIMEEND(t, num, phase)  timing_add(num, phase, t, dmonotonic())
+#else
+    #define TIMESTART(t)            do{}while(0)
+    #define TIMEEND(t, num, phase)  do{}while(0)
+#endif // TIMING
+
 /*
  * Memory allocation
  */
@@ -107,6 +120,7 @@ extern void signals(int sig);
 #endif
 
 double dtime();
+double dmonotonic();
 
 // functions for color output in tty & no-color in pipes
 extern int (*red)(const char *fmt, ...);
@@ -0,0 +1,189 @@
+/*
+ * writer.c - background writing of captured frames
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/*
+ * Captured frames pass through two stages: statistics (one thread) and writing
+ * (one or several threads writing different frames at the same time). Each
+ * stage has a ring of frames, semaphore counts elements in it; ring has one
+ * slot more than frames in processing, so it is empty only when head == tail.
+ * Buffers come from frame pool (framepool.c), so capture blocks when all of
+ * them are busy (back-pressure). Capture threads (main thread or one thread per camera) put
+ * frames into first ring under mutex: writer_stop() takes it too, so frames
+ * captured after the queue was drained are simply released. It isn't called
+ * from signal handler: handler only sets flag, which is checked by capture.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include "framepool.h"
+#include "writer.h"
+
+// max amount of threads in one stage
+#define MAXTHREADS  (16)
+
+typedef struct _stage{
+    frame_handler handler;  // what to do with frame
+    struct _stage *next;    // next stage (NULL - release frame after handler)
+    frame **q;              // ring of frames waiting for processing
+    int head, tail;
+    sem_t nfull;            // amount of frames in ring
+    pthread_mutex_t headmutex; // for several consumers
+    pthread_t threads[MAXTHREADS];
+    int nthreads;
+} stage;
+
+static stage stages[2]; // statistics and writing
+static int qsize = 0;   // size of each ring (max amount of frames + 1)
+static int nsaved = 0;  // amount of frames written
+static double tstart = 0.;  // time of writer start
+// several capture threads put frames into first ring
+static pthread_mutex_t putmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void stage_put(stage *s, frame *f){
+    s->q[s->tail] = f;
+    s->tail = (s->tail + 1) % qsize;
+    sem_post(&s->nfull);
+}
+
+static void *stage_thread(void *arg){
+    stage *s = (stage*) arg;
+    while(1){
+        while(sem_wait(&s->nfull) && errno == EINTR);
+        pthread_mutex_lock(&s->headmutex);
+        if(s->head == s->tail){ // woken by stage_stop() with empty queue
+            pthread_mutex_unlock(&s->headmutex);
+            break;
+        }
+        frame *f = s->q[s->head];
+        s->head = (s->head + 1) % qsize;
+        pthread_mutex_unlock(&s->headmutex);
+        if(s->handler) s->handler(f);
+        if(s->next) stage_put(s->next, f);
+        else{
+            __atomic_add_fetch(&nsaved, 1, __ATOMIC_RELAXED);
+            frame_unref(f);
+        }
+    }
+    return NULL;
+}
+
+static int stage_start(stage *s, frame_handler handler, stage *next, int nthreads){
+    s->handler = handler;
+    s->next = next;
+    s->q = MALLOC(frame*, qsize);
+    s->head = s->tail = 0;
+    s->nthreads = 0;
+    sem_init(&s->nfull, 0, 0);
+    pthread_mutex_init(&s->headmutex, NULL);
+    if(nthreads < 1) nthreads = 1;
+    if(nthreads > MAXTHREADS) nthreads = MAXTHREADS;
+    // signals should be processed only by main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for(int i = 0; i < nthreads; ++i){
+        int r = pthread_create(&s->threads[i], NULL, stage_thread, s);
+        if(r){
+            errno = r;
+            WARN("pthread_create()");
+            break;
+        }
+        ++s->nthreads;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if(!s->nthreads){
+        FREE(s->q);
+        return 1;
+    }
+    return 0;
+}
+
+// process all frames in queue & stop threads
+static void stage_stop(stage *s){
+    int n = s->nthreads;
+    if(!n) return;
+    s->nthreads = 0;
+    // wake up threads: each of them will exit when queue is empty
+    for(int i = 0; i < n; ++i) sem_post(&s->nfull);
+    for(int i = 0; i < n; ++i) pthread_join(s->threads[i], NULL);
+    FREE(s->q);
+    sem_destroy(&s->nfull);
+    pthread_mutex_destroy(&s->headmutex);
+}
+
+/**
+ * Run statistics & writer threads
+ * @param qlen     - max amount of frames in processing (size of frame pool)
+ * @param statfn   - function to calculate frame statistics
+ * @param savefn   - function to save frame (should be thread-safe if nwriters > 1)
+ * @param nwriters - amount of writing threads
+ * @return 0 if all OK
+ */
+int writer_init(int qlen, frame_handler statfn, frame_handler savefn, int nwriters){
+    if(qsize || qlen < 1) return 1;
+    qsize = qlen + 1;
+    nsaved = 0; tstart = dtime();
+    if(stage_start(&stages[1], savefn, NULL, nwriters)) goto bad;
+    if(stage_start(&stages[0], statfn, &stages[1], 1)){
+        stage_stop(&stages[1]);
+        goto bad;
+    }
+    DBG("writer started, queue length %d, %d writing threads", qlen, stages[1].nthreads);
+    return 0;
+bad:
+    qsize = 0;
+    return 1;
+}
+
+/**
+ * Put captured frame into processing queue (could be called from several threads)
+ * @param f - frame got by frame_get(); writer owns this reference
+ */
+void writer_putframe(frame *f){
+    pthread_mutex_lock(&putmutex);
+    if(qsize) stage_put(&stages[0], f);
+    else frame_unref(f); // writer is stopped
+    pthread_mutex_unlock(&putmutex);
+}
+
+/**
+ * Process all frames from queue and stop threads
+ */
+void writer_stop(){
+    if(!qsize) return;
+    pthread_t self = pthread_self();
+    for(int i = 0; i < 2; ++i) // error in one of stages itself
+        for(int j = 0; j < stages[i].nthreads; ++j)
+            if(pthread_equal(self, stages[i].threads[j])) return;
+    DBG("drain writing queue");
+    pthread_mutex_lock(&putmutex);
+    stage_stop(&stages[0]); // statistics stage passes all frames to writer
+    stage_stop(&stages[1]);
+    qsize = 0;
+    pthread_mutex_unlock(&putmutex);
+    if(nsaved){
+        double t = dtime() - tstart, tw = framepool_waittime();
+        green(_("%d frames processed in %.2fs (%.2f frames/s)"), nsaved, t, nsaved / t);
+        if(tw > 0.01) printf(_(", capture waited for free buffer %.2fs"), tw);
+        printf("\n");
+    }
+}
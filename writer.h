@@ -0,0 +1,34 @@
+/*
+ * writer.h - background writing of captured frames
+ *
+ * Copyright 2026 Edward V. Emelianov <eddy@sao.ru, edward.emelianoff@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+#pragma once
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include "main.h"
+
+// function that makes some work with captured frame in one of threads
+typedef void (*frame_handler)(frame *f);
+
+int writer_init(int qlen, frame_handler statfn, frame_handler savefn, int nwriters);
+void writer_putframe(frame *f);
+void writer_stop();
+
+#endif // __WRITER_H__